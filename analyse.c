@@ -0,0 +1,303 @@
+/* GStreamer
+ *
+ * Copyright (C) 2016 William Manley <will@williammanley.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Offline analysis of a recorded capture.
+ *
+ * The file is split into as many segments as there are jobs.  Every segment
+ * is decoded by its own pipeline, without clock sync, after a flushing seek
+ * to its start.  The per-frame results posted by timeoverlayparse are
+ * collected per segment and printed in file order as CSV on stdout. */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <gst/gst.h>
+
+typedef struct {
+  guint64 pts;
+  guint64 frame_id;
+  guint64 remote_time;
+  guint64 receive_time;
+  gint64 latency;
+  guint64 cost;
+} FrameResult;
+
+typedef struct {
+  GstElement *pipeline;
+  GstClockTime start;
+  GstClockTime stop;
+  GArray *results;
+  gboolean failed;
+} Segment;
+
+static gchar *location = NULL;
+static gint jobs = 0;
+static gchar *fec_scheme = NULL;
+static gchar *receive_time = "pts";
+static gint64 pts_offset = 0;
+static gboolean cost = FALSE;
+
+static GOptionEntry entries[] = {
+  { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+    "Number of segments decoded in parallel (default: number of CPUs)", "N" },
+  { "fec-scheme", 'f', 0, G_OPTION_ARG_STRING, &fec_scheme,
+    "fec-scheme of timeoverlayparse", "SCHEME" },
+  { "receive-time", 'r', 0, G_OPTION_ARG_STRING, &receive_time,
+    "receive-time of timeoverlayparse: pts or reference-timestamp "
+    "(default: pts)", "SOURCE" },
+  { "pts-offset", 'o', 0, G_OPTION_ARG_INT64, &pts_offset,
+    "Nanoseconds to add to the recorded PTS to get CLOCK_REALTIME", "NS" },
+  { "cost", 'c', 0, G_OPTION_ARG_NONE, &cost,
+    "Add the time timeoverlayparse took for every frame as a column",
+    NULL },
+  { NULL }
+};
+
+static GstElement *
+create_pipeline (void)
+{
+  GstElement *pipeline, *src, *parse;
+  GError *err = NULL;
+
+  pipeline = gst_parse_launch (
+      "filesrc name=src "
+      "! decodebin "
+      "! videoconvert "
+      "! timeoverlayparse name=parse post-messages=true "
+      "! fakesink sync=false", &err);
+  if (err) {
+    g_printerr ("Error creating pipeline: %s\n", err->message);
+    g_error_free (err);
+    return NULL;
+  }
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  g_object_set (src, "location", location, NULL);
+  gst_object_unref (src);
+
+  parse = gst_bin_get_by_name (GST_BIN (pipeline), "parse");
+  gst_util_set_object_arg (G_OBJECT (parse), "receive-time", receive_time);
+  g_object_set (parse, "pts-offset", pts_offset, NULL);
+  if (fec_scheme)
+    gst_util_set_object_arg (G_OBJECT (parse), "fec-scheme", fec_scheme);
+  g_object_set (parse, "cost", cost, NULL);
+  gst_object_unref (parse);
+
+  return pipeline;
+}
+
+static gboolean
+preroll (GstElement * pipeline)
+{
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  return gst_element_get_state (pipeline, NULL, NULL, GST_CLOCK_TIME_NONE)
+      != GST_STATE_CHANGE_FAILURE;
+}
+
+static gpointer
+run_segment (gpointer data)
+{
+  Segment *seg = data;
+  GstBus *bus;
+  GstMessage *msg;
+  gboolean done = FALSE;
+
+  /* The preroll posted the results of the frames it decoded, and the seek
+   * decodes them again.  The streaming thread is blocked in the prerolled
+   * sink, so nothing else can be on the bus yet. */
+  bus = gst_element_get_bus (seg->pipeline);
+  gst_bus_set_flushing (bus, TRUE);
+  gst_bus_set_flushing (bus, FALSE);
+
+  if (!gst_element_seek (seg->pipeline, 1.0, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+          GST_SEEK_TYPE_SET, seg->start, GST_SEEK_TYPE_SET, seg->stop)) {
+    g_printerr ("Seek to %" GST_TIME_FORMAT " failed\n",
+        GST_TIME_ARGS (seg->start));
+    gst_object_unref (bus);
+    seg->failed = TRUE;
+    return NULL;
+  }
+  /* Wait for the preroll at the new position */
+  gst_element_get_state (seg->pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+  gst_element_set_state (seg->pipeline, GST_STATE_PLAYING);
+
+  while (!done) {
+    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT);
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+      case GST_MESSAGE_ELEMENT: {
+        const GstStructure *s = gst_message_get_structure (msg);
+        FrameResult r;
+
+        if (!gst_structure_has_name (s, "timeoverlayparse"))
+          break;
+        gst_structure_get (s,
+            "pts", G_TYPE_UINT64, &r.pts,
+            "frame-id", G_TYPE_UINT64, &r.frame_id,
+            "remote-time", G_TYPE_UINT64, &r.remote_time,
+            "receive-time", G_TYPE_UINT64, &r.receive_time,
+            "latency", G_TYPE_INT64, &r.latency,
+            NULL);
+        r.cost = 0;
+        gst_structure_get_uint64 (s, "cost", &r.cost);
+        /* Accurate seeks may still let a few frames through from before
+         * the segment start; those belong to the previous segment. */
+        if (r.pts >= seg->start && r.pts < seg->stop)
+          g_array_append_val (seg->results, r);
+        break;
+      }
+      case GST_MESSAGE_ERROR: {
+        GError *error;
+
+        gst_message_parse_error (msg, &error, NULL);
+        g_printerr ("Error: %s\n", error->message);
+        g_error_free (error);
+        seg->failed = TRUE;
+        done = TRUE;
+        break;
+      }
+      case GST_MESSAGE_EOS:
+        done = TRUE;
+        break;
+      default:
+        break;
+    }
+    gst_message_unref (msg);
+  }
+  gst_object_unref (bus);
+
+  gst_element_set_state (seg->pipeline, GST_STATE_NULL);
+  return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GThread **threads;
+  Segment *segments;
+  GstElement *pipeline;
+  gint64 duration;
+  guint64 frames = 0;
+  gint64 lat_min = G_MAXINT64, lat_max = G_MININT64;
+  gdouble lat_sum = 0;
+  guint64 cost_sum = 0, cost_max = 0;
+  int i, res = 0;
+
+  ctx = g_option_context_new ("FILE - analyse a recorded latency-clock capture");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (argc != 2) {
+    g_printerr ("Usage: %s [OPTION...] FILE\n", argv[0]);
+    return 1;
+  }
+  location = argv[1];
+  if (jobs <= 0)
+    jobs = g_get_num_processors ();
+
+  /* The first pipeline doubles as the probe for the file's duration */
+  pipeline = create_pipeline ();
+  if (!pipeline || !preroll (pipeline)) {
+    g_printerr ("Failed to preroll %s\n", location);
+    return 1;
+  }
+  if (!gst_element_query_duration (pipeline, GST_FORMAT_TIME, &duration) ||
+      duration <= 0) {
+    g_printerr ("Unknown duration, decoding %s as a single segment\n",
+        location);
+    duration = GST_CLOCK_TIME_NONE;
+    jobs = 1;
+  }
+
+  segments = g_new0 (Segment, jobs);
+  threads = g_new0 (GThread *, jobs);
+  for (i = 0; i < jobs; i++) {
+    Segment *seg = &segments[i];
+
+    seg->pipeline = (i == 0) ? pipeline : create_pipeline ();
+    if (!seg->pipeline || !preroll (seg->pipeline)) {
+      g_printerr ("Failed to preroll %s\n", location);
+      return 1;
+    }
+    if (duration == GST_CLOCK_TIME_NONE) {
+      seg->start = 0;
+      seg->stop = GST_CLOCK_TIME_NONE;
+    } else {
+      seg->start = gst_util_uint64_scale (duration, i, jobs);
+      seg->stop = gst_util_uint64_scale (duration, i + 1, jobs);
+    }
+    seg->results = g_array_new (FALSE, FALSE, sizeof (FrameResult));
+    threads[i] = g_thread_new ("segment", run_segment, seg);
+  }
+
+  printf ("pts,frame_id,remote_time,receive_time,latency%s\n",
+      cost ? ",cost" : "");
+  for (i = 0; i < jobs; i++) {
+    Segment *seg = &segments[i];
+    guint j;
+
+    g_thread_join (threads[i]);
+    if (seg->failed)
+      res = 1;
+
+    for (j = 0; j < seg->results->len; j++) {
+      FrameResult *r = &g_array_index (seg->results, FrameResult, j);
+
+      printf ("%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+          ",%" G_GUINT64_FORMAT ",%" G_GINT64_FORMAT,
+          r->pts, r->frame_id, r->remote_time, r->receive_time, r->latency);
+      if (cost)
+        printf (",%" G_GUINT64_FORMAT, r->cost);
+      printf ("\n");
+      frames++;
+      cost_sum += r->cost;
+      cost_max = MAX (cost_max, r->cost);
+      lat_sum += r->latency;
+      lat_min = MIN (lat_min, r->latency);
+      lat_max = MAX (lat_max, r->latency);
+    }
+    g_array_free (seg->results, TRUE);
+    gst_object_unref (seg->pipeline);
+  }
+
+  if (frames > 0) {
+    g_printerr ("Frames: %" G_GUINT64_FORMAT "; Latency min/mean/max: "
+        "%" G_GINT64_FORMAT "/%.0f/%" G_GINT64_FORMAT " ns",
+        frames, lat_min, lat_sum / frames, lat_max);
+    if (cost)
+      g_printerr ("; Parse cost mean/max: %" G_GUINT64_FORMAT "/%"
+          G_GUINT64_FORMAT " ns", cost_sum / frames, cost_max);
+    g_printerr ("\n");
+  } else
+    g_printerr ("No timestamps found in %s\n", location);
+
+  g_free (segments);
+  g_free (threads);
+  return res;
+}
@@ -0,0 +1,346 @@
+/* GStreamer
+ *
+ * Copyright (C) 2016 William Manley <will@williammanley.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks the accuracy of the whole measurement path.
+ *
+ * timestampoverlay and timeoverlayparse are joined by latencyinject, which
+ * delays every frame by a known amount.  The latency reported by the parser
+ * for every frame is compared with the delay injected into it; the run
+ * fails if any of them is further off than the tolerance.  The latency is
+ * only exact when the payload carries the exact send time, which needs the
+ * header, so frames without it fail too.
+ *
+ * With --rtp the same is done for rtptimestampinsert and rtptimestampparse:
+ * the packets are delayed between the two and sent over a udpsink/udpsrc
+ * loopback, and the transit time of every packet must be the injected delay
+ * give or take the tolerance. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+
+static gchar *mode = "constant";
+static gdouble delay_ms = 20;
+static gdouble jitter_ms = 0;
+static gchar *trace = NULL;
+static gint seed = 0;
+static gint fps = 240;
+static gint frames = 1200;
+static gdouble tolerance_ms = 2;
+static gboolean rtp = FALSE;
+static gint rtp_port = 5004;
+
+static GOptionEntry entries[] = {
+  { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+    "mode of latencyinject: constant, uniform or trace (default: constant)",
+    "MODE" },
+  { "delay", 'd', 0, G_OPTION_ARG_DOUBLE, &delay_ms,
+    "Injected delay in milliseconds (default: 20)", "MS" },
+  { "jitter", 'j', 0, G_OPTION_ARG_DOUBLE, &jitter_ms,
+    "Largest injected jitter in milliseconds in uniform mode", "MS" },
+  { "trace", 't', 0, G_OPTION_ARG_FILENAME, &trace,
+    "Trace of delays in milliseconds, one per line, for trace mode", "FILE" },
+  { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed of the jitter", "N" },
+  { "fps", 'f', 0, G_OPTION_ARG_INT, &fps,
+    "Frame rate of the test video (default: 240)", "FPS" },
+  { "frames", 'n', 0, G_OPTION_ARG_INT, &frames,
+    "Number of frames to send (default: 1200)", "N" },
+  { "tolerance", 'T', 0, G_OPTION_ARG_DOUBLE, &tolerance_ms,
+    "Largest accepted error in milliseconds (default: 2)", "MS" },
+  { "rtp", 0, 0, G_OPTION_ARG_NONE, &rtp,
+    "Check rtptimestampinsert and rtptimestampparse over UDP loopback "
+    "instead", NULL },
+  { "rtp-port", 0, 0, G_OPTION_ARG_INT, &rtp_port,
+    "UDP port of the loopback for --rtp (default: 5004)", "PORT" },
+  { NULL }
+};
+
+static void
+configure_inject (GstElement *pipeline)
+{
+  GstElement *inject = gst_bin_get_by_name (GST_BIN (pipeline), "inject");
+
+  gst_util_set_object_arg (G_OBJECT (inject), "mode", mode);
+  g_object_set (inject,
+      "delay", (guint64) (delay_ms * GST_MSECOND),
+      "jitter", (guint64) (jitter_ms * GST_MSECOND),
+      "seed", (guint) seed,
+      NULL);
+  if (trace)
+    g_object_set (inject, "trace-location", trace, NULL);
+  gst_object_unref (inject);
+}
+
+/* Returns FALSE if pipeline posted an error */
+static gboolean
+wait_eos (GstElement *pipeline)
+{
+  GstBus *bus = gst_element_get_bus (pipeline);
+  GstMessage *msg;
+  gboolean ok = TRUE;
+
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GError *error;
+
+    gst_message_parse_error (msg, &error, NULL);
+    g_printerr ("Error: %s\n", error->message);
+    g_error_free (error);
+    ok = FALSE;
+  }
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  return ok;
+}
+
+/* The RTP loopback.  latencyinject keeps the packets in order, so a packet
+ * is held for at most delay plus jitter after it arrives, never less than
+ * delay. */
+static int
+check_rtp (void)
+{
+  GError *err = NULL;
+  GstElement *sender = NULL, *receiver;
+  GstBus *bus;
+  GstMessage *msg;
+  gboolean failed;
+  guint64 checked = 0, outside = 0;
+  gint64 err_min = G_MAXINT64, err_max = G_MININT64;
+  gdouble err_sum = 0;
+  gchar *description;
+
+  if (strcmp (mode, "trace") == 0) {
+    g_printerr ("--rtp needs the constant or uniform mode\n");
+    return 1;
+  }
+
+  description = g_strdup_printf (
+      "udpsrc address=127.0.0.1 port=%d "
+      "caps=\"application/x-rtp,media=video,clock-rate=90000,"
+      "encoding-name=RAW\" "
+      "! rtptimestampparse post-packet-messages=true "
+      "! fakesink sync=false", rtp_port);
+  receiver = gst_parse_launch (description, &err);
+  g_free (description);
+  if (!err) {
+    description = g_strdup_printf (
+        "videotestsrc is-live=true num-buffers=%d "
+        "! video/x-raw,format=RGB,width=160,height=120,framerate=%d/1 "
+        "! rtpvrawpay "
+        "! rtptimestampinsert "
+        "! latencyinject name=inject "
+        "! udpsink host=127.0.0.1 port=%d sync=false", frames, fps, rtp_port);
+    sender = gst_parse_launch (description, &err);
+    g_free (description);
+  }
+  if (err) {
+    g_printerr ("Error creating pipeline: %s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+  configure_inject (sender);
+
+  gst_element_set_state (receiver, GST_STATE_PLAYING);
+  gst_element_set_state (sender, GST_STATE_PLAYING);
+  failed = !wait_eos (sender);
+  /* The last packets are still on their way */
+  g_usleep ((delay_ms + jitter_ms) * 1000 + G_USEC_PER_SEC / 10);
+  gst_element_set_state (sender, GST_STATE_NULL);
+  gst_object_unref (sender);
+
+  bus = gst_element_get_bus (receiver);
+  while ((msg = gst_bus_pop_filtered (bus,
+              GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT))) {
+    const GstStructure *s = gst_message_get_structure (msg);
+    gint64 transit, error;
+
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+      failed = TRUE;
+    } else if (gst_structure_has_name (s, "rtptimestampparse-packet") &&
+        gst_structure_get_int64 (s, "transit", &transit)) {
+      error = transit - (gint64) (delay_ms * GST_MSECOND);
+      checked++;
+      err_sum += error;
+      err_min = MIN (err_min, error);
+      err_max = MAX (err_max, error);
+      if (error < -tolerance_ms * GST_MSECOND ||
+          error > (jitter_ms + tolerance_ms) * GST_MSECOND)
+        outside++;
+    }
+    gst_message_unref (msg);
+  }
+  gst_object_unref (bus);
+  gst_element_set_state (receiver, GST_STATE_NULL);
+  gst_object_unref (receiver);
+
+  if (checked == 0) {
+    g_printerr ("No packet arrived\n");
+    return 1;
+  }
+  printf ("Packets: %" G_GUINT64_FORMAT "; transit minus delay min/mean/max: "
+      "%.3f/%.3f/%.3f ms; outside -%.3f..+%.3f ms: %" G_GUINT64_FORMAT "\n",
+      checked, err_min / 1e6, err_sum / checked / 1e6, err_max / 1e6,
+      tolerance_ms, jitter_ms + tolerance_ms, outside);
+
+  return (failed || outside > 0) ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GstElement *pipeline;
+  GHashTable *injected, *measured;
+  GHashTableIter iter;
+  gpointer key, value;
+  GstBus *bus;
+  GstMessage *msg;
+  gboolean done = FALSE, failed = FALSE;
+  guint64 checked = 0, outside = 0, inexact = 0;
+  gint64 err_min = G_MAXINT64, err_max = G_MININT64;
+  gdouble err_sum = 0;
+  gchar *description;
+
+  ctx = g_option_context_new ("- check the latency measured by "
+      "timeoverlayparse against an injected delay");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (rtp)
+    return check_rtp ();
+
+  description = g_strdup_printf (
+      "videotestsrc is-live=true pattern=black num-buffers=%d "
+      "! video/x-raw,format=BGRx,width=640,height=480,framerate=%d/1 "
+      "! timestampoverlay header=true "
+      "! latencyinject name=inject post-messages=true "
+      "! timeoverlayparse post-messages=true "
+      "! fakesink sync=false", frames, fps);
+  pipeline = gst_parse_launch (description, &err);
+  g_free (description);
+  if (err) {
+    g_printerr ("Error creating pipeline: %s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+
+  configure_inject (pipeline);
+
+  /* PTS -> nanoseconds; the parser posts before latencyinject does, so the
+   * two are matched up at the end */
+  injected = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free,
+      g_free);
+  measured = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free,
+      g_free);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (pipeline);
+  while (!done) {
+    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT);
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+      case GST_MESSAGE_ELEMENT: {
+        const GstStructure *s = gst_message_get_structure (msg);
+        guint64 pts;
+        gint64 ns;
+        gboolean exact;
+
+        if (!gst_structure_get_uint64 (s, "pts", &pts))
+          break;
+        if (gst_structure_has_name (s, "latencyinject") &&
+            gst_structure_get_uint64 (s, "delay", (guint64 *) &ns))
+          g_hash_table_insert (injected, g_memdup2 (&pts, sizeof (pts)),
+              g_memdup2 (&ns, sizeof (ns)));
+        else if (gst_structure_has_name (s, "timeoverlayparse") &&
+            gst_structure_get_int64 (s, "latency", &ns)) {
+          if (gst_structure_get_boolean (s, "exact", &exact) && exact)
+            g_hash_table_insert (measured, g_memdup2 (&pts, sizeof (pts)),
+                g_memdup2 (&ns, sizeof (ns)));
+          else
+            inexact++;
+        }
+        break;
+      }
+      case GST_MESSAGE_ERROR: {
+        GError *error;
+
+        gst_message_parse_error (msg, &error, NULL);
+        g_printerr ("Error: %s\n", error->message);
+        g_error_free (error);
+        failed = TRUE;
+        done = TRUE;
+        break;
+      }
+      case GST_MESSAGE_EOS:
+        done = TRUE;
+        break;
+      default:
+        break;
+    }
+    gst_message_unref (msg);
+  }
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  g_hash_table_iter_init (&iter, measured);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    gint64 *expected = g_hash_table_lookup (injected, key);
+    gint64 error;
+
+    if (!expected)
+      continue;
+    error = *(gint64 *) value - *expected;
+    checked++;
+    err_sum += error;
+    err_min = MIN (err_min, error);
+    err_max = MAX (err_max, error);
+    if (ABS (error) > tolerance_ms * GST_MSECOND) {
+      outside++;
+      g_printerr ("Frame at %" GST_TIME_FORMAT ": injected %.3f ms, "
+          "measured %.3f ms\n", GST_TIME_ARGS (*(guint64 *) key),
+          *expected / 1e6, *(gint64 *) value / 1e6);
+    }
+  }
+  g_hash_table_unref (injected);
+  g_hash_table_unref (measured);
+
+  if (inexact > 0)
+    g_printerr ("%" G_GUINT64_FORMAT " frames without the exact send time\n",
+        inexact);
+  if (checked == 0) {
+    g_printerr ("No frame was both injected and measured\n");
+    return 1;
+  }
+  printf ("Frames: %" G_GUINT64_FORMAT "/%d; error min/mean/max: "
+      "%.3f/%.3f/%.3f ms; outside +/-%.3f ms: %" G_GUINT64_FORMAT "\n",
+      checked, frames, err_min / 1e6, err_sum / checked / 1e6, err_max / 1e6,
+      tolerance_ms, outside);
+
+  return (failed || outside > 0 || inexact > 0) ? 1 : 0;
+}
@@ -23,7 +23,76 @@
 #include <stdlib.h>
 #include <gst/gst.h>
 
+#include "rtsched.h"
+
 static gboolean bus_call (GstBus *bus, GstMessage *msg, gpointer data);
+static gboolean report_lateness (gpointer data);
+static void count_mode (const GstStructure *s, gint64 latency);
+static gboolean flush_mode (gpointer data);
+static void take_cost (const GstStructure *s);
+static void set_time_source (GstBin *bin, const gchar *name);
+static void print_cost (void);
+
+static gchar *time_source = NULL;
+static gchar *net_clock_address = NULL;
+static gint net_clock_port = 0;
+static gchar *reflect_sink = NULL;
+static gchar *fec_feedback = NULL;
+static gint fec_feedback_port = 0;
+static gboolean mjpeg = FALSE;
+static gboolean modes = FALSE;
+static gboolean cost = FALSE;
+static gboolean cost_perf = FALSE;
+
+static GOptionEntry entries[] = {
+  { "time-source", 't', 0, G_OPTION_ARG_STRING, &time_source,
+    "time-source of the parsers: realtime, tai, pipeline, net-client "
+    "or ptp (default: realtime)", "SOURCE" },
+  { "net-clock-address", 0, 0, G_OPTION_ARG_STRING, &net_clock_address,
+    "Address of the server's network clock for --time-source=net-client",
+    "ADDRESS" },
+  { "net-clock-port", 0, 0, G_OPTION_ARG_INT, &net_clock_port,
+    "Port of the server's network clock for --time-source=net-client",
+    "PORT" },
+  { "reflect", 'r', 0, G_OPTION_ARG_STRING, &reflect_sink,
+    "Send the captured video back to the server through timestampreflect "
+    "and PIPELINE, so it can measure the round-trip time", "PIPELINE" },
+  { "fec-feedback", 0, 0, G_OPTION_ARG_STRING, &fec_feedback,
+    "Report the decoding errors and corrections to the server at ADDRESS, "
+    "for its adaptive FEC", "ADDRESS" },
+  { "fec-feedback-port", 0, 0, G_OPTION_ARG_INT, &fec_feedback_port,
+    "UDP port of the server for --fec-feedback (default: 5638)", "PORT" },
+  { "mjpeg", 'j', 0, G_OPTION_ARG_NONE, &mjpeg,
+    "Capture MJPEG and decode only the code block with jpegtimestampdec",
+    NULL },
+  { "modes", 'm', 0, G_OPTION_ARG_NONE, &modes,
+    "Print the latency of every mode of server --sweep", NULL },
+  { "cost", 0, 0, G_OPTION_ARG_NONE, &cost,
+    "Print the cost of timeoverlayparse next to the latencies", NULL },
+  { "cost-perf", 0, 0, G_OPTION_ARG_NONE, &cost_perf,
+    "Count the CPU cycles and cache misses of timeoverlayparse (implies "
+    "--cost)", NULL },
+  { NULL }
+};
+
+/* The size the capture is asked for */
+#define CAPTURE_WIDTH 1280
+#define CAPTURE_HEIGHT 720
+
+/* Video latencies since the last report */
+static guint64 latency_frames = 0;
+static gint64 latency_min = G_MAXINT64, latency_max = G_MININT64;
+
+/* Video latencies of the current mode of server --sweep */
+static gint mode_width = 0, mode_height = 0, mode_fps_n = 0, mode_fps_d = 0;
+static guint64 mode_frames = 0;
+static gint64 mode_min, mode_max, mode_sum;
+static gint64 mode_last_frame = 0;
+
+/* Cost of timeoverlayparse since the start, from its last
+ * timeoverlayparse-cost message */
+static guint64 cost_frames = 0, cost_mean = 0, cost_max = 0;
+static guint64 cost_cycles = 0, cost_cache_misses = 0;
 
 int main(int argc, char* argv[])
 {
@@ -31,13 +100,31 @@ int main(int argc, char* argv[])
   GstBus *bus;
   GstElement * epipeline;
   GstPipeline * pipeline;
+  GstElement * parse;
   GstClock* clock;
+  GOptionContext *ctx;
   GError * err = NULL;
-  gchar * source_pipeline;
+  gchar * source_pipeline, * audio_description, * video_sink;
   struct timespec ts;
   int res;
 
-  gst_init(&argc, &argv);
+  ctx = g_option_context_new ("[SOURCE-PIPELINE [AUDIO-SOURCE-PIPELINE]]");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_main_entries (ctx, rtsched_entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (cost_perf)
+    cost = TRUE;
+
+  /* jpegtimestampdec leaves nothing of the picture to reflect */
+  if (mjpeg && reflect_sink) {
+    g_printerr ("--mjpeg and --reflect can't be used together\n");
+    return 1;
+  }
 
   loop = g_main_loop_new (NULL, FALSE);
 
@@ -46,11 +133,36 @@ int main(int argc, char* argv[])
   else
     source_pipeline = "v4l2src";
 
+  /* With an audio source both parsers post their results so the A/V skew
+   * can be printed */
+  if (argc > 2)
+    audio_description = g_strdup_printf (
+        " %s "
+        "! audioconvert "
+        "! audiotimeoverlayparse name=audioparse post-messages=true "
+        "! fakesink", argv[2]);
+  else
+    audio_description = g_strdup ("");
+
+  if (reflect_sink)
+    video_sink = g_strdup_printf (
+        "videoconvert "
+        "! timestampreflect "
+        "! videoconvert "
+        "! %s", reflect_sink);
+  else
+    video_sink = g_strdup ("fakesink");
+
   epipeline = gst_parse_launch (g_strdup_printf (
       "%s "
-      "! video/x-raw,width=1280,height=720 "
-      "! timeoverlayparse "
-      "! fakesink", source_pipeline), &err);
+      "! %s,width=%d,height=%d "
+      "%s"
+      "! timeoverlayparse name=parse post-messages=%s "
+      "! %s%s", source_pipeline,
+      mjpeg ? "image/jpeg" : "video/x-raw", CAPTURE_WIDTH, CAPTURE_HEIGHT,
+      mjpeg ? "! jpegtimestampdec " : "",
+      argc > 2 || rtsched_enabled () || modes || cost ? "true" : "false",
+      video_sink, audio_description), &err);
 
   if (err) {
     fprintf(stderr, "Error creating pipeline: %s\n", err->message);
@@ -59,6 +171,26 @@ int main(int argc, char* argv[])
   g_return_val_if_fail (epipeline != NULL, 1);
   pipeline = GST_PIPELINE(epipeline);
 
+  set_time_source (GST_BIN (pipeline), "parse");
+  set_time_source (GST_BIN (pipeline), "audioparse");
+
+  parse = gst_bin_get_by_name (GST_BIN (pipeline), "parse");
+  if (fec_feedback)
+    g_object_set (parse, "feedback-address", fec_feedback, NULL);
+  if (fec_feedback_port)
+    g_object_set (parse, "feedback-port", fec_feedback_port, NULL);
+  /* The cost of parsing is printed with the latencies it is part of */
+  if (rtsched_enabled () || modes || cost)
+    g_object_set (parse, "cost", TRUE, "cost-perf", cost_perf, NULL);
+  gst_object_unref (parse);
+
+  if (!rtsched_setup (epipeline))
+    return 1;
+  if (rtsched_enabled () || cost)
+    g_timeout_add_seconds (1, report_lateness, NULL);
+  if (modes)
+    g_timeout_add_seconds (1, flush_mode, NULL);
+
   /* we add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
   gst_bus_add_watch (bus, bus_call, loop);
@@ -84,9 +216,42 @@ static gboolean
 bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 {
   GMainLoop *loop = (GMainLoop *) data;
+  static gint64 video_latency = G_MININT64;
 
   switch (GST_MESSAGE_TYPE (msg)) {
 
+    case GST_MESSAGE_ELEMENT: {
+      const GstStructure *s = gst_message_get_structure (msg);
+      gint64 latency;
+
+      if (gst_structure_has_name (s, "timeoverlayparse-cost")) {
+        take_cost (s);
+        break;
+      }
+      if (!gst_structure_get_int64 (s, "latency", &latency))
+        break;
+      if (gst_structure_has_name (s, "timeoverlayparse")) {
+        gboolean exact = FALSE;
+
+        /* The skew is only as good as the video latency it is taken from,
+         * so a latency from the masked first word doesn't make one */
+        gst_structure_get_boolean (s, "exact", &exact);
+        video_latency = exact ? latency : G_MININT64;
+        latency_frames++;
+        latency_min = MIN (latency_min, latency);
+        latency_max = MAX (latency_max, latency);
+        if (modes)
+          count_mode (s, latency);
+      } else if (gst_structure_has_name (s, "audiotimeoverlayparse")) {
+        if (video_latency != G_MININT64)
+          g_print ("Audio latency: %" G_GINT64_FORMAT "; A/V skew: %"
+              G_GINT64_FORMAT "\n", latency, latency - video_latency);
+        else
+          g_print ("Audio latency: %" G_GINT64_FORMAT "\n", latency);
+      }
+      break;
+    }
+
     case GST_MESSAGE_EOS:
       g_print ("End of stream\n");
       g_main_loop_quit (loop);
@@ -111,3 +276,144 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 
   return TRUE;
 }
+
+/* Prints the latency of the current mode */
+static void
+report_mode (void)
+{
+  if (mode_frames == 0)
+    return;
+  g_print ("Mode %dx%d@%d/%d: latency min/mean/max %" G_GINT64_FORMAT "/%"
+      G_GINT64_FORMAT "/%" G_GINT64_FORMAT " ns over %" G_GUINT64_FORMAT
+      " frames", mode_width, mode_height, mode_fps_n, mode_fps_d, mode_min,
+      mode_sum / (gint64) mode_frames, mode_max, mode_frames);
+  if (cost_frames > 0) {
+    g_print ("; ");
+    print_cost ();
+  }
+  g_print ("\n");
+  mode_frames = 0;
+}
+
+/* Adds the latency of a frame to its mode, reporting the last mode when
+ * the mode the frame carries is another one */
+static void
+count_mode (const GstStructure *s, gint64 latency)
+{
+  gint width, height, fps_n, fps_d;
+
+  if (!gst_structure_get_int (s, "mode-width", &width) ||
+      !gst_structure_get_int (s, "mode-height", &height) ||
+      !gst_structure_get_fraction (s, "mode-framerate", &fps_n, &fps_d))
+    return;
+
+  if (width != mode_width || height != mode_height || fps_n != mode_fps_n ||
+      fps_d != mode_fps_d) {
+    report_mode ();
+    mode_width = width;
+    mode_height = height;
+    mode_fps_n = fps_n;
+    mode_fps_d = fps_d;
+  }
+  if (mode_frames == 0) {
+    mode_min = G_MAXINT64;
+    mode_max = G_MININT64;
+    mode_sum = 0;
+  }
+  mode_frames++;
+  mode_min = MIN (mode_min, latency);
+  mode_max = MAX (mode_max, latency);
+  mode_sum += latency;
+  mode_last_frame = g_get_monotonic_time ();
+}
+
+/* The last mode of a sweep is followed by no other, so it is reported once
+ * its frames stop coming */
+static gboolean
+flush_mode (gpointer data)
+{
+  if (mode_frames > 0 &&
+      g_get_monotonic_time () - mode_last_frame > G_USEC_PER_SEC)
+    report_mode ();
+  return G_SOURCE_CONTINUE;
+}
+
+/* Prints the video latency next to the parse cost and the scheduling
+ * lateness of the host over the same second, so outliers of one can be
+ * matched with the others */
+static gboolean
+report_lateness (gpointer data)
+{
+  RtSchedLateness lateness;
+  const gchar *sep = "";
+
+  if (latency_frames > 0) {
+    g_print ("Latency min/max: %" G_GINT64_FORMAT "/%" G_GINT64_FORMAT
+        " ns over %" G_GUINT64_FORMAT " frames", latency_min, latency_max,
+        latency_frames);
+    sep = "; ";
+  }
+  if (cost_frames > 0) {
+    g_print ("%s", sep);
+    print_cost ();
+    sep = "; ";
+  }
+  if (rtsched_enabled ()) {
+    rtsched_take_lateness (&lateness);
+    g_print ("%sWakeup lateness mean/max: %" G_GUINT64_FORMAT "/%"
+        G_GUINT64_FORMAT " ns over %" G_GUINT64_FORMAT " wakeups", sep,
+        lateness.mean, lateness.max, lateness.wakeups);
+  }
+  if (*sep || rtsched_enabled ())
+    g_print ("\n");
+
+  latency_frames = 0;
+  latency_min = G_MAXINT64;
+  latency_max = G_MININT64;
+  return G_SOURCE_CONTINUE;
+}
+
+/* Reads the systime of a stamping or parsing element from the clock given
+ * on the command line.  All of them must read the same clock, or the
+ * latencies of different elements can't be combined. */
+static void
+set_time_source (GstBin *bin, const gchar *name)
+{
+  GstElement *element = gst_bin_get_by_name (bin, name);
+
+  if (!element)
+    return;
+  if (time_source)
+    gst_util_set_object_arg (G_OBJECT (element), "time-source", time_source);
+  if (net_clock_address)
+    g_object_set (element, "net-clock-address", net_clock_address, NULL);
+  if (net_clock_port)
+    g_object_set (element, "net-clock-port", net_clock_port, NULL);
+  gst_object_unref (element);
+}
+
+static void
+take_cost (const GstStructure *s)
+{
+  gst_structure_get (s,
+      "frames", G_TYPE_UINT64, &cost_frames,
+      "mean", G_TYPE_UINT64, &cost_mean,
+      "max", G_TYPE_UINT64, &cost_max,
+      NULL);
+  gst_structure_get (s,
+      "cycles", G_TYPE_UINT64, &cost_cycles,
+      "cache-misses", G_TYPE_UINT64, &cost_cache_misses,
+      NULL);
+}
+
+/* Prints the share of the latencies the parsing itself takes */
+static void
+print_cost (void)
+{
+  g_print ("parse cost mean/max: %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT
+      " ns", cost_mean, cost_max);
+  if (cost_cycles > 0)
+    g_print (", %" G_GUINT64_FORMAT " cycles/%" G_GUINT64_FORMAT
+        " cache misses per frame", cost_cycles / cost_frames,
+        cost_cache_misses / cost_frames);
+}
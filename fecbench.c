@@ -0,0 +1,147 @@
+/* latency-clock
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times the FEC codes on a payload of the given number of words.
+ *
+ * Every scheme is timed as the elements use it: the built-in block codes
+ * in the current wire format and, when built with liquid-dsp, liquid's
+ * codes in the wire format of version 1 headers.  Before decoding, one bit
+ * of the encoded message is flipped, so the codes that correct have
+ * something to correct.  Prints the time per encode and per decode and
+ * whether the flipped bit was corrected. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "latencyclock.h"
+
+static gint iterations = 100000;
+static gint words = 1;
+
+static GOptionEntry entries[] = {
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+    "Encodes and decodes timed per scheme (default: 100000)", "N" },
+  { "words", 'w', 0, G_OPTION_ARG_INT, &words,
+    "64-bit words in the payload (default: 1)", "WORDS" },
+  { NULL }
+};
+
+static const struct {
+  fec_scheme fs;
+  const gchar *name;
+} schemes[] = {
+  /* The nicks of the fec-scheme property */
+  { LIQUID_FEC_NONE, "none" },
+  { LIQUID_FEC_REP3, "rep3" },
+  { LIQUID_FEC_REP5, "rep5" },
+  { LIQUID_FEC_HAMMING74, "hamming74" },
+  { LIQUID_FEC_HAMMING84, "hamming84" },
+  { LIQUID_FEC_HAMMING128, "hamming128" },
+  { LIQUID_FEC_GOLAY2412, "golay2421" },
+  { LIQUID_FEC_SECDED2216, "secded2216" },
+  { LIQUID_FEC_SECDED3932, "secded3932" },
+  { LIQUID_FEC_SECDED7264, "secdec7264" },
+  { LIQUID_FEC_CONV_V27, "conv_v27" },
+  { LIQUID_FEC_CONV_V29, "conv_v29" },
+  { LIQUID_FEC_RS_M8, "rs_m8" },
+};
+
+static gint64
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Times codec and prints a line for it */
+static void
+bench (const gchar *name, const gchar *impl, LatencyClockCodec *codec)
+{
+  guint64 in[LATENCY_CLOCK_MAX_WORDS], out[LATENCY_CLOCK_MAX_WORDS];
+  guint64 enc[LATENCY_CLOCK_MAX_ROWS];
+  gint64 start, enc_ns, dec_ns;
+  gint i;
+
+  for (i = 0; i < words; i++)
+    in[i] = G_GUINT64_CONSTANT (0x0123456789abcdef) * (i + 1);
+
+  start = now_ns ();
+  for (i = 0; i < iterations; i++) {
+    in[0] ^= i;
+    latency_clock_encode (codec, in, (guint8 *) enc);
+    in[0] ^= i;
+  }
+  enc_ns = now_ns () - start;
+
+  latency_clock_encode (codec, in, (guint8 *) enc);
+  enc[0] ^= 1;
+
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    latency_clock_decode (codec, (const guint8 *) enc, out);
+  dec_ns = now_ns () - start;
+
+  g_print ("%-12s %-8s %4u %10.1f %10.1f %s\n", name, impl, codec->rows,
+      (gdouble) enc_ns / iterations, (gdouble) dec_ns / iterations,
+      memcmp (in, out, words * 8) ? "no" : "yes");
+}
+
+int main(int argc, char* argv[])
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  guint i;
+
+  ctx = g_option_context_new ("- time the FEC codes of the payload");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (iterations <= 0 || words <= 0 || words > LATENCY_CLOCK_MAX_WORDS) {
+    g_printerr ("Invalid number of iterations or words\n");
+    return 1;
+  }
+
+  g_print ("%-12s %-8s %4s %10s %10s %s\n", "scheme", "code", "rows",
+      "enc ns", "dec ns", "corrected");
+  for (i = 0; i < G_N_ELEMENTS (schemes); i++) {
+    LatencyClockCodec *codec;
+
+    if (gst_timestamp_fec_builtin (schemes[i].fs)) {
+      codec = latency_clock_codec_new (schemes[i].fs, words);
+      bench (schemes[i].name, "built-in", codec);
+      latency_clock_codec_free (codec);
+    }
+#ifdef HAVE_LIQUID
+    if (!gst_timestamp_fec_builtin (schemes[i].fs) ||
+        !gst_timestamp_fec_liquid_layout (schemes[i].fs)) {
+      codec = latency_clock_codec_new_version (schemes[i].fs, words,
+          LATENCY_CLOCK_HEADER_VERSION_LIQUID);
+      bench (schemes[i].name, "liquid", codec);
+      latency_clock_codec_free (codec);
+    }
+#endif
+  }
+  return 0;
+}
@@ -0,0 +1,556 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstaudiotimeoverlayparse
+ *
+ * The audiotimeoverlayparse element demodulates the bursts written by
+ * audiotimestampoverlay and logs the latency.
+ *
+ * The audio is mixed down from carrier-frequency and the energy of the two
+ * FSK tones is tracked over a sliding symbol window.  Once the preamble is
+ * found, the payload symbols are demodulated with liquid-dsp's fskdem.  All
+ * state is allocated when the caps are set, the streaming thread doesn't
+ * allocate.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * GST_DEBUG=audiotimeoverlayparse:4 gst-launch-1.0 autoaudiosrc ! audioconvert ! audiotimeoverlayparse ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/audio/gstaudiofilter.h>
+#include "gstaudiotimeoverlayparse.h"
+
+#include <string.h>
+#include <sys/time.h>
+#include <inttypes.h>
+#include <math.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_audiotimeoverlayparse_debug_category);
+#define GST_CAT_DEFAULT gst_audiotimeoverlayparse_debug_category
+
+/* prototypes */
+static void gst_audiotimeoverlayparse_dispose (GObject *object);
+static gboolean gst_audiotimeoverlayparse_setup (GstAudioFilter * filter,
+    const GstAudioInfo * info);
+static gboolean gst_audiotimeoverlayparse_start (GstBaseTransform * trans);
+static gboolean gst_audiotimeoverlayparse_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_audiotimeoverlayparse_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_FEC_SCHEME,
+  PROP_SAMPLES_PER_SYMBOL,
+  PROP_CARRIER_FREQUENCY,
+  PROP_DEVIATION,
+  PROP_THRESHOLD,
+  PROP_POST_MESSAGES,
+  PROP_TIME_SOURCE
+};
+
+#define DEFAULT_SAMPLES_PER_SYMBOL 32
+#define DEFAULT_CARRIER_FREQUENCY 3000
+#define DEFAULT_DEVIATION 750
+#define DEFAULT_THRESHOLD 0.6
+
+#define LOWPASS_LEN 31
+/* Tone energy below which a symbol window is considered silence */
+#define MIN_TONE_AMPLITUDE 0.002f
+
+static void
+gst_audiotimeoverlayparse_set_fec_scheme (GstAudioTimeOverlayParse *overlay,
+                                          fec_scheme fs)
+{
+  LatencyClockCodec *codec = latency_clock_codec_new (fs,
+      GST_AUDIO_TIMESTAMP_WORDS);
+
+  overlay->fec_scheme = fs;
+  GST_INFO_OBJECT (overlay, "set_property: fec_scheme n:%u k:%u rows:%u",
+                   codec->fec_n, codec->fec_k, codec->rows);
+  gst_timestamp_codec_publish (&overlay->pending_codec, codec);
+}
+
+static void
+gst_audiotimeoverlayparse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    gst_audiotimeoverlayparse_set_fec_scheme (overlay, g_value_get_enum (value));
+    break;
+  case PROP_SAMPLES_PER_SYMBOL:
+    overlay->samples_per_symbol = g_value_get_uint (value);
+    break;
+  case PROP_CARRIER_FREQUENCY:
+    overlay->carrier_frequency = g_value_get_uint (value);
+    break;
+  case PROP_DEVIATION:
+    overlay->deviation = g_value_get_uint (value);
+    break;
+  case PROP_THRESHOLD:
+    overlay->threshold = g_value_get_double (value);
+    break;
+  case PROP_POST_MESSAGES:
+    overlay->post_messages = g_value_get_boolean (value);
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_audiotimeoverlayparse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    g_value_set_enum (value, overlay->fec_scheme);
+    break;
+  case PROP_SAMPLES_PER_SYMBOL:
+    g_value_set_uint (value, overlay->samples_per_symbol);
+    break;
+  case PROP_CARRIER_FREQUENCY:
+    g_value_set_uint (value, overlay->carrier_frequency);
+    break;
+  case PROP_DEVIATION:
+    g_value_set_uint (value, overlay->deviation);
+    break;
+  case PROP_THRESHOLD:
+    g_value_set_double (value, overlay->threshold);
+    break;
+  case PROP_POST_MESSAGES:
+    g_value_set_boolean (value, overlay->post_messages);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define AUDIO_CAPS \
+    "audio/x-raw, format=(string)" GST_AUDIO_NE (F32) ", " \
+    "layout=(string)interleaved, rate=(int)[ 8000, MAX ], " \
+    "channels=(int)[ 1, MAX ]"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstAudioTimeOverlayParse, gst_audiotimeoverlayparse,
+  GST_TYPE_AUDIO_FILTER,
+  GST_DEBUG_CATEGORY_INIT (gst_audiotimeoverlayparse_debug_category,
+  "audiotimeoverlayparse", 0,
+  "debug category for audiotimeoverlayparse element"));
+
+static void
+gst_audiotimeoverlayparse_class_init (GstAudioTimeOverlayParseClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstAudioFilterClass *audio_filter_class = GST_AUDIO_FILTER_CLASS (klass);
+  GstCaps *caps;
+
+  caps = gst_caps_from_string (AUDIO_CAPS);
+  gst_audio_filter_class_add_pad_templates (audio_filter_class, caps);
+  gst_caps_unref (caps);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "AudioTimeOverlayParse", "Filter/Analyzer/Audio",
+      "Reads the timestamps from the audio written by audiotimestampoverlay",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_audiotimeoverlayparse_set_property;
+  gobject_class->get_property = gst_audiotimeoverlayparse_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FEC_SCHEME,
+    g_param_spec_enum ("fec-scheme", "Foward Error Correction Scheme",
+                       "FEC Scheme to use",
+                       GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SAMPLES_PER_SYMBOL,
+    g_param_spec_uint ("samples-per-symbol", "Samples per symbol",
+                       "Length of one bit of the burst in samples",
+                       2, 4096, DEFAULT_SAMPLES_PER_SYMBOL,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_CARRIER_FREQUENCY,
+    g_param_spec_uint ("carrier-frequency", "Carrier frequency",
+                       "Centre frequency of the burst in Hz",
+                       1, G_MAXUINT, DEFAULT_CARRIER_FREQUENCY,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_DEVIATION,
+    g_param_spec_uint ("deviation", "Deviation",
+                       "Distance of the two FSK tones from the carrier in Hz",
+                       1, G_MAXUINT, DEFAULT_DEVIATION,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_THRESHOLD,
+    g_param_spec_double ("threshold", "Threshold",
+                         "Normalised preamble correlation needed to lock "
+                         "onto a burst",
+                         0.0, 1.0, DEFAULT_THRESHOLD,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+    g_param_spec_boolean ("post-messages", "Post messages",
+                          "Post an element message for every parsed burst",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the receive time of the bursts is read from.  "
+      "Must be the source the audiotimestampoverlay uses");
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_audiotimeoverlayparse_dispose);
+  audio_filter_class->setup = GST_DEBUG_FUNCPTR (gst_audiotimeoverlayparse_setup);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_audiotimeoverlayparse_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_audiotimeoverlayparse_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_audiotimeoverlayparse_transform_ip);
+}
+
+static void
+gst_audiotimeoverlayparse_init (GstAudioTimeOverlayParse *overlay)
+{
+  overlay->samples_per_symbol = DEFAULT_SAMPLES_PER_SYMBOL;
+  overlay->carrier_frequency = DEFAULT_CARRIER_FREQUENCY;
+  overlay->deviation = DEFAULT_DEVIATION;
+  overlay->threshold = DEFAULT_THRESHOLD;
+  overlay->post_messages = FALSE;
+
+  overlay->dem = NULL;
+  overlay->nco = NULL;
+  overlay->tone[0] = overlay->tone[1] = NULL;
+  overlay->lowpass = NULL;
+  overlay->tone_ring[0] = overlay->tone_ring[1] = NULL;
+  overlay->soft_ring = NULL;
+  overlay->symbol = NULL;
+  overlay->state = AUDIO_PARSE_SEARCH;
+
+  overlay->codec = NULL;
+  overlay->pending_codec = NULL;
+  gst_audiotimeoverlayparse_set_fec_scheme (overlay, LIQUID_FEC_NONE);
+  gst_timestamp_systime_init (&overlay->time_source);
+}
+
+static void
+gst_audiotimeoverlayparse_free_modem (GstAudioTimeOverlayParse *overlay)
+{
+  int t;
+
+  if (overlay->dem) {
+    fskdem_destroy (overlay->dem);
+    overlay->dem = NULL;
+  }
+  if (overlay->nco) {
+    nco_crcf_destroy (overlay->nco);
+    overlay->nco = NULL;
+  }
+  if (overlay->lowpass) {
+    firfilt_crcf_destroy (overlay->lowpass);
+    overlay->lowpass = NULL;
+  }
+  for (t = 0; t < 2; t++) {
+    if (overlay->tone[t]) {
+      nco_crcf_destroy (overlay->tone[t]);
+      overlay->tone[t] = NULL;
+    }
+    g_free (overlay->tone_ring[t]);
+    overlay->tone_ring[t] = NULL;
+  }
+  g_free (overlay->soft_ring);
+  overlay->soft_ring = NULL;
+  g_free (overlay->symbol);
+  overlay->symbol = NULL;
+}
+
+static void
+gst_audiotimeoverlayparse_dispose (GObject *object)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (object);
+
+  gst_audiotimeoverlayparse_free_modem (overlay);
+
+  latency_clock_codec_free (overlay->codec);
+  overlay->codec = NULL;
+  gst_timestamp_codec_publish (&overlay->pending_codec, NULL);
+  gst_timestamp_systime_clear (&overlay->time_source);
+
+  G_OBJECT_CLASS (gst_audiotimeoverlayparse_parent_class)->dispose (object);
+}
+
+static gboolean
+gst_audiotimeoverlayparse_start (GstBaseTransform * trans)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (trans);
+
+  return gst_timestamp_systime_start (&overlay->time_source,
+      GST_ELEMENT (overlay));
+}
+
+static gboolean
+gst_audiotimeoverlayparse_stop (GstBaseTransform * trans)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (trans);
+
+  gst_timestamp_systime_stop (&overlay->time_source);
+  return TRUE;
+}
+
+static gboolean
+gst_audiotimeoverlayparse_setup (GstAudioFilter * filter,
+    const GstAudioInfo * info)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (filter);
+  gint rate = GST_AUDIO_INFO_RATE (info);
+  guint k = overlay->samples_per_symbol;
+  float bandwidth = (float) overlay->deviation / rate;
+  float cutoff;
+  int t;
+
+  if (overlay->carrier_frequency + overlay->deviation >= rate / 2 ||
+      overlay->deviation >= overlay->carrier_frequency) {
+    GST_ERROR_OBJECT (filter, "carrier-frequency %u Hz +/- deviation %u Hz "
+        "doesn't fit into %d Hz audio", overlay->carrier_frequency,
+        overlay->deviation, rate);
+    return FALSE;
+  }
+
+  gst_audiotimeoverlayparse_free_modem (overlay);
+
+  overlay->dem = fskdem_create (1, k, bandwidth);
+  overlay->nco = nco_crcf_create (LIQUID_NCO);
+  nco_crcf_set_frequency (overlay->nco,
+      2.0f * M_PI * overlay->carrier_frequency / rate);
+
+  /* Keep both tones and the symbol-rate sidebands, reject the image at
+   * twice the carrier frequency. */
+  cutoff = 2.0f * bandwidth + 1.0f / k;
+  overlay->lowpass = firfilt_crcf_create_kaiser (LOWPASS_LEN,
+      MIN (cutoff, 0.45f), 60.0f, 0.0f);
+
+  for (t = 0; t < 2; t++) {
+    overlay->tone[t] = nco_crcf_create (LIQUID_NCO);
+    nco_crcf_set_frequency (overlay->tone[t],
+        (t ? 2.0f : -2.0f) * M_PI * bandwidth);
+    overlay->tone_ring[t] = g_new0 (float complex, k);
+    overlay->tone_sum[t] = 0;
+  }
+  overlay->soft_len = GST_AUDIO_TIMESTAMP_PREAMBLE_LEN * k;
+  overlay->soft_ring = g_new0 (float, overlay->soft_len);
+  overlay->symbol = g_new0 (float complex, 2 * k);
+
+  overlay->state = AUDIO_PARSE_SEARCH;
+  overlay->offset = 0;
+  return TRUE;
+}
+
+/* Normalised correlation of the soft bits ending at stream sample n with
+ * the preamble, in [-1, 1]. */
+static float
+gst_audiotimeoverlayparse_correlate (GstAudioTimeOverlayParse *overlay,
+    guint64 n)
+{
+  guint k = overlay->samples_per_symbol;
+  float corr = 0;
+  int j;
+
+  for (j = 0; j < GST_AUDIO_TIMESTAMP_PREAMBLE_LEN; j++) {
+    guint64 at = n + overlay->soft_len -
+        (guint64) (GST_AUDIO_TIMESTAMP_PREAMBLE_LEN - 1 - j) * k;
+    float soft = overlay->soft_ring[at % overlay->soft_len];
+    int bit = (GST_AUDIO_TIMESTAMP_PREAMBLE >>
+        (GST_AUDIO_TIMESTAMP_PREAMBLE_LEN - 1 - j)) & 1;
+
+    corr += bit ? soft : -soft;
+  }
+  return corr / GST_AUDIO_TIMESTAMP_PREAMBLE_LEN;
+}
+
+static void
+gst_audiotimeoverlayparse_report (GstAudioTimeOverlayParse *overlay,
+    LatencyClockCodec *codec, GstClockTime systime)
+{
+  guint64 words[GST_AUDIO_TIMESTAMP_WORDS];
+  GstClockTimeDiff latency;
+
+  latency_clock_decode (codec, (const guint8 *) overlay->payload, words);
+
+  uint64_t frame_id = words[0] & LATENCY_CLOCK_FRAME_ID_MASK;
+  GstClockTime remote_time = latency_clock_send_time (words,
+      GST_AUDIO_TIMESTAMP_WORDS, NULL);
+  latency = systime - remote_time;
+
+  GST_INFO_OBJECT (overlay, "Systime: %ld; Latency: %ld; Frame-id: %lu",
+      GST_TIME_AS_NSECONDS(systime),
+      GST_TIME_AS_NSECONDS(latency),
+      frame_id);
+
+  if (overlay->post_messages) {
+    gst_element_post_message (GST_ELEMENT (overlay),
+        gst_message_new_element (GST_OBJECT (overlay),
+            gst_structure_new ("audiotimeoverlayparse",
+                "frame-id", G_TYPE_UINT64, frame_id,
+                "remote-time", G_TYPE_UINT64, remote_time,
+                "receive-time", G_TYPE_UINT64, systime,
+                "latency", G_TYPE_INT64, latency,
+                NULL)));
+  }
+}
+
+static GstFlowReturn
+gst_audiotimeoverlayparse_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buf)
+{
+  GstAudioTimeOverlayParse *overlay = GST_AUDIOTIMEOVERLAYPARSE (trans);
+  GstAudioInfo *info = &GST_AUDIO_FILTER (trans)->info;
+  gint channels = GST_AUDIO_INFO_CHANNELS (info);
+  gint rate = GST_AUDIO_INFO_RATE (info);
+  guint k = overlay->samples_per_symbol;
+  float min_energy = (k * MIN_TONE_AMPLITUDE) * (k * MIN_TONE_AMPLITUDE);
+  GstClockTime systime;
+  LatencyClockCodec *codec;
+  GstMapInfo map;
+  const float *samples;
+  gsize frames, i;
+  int t;
+
+  systime = gst_timestamp_systime_now (&overlay->time_source,
+      GST_ELEMENT (overlay));
+
+  if (!overlay->dem) {
+    GST_ELEMENT_ERROR (overlay, CORE, NEGOTIATION, (NULL),
+        ("transform_ip called before setup"));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  /* A new fec-scheme only takes over between bursts */
+  if (overlay->state == AUDIO_PARSE_SEARCH)
+    codec = gst_timestamp_codec_acquire (&overlay->pending_codec,
+        &overlay->codec);
+  else
+    codec = overlay->codec;
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+  samples = (const float *) map.data;
+  frames = map.size / GST_AUDIO_INFO_BPF (info);
+
+  for (i = 0; i < frames; i++) {
+    guint64 n = overlay->offset + i;
+    guint slot = n % k;
+    float complex z, d;
+    float e[2], soft, corr;
+
+    nco_crcf_mix_down (overlay->nco, samples[i * channels], &z);
+    nco_crcf_step (overlay->nco);
+    firfilt_crcf_push (overlay->lowpass, z);
+    firfilt_crcf_execute (overlay->lowpass, &z);
+    overlay->symbol[slot] = z;
+
+    /* Sliding energy of both tones over the last symbol window */
+    for (t = 0; t < 2; t++) {
+      nco_crcf_mix_down (overlay->tone[t], z, &d);
+      nco_crcf_step (overlay->tone[t]);
+      overlay->tone_sum[t] += d - overlay->tone_ring[t][slot];
+      overlay->tone_ring[t][slot] = d;
+      if (slot == k - 1) {
+        /* Get rid of accumulated rounding errors once per symbol */
+        guint s;
+        overlay->tone_sum[t] = 0;
+        for (s = 0; s < k; s++)
+          overlay->tone_sum[t] += overlay->tone_ring[t][s];
+      }
+      e[t] = crealf (overlay->tone_sum[t] * conjf (overlay->tone_sum[t]));
+    }
+    soft = (e[0] + e[1] > min_energy) ? (e[1] - e[0]) / (e[1] + e[0]) : 0.0f;
+    overlay->soft_ring[n % overlay->soft_len] = soft;
+
+    switch (overlay->state) {
+    case AUDIO_PARSE_SEARCH:
+      corr = gst_audiotimeoverlayparse_correlate (overlay, n);
+      if (corr > overlay->threshold) {
+        overlay->state = AUDIO_PARSE_PEAK;
+        overlay->peak = corr;
+        overlay->peak_offset = n;
+      }
+      break;
+    case AUDIO_PARSE_PEAK:
+      corr = gst_audiotimeoverlayparse_correlate (overlay, n);
+      if (corr > overlay->peak) {
+        overlay->peak = corr;
+        overlay->peak_offset = n;
+      } else if (n - overlay->peak_offset >= k / 2) {
+        /* The preamble ended at the correlation peak */
+        overlay->state = AUDIO_PARSE_PAYLOAD;
+        overlay->payload_start = overlay->peak_offset + 1;
+        overlay->payload_bit = 0;
+        memset (overlay->payload, 0, sizeof (overlay->payload));
+      }
+      break;
+    case AUDIO_PARSE_PAYLOAD:
+      if (n + 1 - overlay->payload_start ==
+          (guint64) (overlay->payload_bit + 1) * k) {
+        unsigned int bit;
+
+        /* Unroll the ring so the symbol window is in order */
+        memcpy (overlay->symbol + k, overlay->symbol,
+            (slot + 1) * sizeof (float complex));
+        bit = fskdem_demodulate (overlay->dem, overlay->symbol + slot + 1);
+        overlay->payload[overlay->payload_bit / 64] |=
+            (guint64) (bit & 1) << (63 - overlay->payload_bit % 64);
+
+        if (++overlay->payload_bit == codec->rows * 64) {
+          guint64 burst_start = overlay->payload_start -
+              GST_AUDIO_TIMESTAMP_PREAMBLE_LEN * k - (LOWPASS_LEN - 1) / 2;
+          GstClockTime receive_time = systime - gst_util_uint64_scale_int (
+              overlay->offset + frames - burst_start, GST_SECOND, rate);
+
+          gst_audiotimeoverlayparse_report (overlay, codec, receive_time);
+          overlay->state = AUDIO_PARSE_SEARCH;
+        }
+      }
+      break;
+    }
+  }
+  overlay->offset += frames;
+
+  gst_buffer_unmap (buf, &map);
+  return GST_FLOW_OK;
+}
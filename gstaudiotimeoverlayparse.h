@@ -0,0 +1,91 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_AUDIOTIMEOVERLAYPARSE_H_
+#define _GST_AUDIOTIMEOVERLAYPARSE_H_
+
+#include <complex.h>
+#include <gst/audio/audio.h>
+#include <gst/audio/gstaudiofilter.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AUDIOTIMEOVERLAYPARSE   (gst_audiotimeoverlayparse_get_type())
+#define GST_AUDIOTIMEOVERLAYPARSE(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AUDIOTIMEOVERLAYPARSE,GstAudioTimeOverlayParse))
+#define GST_AUDIOTIMEOVERLAYPARSE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_AUDIOTIMEOVERLAYPARSE,GstAudioTimeOverlayParseClass))
+#define GST_IS_AUDIOTIMEOVERLAYPARSE(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_AUDIOTIMEOVERLAYPARSE))
+#define GST_IS_AUDIOTIMEOVERLAYPARSE_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AUDIOTIMEOVERLAYPARSE))
+
+typedef struct _GstAudioTimeOverlayParse GstAudioTimeOverlayParse;
+typedef struct _GstAudioTimeOverlayParseClass GstAudioTimeOverlayParseClass;
+
+typedef enum {
+  AUDIO_PARSE_SEARCH,
+  AUDIO_PARSE_PEAK,
+  AUDIO_PARSE_PAYLOAD,
+} GstAudioTimeOverlayParseState;
+
+struct _GstAudioTimeOverlayParse
+{
+  GstAudioFilter base_audiotimeoverlayparse;
+
+  fec_scheme fec_scheme;
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+
+  /* properties */
+  guint samples_per_symbol;
+  guint carrier_frequency;
+  guint deviation;
+  gdouble threshold;
+  gboolean post_messages;
+  GstTimestampSystime time_source;
+
+  /* demodulator, everything is allocated in setup() so that
+   * transform_ip never allocates */
+  fskdem dem;
+  nco_crcf nco;
+  nco_crcf tone[2];
+  firfilt_crcf lowpass;
+  float complex *tone_ring[2];
+  float complex tone_sum[2];
+  float *soft_ring;
+  guint soft_len;
+  float complex *symbol;
+
+  GstAudioTimeOverlayParseState state;
+  float peak;
+  guint64 peak_offset;
+  guint64 payload_start;
+  guint payload_bit;
+  /* The payload rows demodulated so far */
+  guint64 payload[LATENCY_CLOCK_MAX_ROWS];
+  guint64 offset;
+};
+
+struct _GstAudioTimeOverlayParseClass
+{
+  GstAudioFilterClass base_audiotimeoverlayparse_class;
+};
+
+GType gst_audiotimeoverlayparse_get_type (void);
+
+G_END_DECLS
+
+#endif
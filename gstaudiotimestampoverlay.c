@@ -0,0 +1,459 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstaudiotimestampoverlay
+ *
+ * The audiotimestampoverlay element replaces the audio with a short BFSK
+ * burst carrying the same FEC-encoded timestamp as timestampoverlay every
+ * interval milliseconds.  The burst is modulated with liquid-dsp's fskmod
+ * and mixed up to carrier-frequency.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 audiotestsrc is-live=true wave=silence ! audioconvert ! audiotimestampoverlay ! autoaudiosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/audio/gstaudiofilter.h>
+#include "gstaudiotimestampoverlay.h"
+
+#include <string.h>
+#include <sys/time.h>
+#include <inttypes.h>
+#include <math.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_audiotimestampoverlay_debug_category);
+#define GST_CAT_DEFAULT gst_audiotimestampoverlay_debug_category
+
+/* prototypes */
+static void gst_audiotimestampoverlay_dispose (GObject *object);
+static gboolean gst_audiotimestampoverlay_setup (GstAudioFilter * filter,
+    const GstAudioInfo * info);
+static gboolean gst_audiotimestampoverlay_start (GstBaseTransform * trans);
+static gboolean gst_audiotimestampoverlay_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_audiotimestampoverlay_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_FEC_SCHEME,
+  PROP_INTERVAL,
+  PROP_SAMPLES_PER_SYMBOL,
+  PROP_CARRIER_FREQUENCY,
+  PROP_DEVIATION,
+  PROP_VOLUME,
+  PROP_TIME_SOURCE
+};
+
+#define DEFAULT_INTERVAL 1000
+#define DEFAULT_SAMPLES_PER_SYMBOL 32
+#define DEFAULT_CARRIER_FREQUENCY 3000
+#define DEFAULT_DEVIATION 750
+#define DEFAULT_VOLUME 0.5
+
+/* (Re)allocates the burst for the given number of payload rows and the
+ * current symbol length.  Only happens in setup() and when a new fec-scheme
+ * changes the number of rows. */
+static void
+gst_audiotimestampoverlay_alloc_burst (GstAudioTimeStampOverlay *overlay,
+    guint rows)
+{
+  unsigned int symbols = GST_AUDIO_TIMESTAMP_PREAMBLE_LEN + rows * 64;
+
+  g_free (overlay->burst);
+  overlay->burst_rows = rows;
+  overlay->burst_len = symbols * overlay->samples_per_symbol;
+  overlay->burst = g_new0 (float complex, overlay->burst_len);
+  overlay->burst_pos = overlay->burst_len;
+}
+
+static void
+gst_audiotimestampoverlay_set_fec_scheme (GstAudioTimeStampOverlay *overlay,
+                                          fec_scheme fs)
+{
+  LatencyClockCodec *codec = latency_clock_codec_new (fs,
+      GST_AUDIO_TIMESTAMP_WORDS);
+
+  overlay->fec_scheme = fs;
+  GST_INFO_OBJECT (overlay, "set_property: fec_scheme n:%u k:%u rows:%u",
+                   codec->fec_n, codec->fec_k, codec->rows);
+  gst_timestamp_codec_publish (&overlay->pending_codec, codec);
+}
+
+static void
+gst_audiotimestampoverlay_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    gst_audiotimestampoverlay_set_fec_scheme (overlay, g_value_get_enum (value));
+    break;
+  case PROP_INTERVAL:
+    overlay->interval = g_value_get_uint (value);
+    break;
+  case PROP_SAMPLES_PER_SYMBOL:
+    overlay->samples_per_symbol = g_value_get_uint (value);
+    break;
+  case PROP_CARRIER_FREQUENCY:
+    overlay->carrier_frequency = g_value_get_uint (value);
+    break;
+  case PROP_DEVIATION:
+    overlay->deviation = g_value_get_uint (value);
+    break;
+  case PROP_VOLUME:
+    overlay->volume = g_value_get_double (value);
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_audiotimestampoverlay_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    g_value_set_enum (value, overlay->fec_scheme);
+    break;
+  case PROP_INTERVAL:
+    g_value_set_uint (value, overlay->interval);
+    break;
+  case PROP_SAMPLES_PER_SYMBOL:
+    g_value_set_uint (value, overlay->samples_per_symbol);
+    break;
+  case PROP_CARRIER_FREQUENCY:
+    g_value_set_uint (value, overlay->carrier_frequency);
+    break;
+  case PROP_DEVIATION:
+    g_value_set_uint (value, overlay->deviation);
+    break;
+  case PROP_VOLUME:
+    g_value_set_double (value, overlay->volume);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define AUDIO_CAPS \
+    "audio/x-raw, format=(string)" GST_AUDIO_NE (F32) ", " \
+    "layout=(string)interleaved, rate=(int)[ 8000, MAX ], " \
+    "channels=(int)[ 1, MAX ]"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstAudioTimeStampOverlay, gst_audiotimestampoverlay,
+  GST_TYPE_AUDIO_FILTER,
+  GST_DEBUG_CATEGORY_INIT (gst_audiotimestampoverlay_debug_category,
+  "audiotimestampoverlay", 0,
+  "debug category for audiotimestampoverlay element"));
+
+static void
+gst_audiotimestampoverlay_class_init (GstAudioTimeStampOverlayClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstAudioFilterClass *audio_filter_class = GST_AUDIO_FILTER_CLASS (klass);
+  GstCaps *caps;
+
+  caps = gst_caps_from_string (AUDIO_CAPS);
+  gst_audio_filter_class_add_pad_templates (audio_filter_class, caps);
+  gst_caps_unref (caps);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "AudioTimestampoverlay", "Filter/Effect/Audio",
+      "Modulates timestamps into the audio so they can be read off the "
+      "audio afterwards",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_audiotimestampoverlay_set_property;
+  gobject_class->get_property = gst_audiotimestampoverlay_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FEC_SCHEME,
+    g_param_spec_enum ("fec-scheme", "Foward Error Correction Scheme",
+                       "FEC Scheme to use",
+                       GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INTERVAL,
+    g_param_spec_uint ("interval", "Interval",
+                       "Milliseconds between the start of two bursts",
+                       1, G_MAXUINT, DEFAULT_INTERVAL,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SAMPLES_PER_SYMBOL,
+    g_param_spec_uint ("samples-per-symbol", "Samples per symbol",
+                       "Length of one bit of the burst in samples",
+                       2, 4096, DEFAULT_SAMPLES_PER_SYMBOL,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_CARRIER_FREQUENCY,
+    g_param_spec_uint ("carrier-frequency", "Carrier frequency",
+                       "Centre frequency of the burst in Hz",
+                       1, G_MAXUINT, DEFAULT_CARRIER_FREQUENCY,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_DEVIATION,
+    g_param_spec_uint ("deviation", "Deviation",
+                       "Distance of the two FSK tones from the carrier in Hz",
+                       1, G_MAXUINT, DEFAULT_DEVIATION,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_VOLUME,
+    g_param_spec_double ("volume", "Volume", "Amplitude of the burst",
+                         0.0, 1.0, DEFAULT_VOLUME,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the send time of the bursts is read from");
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_audiotimestampoverlay_dispose);
+  audio_filter_class->setup = GST_DEBUG_FUNCPTR (gst_audiotimestampoverlay_setup);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_audiotimestampoverlay_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_audiotimestampoverlay_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_audiotimestampoverlay_transform_ip);
+}
+
+static void
+gst_audiotimestampoverlay_init (GstAudioTimeStampOverlay *overlay)
+{
+  overlay->frame_id = 0;
+
+  overlay->interval = DEFAULT_INTERVAL;
+  overlay->samples_per_symbol = DEFAULT_SAMPLES_PER_SYMBOL;
+  overlay->carrier_frequency = DEFAULT_CARRIER_FREQUENCY;
+  overlay->deviation = DEFAULT_DEVIATION;
+  overlay->volume = DEFAULT_VOLUME;
+
+  overlay->mod = NULL;
+  overlay->nco = NULL;
+  overlay->burst = NULL;
+  overlay->burst_rows = 0;
+  overlay->burst_len = 0;
+  overlay->burst_pos = 0;
+  overlay->next_burst = 0;
+  overlay->offset = 0;
+
+  overlay->codec = NULL;
+  overlay->pending_codec = NULL;
+  gst_audiotimestampoverlay_set_fec_scheme (overlay, LIQUID_FEC_NONE);
+  gst_timestamp_systime_init (&overlay->time_source);
+}
+
+static void
+gst_audiotimestampoverlay_free_modem (GstAudioTimeStampOverlay *overlay)
+{
+  if (overlay->mod) {
+    fskmod_destroy (overlay->mod);
+    overlay->mod = NULL;
+  }
+  if (overlay->nco) {
+    nco_crcf_destroy (overlay->nco);
+    overlay->nco = NULL;
+  }
+}
+
+static void
+gst_audiotimestampoverlay_dispose (GObject *object)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (object);
+
+  gst_audiotimestampoverlay_free_modem (overlay);
+  g_free (overlay->burst);
+  overlay->burst = NULL;
+
+  latency_clock_codec_free (overlay->codec);
+  overlay->codec = NULL;
+  gst_timestamp_codec_publish (&overlay->pending_codec, NULL);
+  gst_timestamp_systime_clear (&overlay->time_source);
+
+  G_OBJECT_CLASS (gst_audiotimestampoverlay_parent_class)->dispose (object);
+}
+
+static gboolean
+gst_audiotimestampoverlay_start (GstBaseTransform * trans)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (trans);
+
+  return gst_timestamp_systime_start (&overlay->time_source,
+      GST_ELEMENT (overlay));
+}
+
+static gboolean
+gst_audiotimestampoverlay_stop (GstBaseTransform * trans)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (trans);
+
+  gst_timestamp_systime_stop (&overlay->time_source);
+  return TRUE;
+}
+
+static gboolean
+gst_audiotimestampoverlay_setup (GstAudioFilter * filter,
+    const GstAudioInfo * info)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (filter);
+  gint rate = GST_AUDIO_INFO_RATE (info);
+  float bandwidth = (float) overlay->deviation / rate;
+  LatencyClockCodec *codec;
+
+  if (overlay->carrier_frequency + overlay->deviation >= rate / 2 ||
+      overlay->deviation >= overlay->carrier_frequency) {
+    GST_ERROR_OBJECT (filter, "carrier-frequency %u Hz +/- deviation %u Hz "
+        "doesn't fit into %d Hz audio", overlay->carrier_frequency,
+        overlay->deviation, rate);
+    return FALSE;
+  }
+
+  gst_audiotimestampoverlay_free_modem (overlay);
+  overlay->mod = fskmod_create (1, overlay->samples_per_symbol, bandwidth);
+  overlay->nco = nco_crcf_create (LIQUID_NCO);
+  nco_crcf_set_frequency (overlay->nco,
+      2.0f * M_PI * overlay->carrier_frequency / rate);
+
+  codec = gst_timestamp_codec_acquire (&overlay->pending_codec,
+      &overlay->codec);
+  gst_audiotimestampoverlay_alloc_burst (overlay, codec->rows);
+  overlay->next_burst = 0;
+  overlay->offset = 0;
+
+  GST_INFO_OBJECT (filter, "burst of %u samples (%.1f ms) every %u ms",
+      overlay->burst_len, 1000.0 * overlay->burst_len / rate,
+      overlay->interval);
+  return TRUE;
+}
+
+static void
+gst_audiotimestampoverlay_build_burst (GstAudioTimeStampOverlay *overlay,
+    const guint64 *words)
+{
+  LatencyClockCodec *codec;
+  unsigned int k = overlay->samples_per_symbol;
+  guint64 enc[LATENCY_CLOCK_MAX_ROWS];
+  float complex *out;
+  int bit;
+
+  /* Only between bursts, so a burst is never modulated with two schemes */
+  codec = gst_timestamp_codec_acquire (&overlay->pending_codec,
+      &overlay->codec);
+  if (codec->rows != overlay->burst_rows)
+    gst_audiotimestampoverlay_alloc_burst (overlay, codec->rows);
+  latency_clock_encode (codec, words, (guint8 *) enc);
+
+  out = overlay->burst;
+  for (bit = GST_AUDIO_TIMESTAMP_PREAMBLE_LEN - 1; bit >= 0; bit--) {
+    fskmod_modulate (overlay->mod, (GST_AUDIO_TIMESTAMP_PREAMBLE >> bit) & 1,
+        out);
+    out += k;
+  }
+
+  for (int r = 0; r < codec->rows; r++) {
+    for (bit = 63; bit >= 0; bit--) {
+      fskmod_modulate (overlay->mod, (enc[r] >> bit) & 1, out);
+      out += k;
+    }
+  }
+  overlay->burst_pos = 0;
+}
+
+static GstFlowReturn
+gst_audiotimestampoverlay_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buf)
+{
+  GstAudioTimeStampOverlay *overlay = GST_AUDIOTIMESTAMPOVERLAY (trans);
+  GstAudioInfo *info = &GST_AUDIO_FILTER (trans)->info;
+  gint channels = GST_AUDIO_INFO_CHANNELS (info);
+  gint rate = GST_AUDIO_INFO_RATE (info);
+  GstClockTime systime0;
+  GstMapInfo map;
+  float *samples;
+  gsize frames, i;
+  gint c;
+
+  if (!overlay->mod) {
+    GST_ELEMENT_ERROR (overlay, CORE, NEGOTIATION, (NULL),
+        ("transform_ip called before setup"));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READWRITE))
+    return GST_FLOW_ERROR;
+  samples = (float *) map.data;
+  frames = map.size / GST_AUDIO_INFO_BPF (info);
+
+  systime0 = gst_timestamp_systime_now (&overlay->time_source,
+      GST_ELEMENT (overlay));
+
+  for (i = 0; i < frames; i++) {
+    if (overlay->burst_pos == overlay->burst_len &&
+        overlay->offset + i >= overlay->next_burst) {
+      /* The burst's timestamp is that of its first sample */
+      uint64_t systime = (uint64_t)(systime0 +
+          gst_util_uint64_scale_int (i, GST_SECOND, rate));
+      guint64 words[GST_AUDIO_TIMESTAMP_WORDS];
+
+      overlay->frame_id++;
+      words[0] = (systime & LATENCY_CLOCK_SYSTIME_MASK) |
+          (overlay->frame_id & LATENCY_CLOCK_FRAME_ID_MASK);
+      words[1] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_SEND_TIME, systime);
+      GST_INFO_OBJECT (overlay, "systime: %" PRIx64 ", frame_id: %" PRIx64,
+                       systime, overlay->frame_id);
+
+      gst_audiotimestampoverlay_build_burst (overlay, words);
+      overlay->next_burst = overlay->offset + i +
+          gst_util_uint64_scale_int (overlay->interval, rate, 1000);
+    }
+    if (overlay->burst_pos < overlay->burst_len) {
+      float complex y;
+      float v;
+
+      nco_crcf_mix_up (overlay->nco, overlay->burst[overlay->burst_pos++], &y);
+      nco_crcf_step (overlay->nco);
+      v = overlay->volume * crealf (y);
+      for (c = 0; c < channels; c++)
+        samples[i * channels + c] = v;
+    }
+  }
+  overlay->offset += frames;
+
+  gst_buffer_unmap (buf, &map);
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,75 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_AUDIOTIMESTAMPOVERLAY_H_
+#define _GST_AUDIOTIMESTAMPOVERLAY_H_
+
+#include <complex.h>
+#include <gst/audio/audio.h>
+#include <gst/audio/gstaudiofilter.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AUDIOTIMESTAMPOVERLAY   (gst_audiotimestampoverlay_get_type())
+#define GST_AUDIOTIMESTAMPOVERLAY(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AUDIOTIMESTAMPOVERLAY,GstAudioTimeStampOverlay))
+#define GST_AUDIOTIMESTAMPOVERLAY_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_AUDIOTIMESTAMPOVERLAY,GstAudioTimeStampOverlayClass))
+#define GST_IS_AUDIOTIMESTAMPOVERLAY(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_AUDIOTIMESTAMPOVERLAY))
+#define GST_IS_AUDIOTIMESTAMPOVERLAY_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AUDIOTIMESTAMPOVERLAY))
+
+typedef struct _GstAudioTimeStampOverlay GstAudioTimeStampOverlay;
+typedef struct _GstAudioTimeStampOverlayClass GstAudioTimeStampOverlayClass;
+
+struct _GstAudioTimeStampOverlay
+{
+  GstAudioFilter base_audiotimestampoverlay;
+  uint64_t frame_id;
+
+  fec_scheme fec_scheme;
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+
+  /* properties */
+  guint interval;
+  guint samples_per_symbol;
+  guint carrier_frequency;
+  guint deviation;
+  gdouble volume;
+  GstTimestampSystime time_source;
+
+  /* modulator state, set up in setup() */
+  fskmod mod;
+  nco_crcf nco;
+  float complex *burst;
+  guint burst_rows;
+  guint burst_len;
+  guint burst_pos;
+  guint64 next_burst;
+  guint64 offset;
+};
+
+struct _GstAudioTimeStampOverlayClass
+{
+  GstAudioFilterClass base_audiotimestampoverlay_class;
+};
+
+GType gst_audiotimestampoverlay_get_type (void);
+
+G_END_DECLS
+
+#endif
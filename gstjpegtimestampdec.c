@@ -0,0 +1,381 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstjpegtimestampdec
+ *
+ * The jpegtimestampdec element decodes only the part of an MJPEG frame
+ * that holds the code block of timestampoverlay: the header row, centred
+ * in the frame, and the rows below it.  It decodes the luma alone, skips
+ * the MCU rows above and below the block and the MCUs left and right of
+ * it, and, when the code block is aligned to the DCT blocks, decodes at a
+ * reduced scale.  At 1/8 scale that is the DC coefficient of every block
+ * and nothing else.
+ *
+ * Its output is a GRAY8 frame 512 pixels wide with the code block in the
+ * middle, which timeoverlayparse reads like any other frame.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 v4l2src ! image/jpeg,width=1920,height=1080 ! jpegtimestampdec ! timeoverlayparse ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+#include "gstjpegtimestampdec.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_jpegtimestampdec_debug_category);
+#define GST_CAT_DEFAULT gst_jpegtimestampdec_debug_category
+
+/* prototypes */
+static void gst_jpegtimestampdec_finalize (GObject *object);
+static GstCaps *gst_jpegtimestampdec_transform_caps (GstBaseTransform *
+    trans, GstPadDirection direction, GstCaps * caps, GstCaps * filter);
+static gboolean gst_jpegtimestampdec_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static gboolean gst_jpegtimestampdec_transform_size (GstBaseTransform *
+    trans, GstPadDirection direction, GstCaps * caps, gsize size,
+    GstCaps * othercaps, gsize * othersize);
+static GstFlowReturn gst_jpegtimestampdec_transform (GstBaseTransform *
+    trans, GstBuffer * inbuf, GstBuffer * outbuf);
+
+#define DEFAULT_ROWS 16
+
+enum
+{
+  PROP_0,
+  PROP_ROWS,
+  PROP_REDUCED_SCALE
+};
+
+static void
+gst_jpegtimestampdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (object);
+
+  switch (prop_id) {
+  case PROP_ROWS:
+    dec->rows = g_value_get_uint (value);
+    break;
+  case PROP_REDUCED_SCALE:
+    dec->reduced_scale = g_value_get_boolean (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_jpegtimestampdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (object);
+
+  switch (prop_id) {
+  case PROP_ROWS:
+    g_value_set_uint (value, dec->rows);
+    break;
+  case PROP_REDUCED_SCALE:
+    g_value_set_boolean (value, dec->reduced_scale);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define JPEG_CAPS "image/jpeg"
+
+#define VIDEO_SRC_CAPS \
+    GST_VIDEO_CAPS_MAKE("GRAY8")
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstJpegTimestampDec, gst_jpegtimestampdec,
+  GST_TYPE_BASE_TRANSFORM,
+  GST_DEBUG_CATEGORY_INIT (gst_jpegtimestampdec_debug_category,
+  "jpegtimestampdec", 0,
+  "debug category for jpegtimestampdec element"));
+
+static void
+gst_jpegtimestampdec_class_init (GstJpegTimestampDecClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (VIDEO_SRC_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (JPEG_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "JpegTimestampDec", "Codec/Decoder/Video",
+      "Decodes only the timestamp code block of MJPEG frames",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_jpegtimestampdec_set_property;
+  gobject_class->get_property = gst_jpegtimestampdec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_ROWS,
+    g_param_spec_uint ("rows", "Rows",
+                       "Rows of 8x8 boxes decoded below the header row, "
+                       "for the payload and any appended bands.  The "
+                       "output is 8 + 16 * rows pixels high",
+                       1, 255, DEFAULT_ROWS,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                       GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_REDUCED_SCALE,
+    g_param_spec_boolean ("reduced-scale", "Reduced scale",
+                          "Decode at 1/8, 1/4 or 1/2 scale when the code "
+                          "block is aligned to it (1/8 uses the DC "
+                          "coefficients only)",
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gobject_class->finalize = gst_jpegtimestampdec_finalize;
+  base_transform_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_jpegtimestampdec_transform_caps);
+  base_transform_class->set_caps =
+      GST_DEBUG_FUNCPTR (gst_jpegtimestampdec_set_caps);
+  base_transform_class->transform_size =
+      GST_DEBUG_FUNCPTR (gst_jpegtimestampdec_transform_size);
+  base_transform_class->transform =
+      GST_DEBUG_FUNCPTR (gst_jpegtimestampdec_transform);
+}
+
+/* libjpeg calls exit () on errors unless told otherwise */
+static void
+gst_jpegtimestampdec_error_exit (j_common_ptr cinfo)
+{
+  GstJpegTimestampDec *dec = cinfo->client_data;
+  char message[JMSG_LENGTH_MAX];
+
+  cinfo->err->format_message (cinfo, message);
+  GST_WARNING_OBJECT (dec, "Failed to decode frame: %s", message);
+  longjmp (dec->setjmp_buffer, 1);
+}
+
+static void
+gst_jpegtimestampdec_output_message (j_common_ptr cinfo)
+{
+  GstJpegTimestampDec *dec = cinfo->client_data;
+  char message[JMSG_LENGTH_MAX];
+
+  cinfo->err->format_message (cinfo, message);
+  GST_DEBUG_OBJECT (dec, "%s", message);
+}
+
+static void
+gst_jpegtimestampdec_init (GstJpegTimestampDec *dec)
+{
+  dec->rows = DEFAULT_ROWS;
+  dec->reduced_scale = TRUE;
+  dec->last_scale = 0;
+  gst_video_info_init (&dec->out_info);
+
+  dec->cinfo.err = jpeg_std_error (&dec->jerr);
+  dec->jerr.error_exit = gst_jpegtimestampdec_error_exit;
+  dec->jerr.output_message = gst_jpegtimestampdec_output_message;
+  jpeg_create_decompress (&dec->cinfo);
+  dec->cinfo.client_data = dec;
+}
+
+static void
+gst_jpegtimestampdec_finalize (GObject *object)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (object);
+
+  jpeg_destroy_decompress (&dec->cinfo);
+
+  G_OBJECT_CLASS (gst_jpegtimestampdec_parent_class)->finalize (object);
+}
+
+/* The output only depends on the rows property, not on the size of the
+ * MJPEG frames */
+static GstCaps *
+gst_jpegtimestampdec_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (trans);
+  GstCaps *othercaps;
+  guint i;
+
+  if (direction == GST_PAD_SINK) {
+    othercaps = gst_caps_new_empty ();
+    for (i = 0; i < gst_caps_get_size (caps); i++) {
+      GstStructure *s = gst_caps_get_structure (caps, i);
+      GstStructure *out = gst_structure_new ("video/x-raw",
+          "format", G_TYPE_STRING, "GRAY8",
+          "width", G_TYPE_INT, 64 * 8,
+          "height", G_TYPE_INT, 8 + 16 * dec->rows, NULL);
+      const GValue *framerate = gst_structure_get_value (s, "framerate");
+
+      if (framerate)
+        gst_structure_set_value (out, "framerate", framerate);
+      othercaps = gst_caps_merge_structure (othercaps, out);
+    }
+  } else {
+    othercaps = gst_caps_from_string (JPEG_CAPS);
+  }
+
+  if (filter) {
+    GstCaps *tmp = gst_caps_intersect_full (filter, othercaps,
+        GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (othercaps);
+    othercaps = tmp;
+  }
+  return othercaps;
+}
+
+static gboolean
+gst_jpegtimestampdec_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (trans);
+
+  return gst_video_info_from_caps (&dec->out_info, outcaps);
+}
+
+static gboolean
+gst_jpegtimestampdec_transform_size (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, gsize size,
+    GstCaps * othercaps, gsize * othersize)
+{
+  GstVideoInfo info;
+
+  if (direction != GST_PAD_SINK || !gst_video_info_from_caps (&info,
+          othercaps))
+    return FALSE;
+  *othersize = GST_VIDEO_INFO_SIZE (&info);
+  return TRUE;
+}
+
+/* Decodes the header row and the rows below it into out, which holds the
+ * code block from line rows * 8 on.  The scale is the largest of 1/8, 1/4
+ * and 1/2 the block is aligned to, so every scaled pixel lies within one
+ * box, and every box is drawn with the pixels of its scaled ones.  Returns
+ * FALSE if the frame can't be decoded or is too small. */
+static gboolean
+gst_jpegtimestampdec_decode (GstJpegTimestampDec *dec, const guint8 *jpeg,
+    gsize size, guint8 *out, gint stride)
+{
+  struct jpeg_decompress_struct *cinfo = &dec->cinfo;
+  JDIMENSION xoffset, width, lines, j;
+  JSAMPARRAY line;
+  gint left, top, x, i;
+  guint scale;
+
+  if (setjmp (dec->setjmp_buffer)) {
+    jpeg_abort_decompress (cinfo);
+    return FALSE;
+  }
+
+  jpeg_mem_src (cinfo, (unsigned char *) jpeg, size);
+  jpeg_read_header (cinfo, TRUE);
+
+  left = ((gint) cinfo->image_width - 64 * 8) / 2;
+  top = ((gint) cinfo->image_height - 8) / 2;
+  if (left < 0 || top < 0) {
+    GST_WARNING_OBJECT (dec, "%ux%u frames are too small for a code block",
+        cinfo->image_width, cinfo->image_height);
+    jpeg_abort_decompress (cinfo);
+    return FALSE;
+  }
+
+  for (scale = dec->reduced_scale ? 8 : 1; scale > 1; scale /= 2)
+    if (left % scale == 0 && top % scale == 0)
+      break;
+  if (scale != dec->last_scale) {
+    GST_INFO_OBJECT (dec, "Decoding the code block at 1/%u scale", scale);
+    dec->last_scale = scale;
+  }
+
+  /* Only the luma is needed, without any smoothing */
+  cinfo->out_color_space = JCS_GRAYSCALE;
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = scale;
+  cinfo->dct_method = JDCT_IFAST;
+  cinfo->do_fancy_upsampling = FALSE;
+  cinfo->do_block_smoothing = FALSE;
+  jpeg_start_decompress (cinfo);
+
+  xoffset = left / scale;
+  width = 64 * 8 / scale;
+  jpeg_crop_scanline (cinfo, &xoffset, &width);
+  lines = MIN ((8 + dec->rows * 8) / scale,
+      cinfo->output_height - top / scale);
+  jpeg_skip_scanlines (cinfo, top / scale);
+
+  line = cinfo->mem->alloc_sarray ((j_common_ptr) cinfo, JPOOL_IMAGE,
+      width, 1);
+  out += dec->rows * 8 * stride;
+  for (j = 0; j < lines; j++) {
+    const guint8 *src = line[0] + left / scale - xoffset;
+
+    jpeg_read_scanlines (cinfo, line, 1);
+    for (i = 0; i < (gint) scale; i++, out += stride)
+      for (x = 0; x < 64 * 8; x++)
+        out[x] = src[x / scale];
+  }
+
+  /* The rest of the frame is not needed */
+  jpeg_abort_decompress (cinfo);
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_jpegtimestampdec_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  GstJpegTimestampDec *dec = GST_JPEGTIMESTAMPDEC (trans);
+  GstMapInfo in, out;
+
+  if (!gst_buffer_map (inbuf, &in, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+  if (!gst_buffer_map (outbuf, &out, GST_MAP_WRITE)) {
+    gst_buffer_unmap (inbuf, &in);
+    return GST_FLOW_ERROR;
+  }
+
+  /* Lines that are not decoded stay black, so a frame that fails to
+   * decode has no header for timeoverlayparse */
+  memset (out.data, 0, out.size);
+  gst_jpegtimestampdec_decode (dec, in.data, in.size, out.data,
+      GST_VIDEO_INFO_PLANE_STRIDE (&dec->out_info, 0));
+
+  gst_buffer_unmap (outbuf, &out);
+  gst_buffer_unmap (inbuf, &in);
+  return GST_FLOW_OK;
+}
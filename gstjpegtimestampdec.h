@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_JPEGTIMESTAMPDEC_H_
+#define _GST_JPEGTIMESTAMPDEC_H_
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/video/video.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_JPEGTIMESTAMPDEC   (gst_jpegtimestampdec_get_type())
+#define GST_JPEGTIMESTAMPDEC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_JPEGTIMESTAMPDEC,GstJpegTimestampDec))
+#define GST_JPEGTIMESTAMPDEC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_JPEGTIMESTAMPDEC,GstJpegTimestampDecClass))
+#define GST_IS_JPEGTIMESTAMPDEC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_JPEGTIMESTAMPDEC))
+#define GST_IS_JPEGTIMESTAMPDEC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_JPEGTIMESTAMPDEC))
+
+typedef struct _GstJpegTimestampDec GstJpegTimestampDec;
+typedef struct _GstJpegTimestampDecClass GstJpegTimestampDecClass;
+
+struct _GstJpegTimestampDec
+{
+  GstBaseTransform base_jpegtimestampdec;
+
+  /* properties */
+  guint rows;
+  gboolean reduced_scale;
+
+  GstVideoInfo out_info;
+
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  jmp_buf setjmp_buffer;
+
+  /* scale denominator of the last frame, to log changes */
+  guint last_scale;
+};
+
+struct _GstJpegTimestampDecClass
+{
+  GstBaseTransformClass base_jpegtimestampdec_class;
+};
+
+GType gst_jpegtimestampdec_get_type (void);
+
+G_END_DECLS
+
+#endif
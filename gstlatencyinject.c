@@ -0,0 +1,623 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstlatencyinject
+ *
+ * The latencyinject element holds every buffer back for a programmable
+ * delay, measured on the pipeline clock, so that the latency reported by
+ * timeoverlayparse can be checked against a known value.  The delay is
+ * either constant, constant plus uniformly distributed jitter, or read from
+ * a trace file with one delay in milliseconds per line, replayed in a loop.
+ *
+ * Buffers are never reordered: a buffer is released no earlier than the one
+ * before it.  All buffers are released by a single streaming thread that
+ * only ever waits for the head of the queue.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 videotestsrc is-live=true ! timestampoverlay ! latencyinject mode=uniform delay=20000000 jitter=5000000 ! timeoverlayparse ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstlatencyinject.h"
+
+#include <stdlib.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_latencyinject_debug_category);
+#define GST_CAT_DEFAULT gst_latencyinject_debug_category
+
+typedef struct {
+  GstMiniObject *obj;
+  GstClockTime arrival;
+  GstClockTime release;
+} QueueItem;
+
+/* prototypes */
+static void gst_latencyinject_finalize (GObject *object);
+static GstFlowReturn gst_latencyinject_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buf);
+static gboolean gst_latencyinject_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_latencyinject_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static gboolean gst_latencyinject_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+
+enum
+{
+  PROP_0,
+  PROP_MODE,
+  PROP_DELAY,
+  PROP_JITTER,
+  PROP_SEED,
+  PROP_TRACE_LOCATION,
+  PROP_POST_MESSAGES
+};
+
+#define DEFAULT_MODE GST_LATENCYINJECT_MODE_CONSTANT
+#define DEFAULT_DELAY 0
+#define DEFAULT_JITTER 0
+#define DEFAULT_SEED 0
+
+GType
+gst_latencyinject_mode_get_type (void)
+{
+  static GType mode_type = 0;
+
+  if (!mode_type) {
+    static GEnumValue mode_types[] = {
+      { GST_LATENCYINJECT_MODE_CONSTANT, "Always delay", "constant" },
+      { GST_LATENCYINJECT_MODE_UNIFORM,
+        "delay plus uniformly distributed jitter", "uniform" },
+      { GST_LATENCYINJECT_MODE_TRACE,
+        "Delays replayed from trace-location", "trace" },
+      { 0, NULL, NULL },
+    };
+
+    mode_type = g_enum_register_static ("latencyinject_mode", mode_types);
+  }
+
+  return mode_type;
+}
+
+/* Reads one delay in milliseconds per line; empty lines and lines starting
+ * with '#' are skipped.  Called with the object lock held. */
+static void
+gst_latencyinject_load_trace (GstLatencyInject *inject)
+{
+  gchar *contents = NULL, **lines, **line;
+  GError *err = NULL;
+
+  g_array_set_size (inject->trace, 0);
+  inject->trace_pos = 0;
+  if (!inject->trace_location)
+    return;
+
+  if (!g_file_get_contents (inject->trace_location, &contents, NULL, &err)) {
+    GST_WARNING_OBJECT (inject, "Can't read trace: %s", err->message);
+    g_error_free (err);
+    return;
+  }
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line; line++) {
+    gchar *s = g_strstrip (*line), *end;
+    gdouble ms;
+    GstClockTime delay;
+
+    if (*s == '\0' || *s == '#')
+      continue;
+    ms = g_ascii_strtod (s, &end);
+    if (end == s || ms < 0) {
+      GST_WARNING_OBJECT (inject, "Ignoring trace line \"%s\"", s);
+      continue;
+    }
+    delay = (GstClockTime) (ms * GST_MSECOND);
+    g_array_append_val (inject->trace, delay);
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  GST_INFO_OBJECT (inject, "Loaded %u delays from %s", inject->trace->len,
+      inject->trace_location);
+}
+
+static void
+gst_latencyinject_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (object);
+
+  GST_OBJECT_LOCK (inject);
+  switch (prop_id) {
+  case PROP_MODE:
+    inject->mode = g_value_get_enum (value);
+    break;
+  case PROP_DELAY:
+    inject->delay = g_value_get_uint64 (value);
+    break;
+  case PROP_JITTER:
+    inject->jitter = g_value_get_uint64 (value);
+    break;
+  case PROP_SEED:
+    inject->seed = g_value_get_uint (value);
+    g_rand_set_seed (inject->rand, inject->seed);
+    break;
+  case PROP_TRACE_LOCATION:
+    g_free (inject->trace_location);
+    inject->trace_location = g_value_dup_string (value);
+    gst_latencyinject_load_trace (inject);
+    break;
+  case PROP_POST_MESSAGES:
+    inject->post_messages = g_value_get_boolean (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK (inject);
+}
+
+static void
+gst_latencyinject_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (object);
+
+  GST_OBJECT_LOCK (inject);
+  switch (prop_id) {
+  case PROP_MODE:
+    g_value_set_enum (value, inject->mode);
+    break;
+  case PROP_DELAY:
+    g_value_set_uint64 (value, inject->delay);
+    break;
+  case PROP_JITTER:
+    g_value_set_uint64 (value, inject->jitter);
+    break;
+  case PROP_SEED:
+    g_value_set_uint (value, inject->seed);
+    break;
+  case PROP_TRACE_LOCATION:
+    g_value_set_string (value, inject->trace_location);
+    break;
+  case PROP_POST_MESSAGES:
+    g_value_set_boolean (value, inject->post_messages);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK (inject);
+}
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_latencyinject_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate gst_latencyinject_src_template =
+GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstLatencyInject, gst_latencyinject,
+  GST_TYPE_ELEMENT,
+  GST_DEBUG_CATEGORY_INIT (gst_latencyinject_debug_category,
+  "latencyinject", 0,
+  "debug category for latencyinject element"));
+
+static void
+gst_latencyinject_class_init (GstLatencyInjectClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_add_static_pad_template (gstelement_class,
+      &gst_latencyinject_sink_template);
+  gst_element_class_add_static_pad_template (gstelement_class,
+      &gst_latencyinject_src_template);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "LatencyInject", "Generic",
+      "Delays buffers by a programmable amount on the pipeline clock",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_latencyinject_set_property;
+  gobject_class->get_property = gst_latencyinject_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MODE,
+    g_param_spec_enum ("mode", "Mode", "How the delay of a buffer is chosen",
+                       GST_TYPE_LATENCYINJECT_MODE, DEFAULT_MODE,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DELAY,
+    g_param_spec_uint64 ("delay", "Delay",
+                         "Delay in nanoseconds (constant and uniform mode, "
+                         "and trace mode while there is no trace)",
+                         0, G_MAXUINT64, DEFAULT_DELAY,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_JITTER,
+    g_param_spec_uint64 ("jitter", "Jitter",
+                         "Largest random extra delay in nanoseconds in "
+                         "uniform mode",
+                         0, G_MAXUINT64, DEFAULT_JITTER,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SEED,
+    g_param_spec_uint ("seed", "Seed",
+                       "Seed of the jitter, so runs can be repeated",
+                       0, G_MAXUINT32, DEFAULT_SEED,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TRACE_LOCATION,
+    g_param_spec_string ("trace-location", "Trace location",
+                         "File with one delay in milliseconds per line",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+    g_param_spec_boolean ("post-messages", "Post messages",
+                          "Post an element message with the delay of every "
+                          "buffer",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gobject_class->finalize = gst_latencyinject_finalize;
+}
+
+static void
+gst_latencyinject_init (GstLatencyInject *inject)
+{
+  inject->sinkpad = gst_pad_new_from_static_template (
+      &gst_latencyinject_sink_template, "sink");
+  gst_pad_set_chain_function (inject->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_latencyinject_chain));
+  gst_pad_set_event_function (inject->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_latencyinject_sink_event));
+  GST_PAD_SET_PROXY_CAPS (inject->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (inject->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (inject), inject->sinkpad);
+
+  inject->srcpad = gst_pad_new_from_static_template (
+      &gst_latencyinject_src_template, "src");
+  gst_pad_set_query_function (inject->srcpad,
+      GST_DEBUG_FUNCPTR (gst_latencyinject_src_query));
+  gst_pad_set_activatemode_function (inject->srcpad,
+      GST_DEBUG_FUNCPTR (gst_latencyinject_src_activate_mode));
+  GST_PAD_SET_PROXY_CAPS (inject->srcpad);
+  gst_element_add_pad (GST_ELEMENT (inject), inject->srcpad);
+
+  inject->mode = DEFAULT_MODE;
+  inject->delay = DEFAULT_DELAY;
+  inject->jitter = DEFAULT_JITTER;
+  inject->seed = DEFAULT_SEED;
+  inject->trace_location = NULL;
+  inject->post_messages = FALSE;
+  inject->trace = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  inject->trace_pos = 0;
+  inject->rand = g_rand_new_with_seed (DEFAULT_SEED);
+
+  g_mutex_init (&inject->lock);
+  g_cond_init (&inject->cond);
+  g_queue_init (&inject->queue);
+  inject->last_release = 0;
+  inject->clock_id = NULL;
+  inject->flushing = TRUE;
+  inject->srcresult = GST_FLOW_FLUSHING;
+}
+
+static void
+gst_latencyinject_item_free (QueueItem *item)
+{
+  gst_mini_object_unref (item->obj);
+  g_free (item);
+}
+
+static void
+gst_latencyinject_finalize (GObject *object)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (object);
+
+  g_queue_clear_full (&inject->queue,
+      (GDestroyNotify) gst_latencyinject_item_free);
+  g_mutex_clear (&inject->lock);
+  g_cond_clear (&inject->cond);
+  g_array_free (inject->trace, TRUE);
+  g_rand_free (inject->rand);
+  g_free (inject->trace_location);
+
+  G_OBJECT_CLASS (gst_latencyinject_parent_class)->finalize (object);
+}
+
+/* The delay of the next buffer.  Called with the object lock held. */
+static GstClockTime
+gst_latencyinject_next_delay (GstLatencyInject *inject)
+{
+  switch (inject->mode) {
+  case GST_LATENCYINJECT_MODE_UNIFORM:
+    return inject->delay +
+        (GstClockTime) (g_rand_double (inject->rand) * inject->jitter);
+  case GST_LATENCYINJECT_MODE_TRACE:
+    if (inject->trace->len > 0)
+      return g_array_index (inject->trace, GstClockTime,
+          inject->trace_pos++ % inject->trace->len);
+    return inject->delay;
+  case GST_LATENCYINJECT_MODE_CONSTANT:
+  default:
+    return inject->delay;
+  }
+}
+
+/* The largest delay any buffer may get, reported as latency */
+static GstClockTime
+gst_latencyinject_max_delay (GstLatencyInject *inject)
+{
+  GstClockTime max = inject->delay;
+  guint i;
+
+  GST_OBJECT_LOCK (inject);
+  if (inject->mode == GST_LATENCYINJECT_MODE_UNIFORM) {
+    max = inject->delay + inject->jitter;
+  } else if (inject->mode == GST_LATENCYINJECT_MODE_TRACE &&
+      inject->trace->len > 0) {
+    max = 0;
+    for (i = 0; i < inject->trace->len; i++)
+      max = MAX (max, g_array_index (inject->trace, GstClockTime, i));
+  }
+  GST_OBJECT_UNLOCK (inject);
+
+  return max;
+}
+
+/* Queues obj for release delay after now, but not before the item queued
+ * before it */
+static GstFlowReturn
+gst_latencyinject_enqueue (GstLatencyInject *inject, GstMiniObject *obj,
+    GstClockTime delay)
+{
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (inject));
+  QueueItem *item;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&inject->lock);
+  ret = inject->srcresult;
+  if (ret != GST_FLOW_OK) {
+    g_mutex_unlock (&inject->lock);
+    gst_mini_object_unref (obj);
+    if (clock)
+      gst_object_unref (clock);
+    return ret;
+  }
+
+  item = g_new (QueueItem, 1);
+  item->obj = obj;
+  item->arrival = clock ? gst_clock_get_time (clock) : GST_CLOCK_TIME_NONE;
+  item->release = GST_CLOCK_TIME_IS_VALID (item->arrival) ?
+      MAX (item->arrival + delay, inject->last_release) : GST_CLOCK_TIME_NONE;
+  if (GST_CLOCK_TIME_IS_VALID (item->release))
+    inject->last_release = item->release;
+  g_queue_push_tail (&inject->queue, item);
+  g_cond_signal (&inject->cond);
+  g_mutex_unlock (&inject->lock);
+
+  if (clock)
+    gst_object_unref (clock);
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_latencyinject_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (parent);
+  GstClockTime delay;
+
+  GST_OBJECT_LOCK (inject);
+  delay = gst_latencyinject_next_delay (inject);
+  GST_OBJECT_UNLOCK (inject);
+
+  return gst_latencyinject_enqueue (inject, GST_MINI_OBJECT_CAST (buf),
+      delay);
+}
+
+/* Drops everything queued and wakes the streaming thread.  Called with
+ * inject->lock held. */
+static void
+gst_latencyinject_set_flushing (GstLatencyInject *inject)
+{
+  inject->flushing = TRUE;
+  inject->srcresult = GST_FLOW_FLUSHING;
+  if (inject->clock_id)
+    gst_clock_id_unschedule (inject->clock_id);
+  g_queue_clear_full (&inject->queue,
+      (GDestroyNotify) gst_latencyinject_item_free);
+  g_cond_signal (&inject->cond);
+}
+
+static void gst_latencyinject_loop (GstLatencyInject *inject);
+
+static gboolean
+gst_latencyinject_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+  case GST_EVENT_FLUSH_START:
+    gst_pad_push_event (inject->srcpad, event);
+    g_mutex_lock (&inject->lock);
+    gst_latencyinject_set_flushing (inject);
+    g_mutex_unlock (&inject->lock);
+    gst_pad_pause_task (inject->srcpad);
+    return TRUE;
+  case GST_EVENT_FLUSH_STOP:
+    g_mutex_lock (&inject->lock);
+    inject->flushing = FALSE;
+    inject->srcresult = GST_FLOW_OK;
+    inject->last_release = 0;
+    g_mutex_unlock (&inject->lock);
+    gst_pad_push_event (inject->srcpad, event);
+    return gst_pad_start_task (inject->srcpad,
+        (GstTaskFunction) gst_latencyinject_loop, inject, NULL);
+  default:
+    break;
+  }
+
+  /* Serialized events keep their place between the buffers */
+  if (GST_EVENT_IS_SERIALIZED (event))
+    return gst_latencyinject_enqueue (inject, GST_MINI_OBJECT_CAST (event),
+        0) == GST_FLOW_OK;
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_latencyinject_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (parent);
+  GstClockTime min, max, delay;
+  gboolean live;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+    return gst_pad_query_default (pad, parent, query);
+
+  if (!gst_pad_peer_query (inject->sinkpad, query))
+    return FALSE;
+
+  gst_query_parse_latency (query, &live, &min, &max);
+  delay = gst_latencyinject_max_delay (inject);
+  min += delay;
+  if (GST_CLOCK_TIME_IS_VALID (max))
+    max += delay;
+  gst_query_set_latency (query, live, min, max);
+  GST_DEBUG_OBJECT (inject, "latency: min %" GST_TIME_FORMAT " max %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+  return TRUE;
+}
+
+static void
+gst_latencyinject_loop (GstLatencyInject *inject)
+{
+  GstClock *clock;
+  QueueItem *item;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean post_messages;
+
+  g_mutex_lock (&inject->lock);
+  while (g_queue_is_empty (&inject->queue) && !inject->flushing)
+    g_cond_wait (&inject->cond, &inject->lock);
+  if (inject->flushing)
+    goto out_flushing;
+
+  item = g_queue_peek_head (&inject->queue);
+  clock = gst_element_get_clock (GST_ELEMENT (inject));
+  if (clock && GST_CLOCK_TIME_IS_VALID (item->release)) {
+    inject->clock_id = gst_clock_new_single_shot_id (clock, item->release);
+    g_mutex_unlock (&inject->lock);
+    gst_clock_id_wait (inject->clock_id, NULL);
+    g_mutex_lock (&inject->lock);
+    gst_clock_id_unref (inject->clock_id);
+    inject->clock_id = NULL;
+  }
+  if (clock)
+    gst_object_unref (clock);
+  if (inject->flushing)
+    goto out_flushing;
+  item = g_queue_pop_head (&inject->queue);
+  g_mutex_unlock (&inject->lock);
+
+  if (GST_IS_BUFFER (item->obj)) {
+    GstBuffer *buf = GST_BUFFER_CAST (item->obj);
+    GstClockTime pts = GST_BUFFER_PTS (buf);
+
+    GST_OBJECT_LOCK (inject);
+    post_messages = inject->post_messages;
+    GST_OBJECT_UNLOCK (inject);
+
+    item->obj = NULL;
+    ret = gst_pad_push (inject->srcpad, buf);
+    if (post_messages && GST_CLOCK_TIME_IS_VALID (item->release)) {
+      gst_element_post_message (GST_ELEMENT (inject),
+          gst_message_new_element (GST_OBJECT (inject),
+              gst_structure_new ("latencyinject",
+                  "pts", G_TYPE_UINT64, pts,
+                  "delay", G_TYPE_UINT64, item->release - item->arrival,
+                  NULL)));
+    }
+  } else {
+    GstEvent *event = GST_EVENT_CAST (item->obj);
+
+    item->obj = NULL;
+    if (GST_EVENT_TYPE (event) == GST_EVENT_EOS)
+      ret = GST_FLOW_EOS;
+    gst_pad_push_event (inject->srcpad, event);
+  }
+  g_free (item);
+
+  if (ret != GST_FLOW_OK) {
+    g_mutex_lock (&inject->lock);
+    inject->srcresult = ret;
+    g_mutex_unlock (&inject->lock);
+    gst_pad_pause_task (inject->srcpad);
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS)
+      GST_ELEMENT_FLOW_ERROR (inject, ret);
+  }
+  return;
+
+out_flushing:
+  g_mutex_unlock (&inject->lock);
+  gst_pad_pause_task (inject->srcpad);
+}
+
+static gboolean
+gst_latencyinject_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstLatencyInject *inject = GST_LATENCYINJECT (parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active) {
+    g_mutex_lock (&inject->lock);
+    inject->flushing = FALSE;
+    inject->srcresult = GST_FLOW_OK;
+    inject->last_release = 0;
+    g_mutex_unlock (&inject->lock);
+
+    /* Every run replays the same delays */
+    GST_OBJECT_LOCK (inject);
+    g_rand_set_seed (inject->rand, inject->seed);
+    inject->trace_pos = 0;
+    GST_OBJECT_UNLOCK (inject);
+
+    return gst_pad_start_task (pad, (GstTaskFunction) gst_latencyinject_loop,
+        inject, NULL);
+  }
+
+  g_mutex_lock (&inject->lock);
+  gst_latencyinject_set_flushing (inject);
+  g_mutex_unlock (&inject->lock);
+  return gst_pad_stop_task (pad);
+}
@@ -0,0 +1,83 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_LATENCYINJECT_H_
+#define _GST_LATENCYINJECT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_LATENCYINJECT   (gst_latencyinject_get_type())
+#define GST_LATENCYINJECT(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LATENCYINJECT,GstLatencyInject))
+#define GST_LATENCYINJECT_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_LATENCYINJECT,GstLatencyInjectClass))
+#define GST_IS_LATENCYINJECT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LATENCYINJECT))
+#define GST_IS_LATENCYINJECT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_LATENCYINJECT))
+
+typedef struct _GstLatencyInject GstLatencyInject;
+typedef struct _GstLatencyInjectClass GstLatencyInjectClass;
+
+typedef enum {
+  GST_LATENCYINJECT_MODE_CONSTANT,
+  GST_LATENCYINJECT_MODE_UNIFORM,
+  GST_LATENCYINJECT_MODE_TRACE,
+} GstLatencyInjectMode;
+
+#define GST_TYPE_LATENCYINJECT_MODE (gst_latencyinject_mode_get_type ())
+GType gst_latencyinject_mode_get_type (void);
+
+struct _GstLatencyInject
+{
+  GstElement base_latencyinject;
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* properties, protected by the object lock */
+  GstLatencyInjectMode mode;
+  GstClockTime delay;
+  GstClockTime jitter;
+  guint32 seed;
+  gchar *trace_location;
+  gboolean post_messages;
+
+  /* delays read from trace_location */
+  GArray *trace;
+  guint trace_pos;
+  GRand *rand;
+
+  /* Buffers and serialized events waiting for their release time.  They
+   * are released in order, so the only timer ever needed is the one for
+   * the head of the queue. */
+  GMutex lock;
+  GCond cond;
+  GQueue queue;
+  GstClockTime last_release;
+  GstClockID clock_id;
+  gboolean flushing;
+  GstFlowReturn srcresult;
+};
+
+struct _GstLatencyInjectClass
+{
+  GstElementClass base_latencyinject_class;
+};
+
+GType gst_latencyinject_get_type (void);
+
+G_END_DECLS
+
+#endif
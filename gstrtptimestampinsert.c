@@ -0,0 +1,230 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstrtptimestampinsert
+ *
+ * The rtptimestampinsert element stamps every RTP packet with the time it
+ * passes through, as a one-byte RTP header extension in the style of
+ * abs-capture-time.  Put it right after the payloader; rtptimestampparse
+ * right before the depayloader reports the transit time of every packet
+ * and frame.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 videotestsrc ! x264enc tune=zerolatency ! rtph264pay ! rtptimestampinsert ! udpsink host=127.0.0.1 port=5000
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "gstrtptimestampinsert.h"
+
+#include <inttypes.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_rtptimestampinsert_debug_category);
+#define GST_CAT_DEFAULT gst_rtptimestampinsert_debug_category
+
+/* prototypes */
+static void gst_rtptimestampinsert_dispose (GObject *object);
+static gboolean gst_rtptimestampinsert_start (GstBaseTransform * trans);
+static gboolean gst_rtptimestampinsert_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_rtptimestampinsert_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_EXTENSION_ID,
+  PROP_TIME_SOURCE
+};
+
+static void
+gst_rtptimestampinsert_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (object);
+
+  switch (prop_id) {
+  case PROP_EXTENSION_ID:
+    insert->extension_id = g_value_get_uint (value);
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&insert->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_rtptimestampinsert_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (object);
+
+  switch (prop_id) {
+  case PROP_EXTENSION_ID:
+    g_value_set_uint (value, insert->extension_id);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&insert->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define RTP_CAPS "application/x-rtp"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstRtpTimestampInsert, gst_rtptimestampinsert,
+  GST_TYPE_BASE_TRANSFORM,
+  GST_DEBUG_CATEGORY_INIT (gst_rtptimestampinsert_debug_category,
+  "rtptimestampinsert", 0,
+  "debug category for rtptimestampinsert element"));
+
+static void
+gst_rtptimestampinsert_class_init (GstRtpTimestampInsertClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (RTP_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (RTP_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RtpTimestampInsert", "Network/RTP",
+      "Stamps RTP packets with their send time in a header extension",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_rtptimestampinsert_set_property;
+  gobject_class->get_property = gst_rtptimestampinsert_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_EXTENSION_ID,
+    g_param_spec_uint ("extension-id", "Extension id",
+                       "ID of the one-byte RTP header extension element",
+                       1, 14, GST_TIMESTAMP_RTP_HDREXT_DEFAULT_ID,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the send time is read from");
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_rtptimestampinsert_dispose);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampinsert_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampinsert_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampinsert_transform_ip);
+}
+
+static void
+gst_rtptimestampinsert_init (GstRtpTimestampInsert *insert)
+{
+  insert->frame_id = 0;
+  insert->have_rtptime = FALSE;
+  insert->last_rtptime = 0;
+  insert->extension_id = GST_TIMESTAMP_RTP_HDREXT_DEFAULT_ID;
+  gst_timestamp_systime_init (&insert->time_source);
+}
+
+static void
+gst_rtptimestampinsert_dispose (GObject *object)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (object);
+
+  gst_timestamp_systime_clear (&insert->time_source);
+
+  G_OBJECT_CLASS (gst_rtptimestampinsert_parent_class)->dispose (object);
+}
+
+static gboolean
+gst_rtptimestampinsert_start (GstBaseTransform * trans)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (trans);
+
+  insert->have_rtptime = FALSE;
+  return gst_timestamp_systime_start (&insert->time_source,
+      GST_ELEMENT (insert));
+}
+
+static gboolean
+gst_rtptimestampinsert_stop (GstBaseTransform * trans)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (trans);
+
+  gst_timestamp_systime_stop (&insert->time_source);
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_rtptimestampinsert_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstRtpTimestampInsert *insert = GST_RTPTIMESTAMPINSERT (trans);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 data[GST_TIMESTAMP_RTP_HDREXT_SIZE];
+  uint64_t systime;
+  guint32 rtptime;
+  gboolean added;
+
+  /* No FEC here: UDP checksums the packet already */
+  systime = gst_timestamp_systime_now (&insert->time_source,
+      GST_ELEMENT (insert));
+
+  if (!gst_rtp_buffer_map (buf, GST_MAP_READWRITE, &rtp)) {
+    GST_WARNING_OBJECT (insert, "Can't stamp: not an RTP packet");
+    return GST_FLOW_OK;
+  }
+
+  /* All packets of a frame share the RTP timestamp */
+  rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+  if (!insert->have_rtptime || rtptime != insert->last_rtptime) {
+    insert->frame_id++;
+    insert->last_rtptime = rtptime;
+    insert->have_rtptime = TRUE;
+  }
+  GST_LOG_OBJECT (insert, "systime: %" PRIx64 ", frame_id: %" PRIx64
+      ", seqnum: %u", systime, insert->frame_id,
+      gst_rtp_buffer_get_seq (&rtp));
+
+  GST_WRITE_UINT64_BE (data, systime);
+  GST_WRITE_UINT32_BE (data + 8, (guint32) insert->frame_id);
+  added = gst_rtp_buffer_add_extension_onebyte_header (&rtp,
+      insert->extension_id, data, sizeof (data));
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (!added)
+    GST_WARNING_OBJECT (insert, "Can't stamp packet: it already has a "
+        "header extension that isn't one-byte or is full");
+
+  return GST_FLOW_OK;
+}
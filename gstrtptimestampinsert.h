@@ -0,0 +1,56 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_RTPTIMESTAMPINSERT_H_
+#define _GST_RTPTIMESTAMPINSERT_H_
+
+#include <gst/base/gstbasetransform.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RTPTIMESTAMPINSERT   (gst_rtptimestampinsert_get_type())
+#define GST_RTPTIMESTAMPINSERT(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RTPTIMESTAMPINSERT,GstRtpTimestampInsert))
+#define GST_RTPTIMESTAMPINSERT_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RTPTIMESTAMPINSERT,GstRtpTimestampInsertClass))
+#define GST_IS_RTPTIMESTAMPINSERT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RTPTIMESTAMPINSERT))
+#define GST_IS_RTPTIMESTAMPINSERT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RTPTIMESTAMPINSERT))
+
+typedef struct _GstRtpTimestampInsert GstRtpTimestampInsert;
+typedef struct _GstRtpTimestampInsertClass GstRtpTimestampInsertClass;
+
+struct _GstRtpTimestampInsert
+{
+  GstBaseTransform base_rtptimestampinsert;
+  uint64_t frame_id;
+  gboolean have_rtptime;
+  guint32 last_rtptime;
+
+  guint extension_id;
+  GstTimestampSystime time_source;
+};
+
+struct _GstRtpTimestampInsertClass
+{
+  GstBaseTransformClass base_rtptimestampinsert_class;
+};
+
+GType gst_rtptimestampinsert_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,306 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstrtptimestampparse
+ *
+ * The rtptimestampparse element reads the header extension written by
+ * rtptimestampinsert and reports the transit time of every frame, from the
+ * moment its first packet was stamped to the arrival of its last packet.
+ * With post-packet-messages it also reports every single packet.  Put it
+ * in front of the jitterbuffer to measure the network alone, or after it
+ * to include the jitterbuffer delay.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 udpsrc port=5000 caps=application/x-rtp,media=video,encoding-name=H264,clock-rate=90000 ! rtptimestampparse ! rtpjitterbuffer ! rtph264depay ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "gstrtptimestampparse.h"
+
+#include <inttypes.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_rtptimestampparse_debug_category);
+#define GST_CAT_DEFAULT gst_rtptimestampparse_debug_category
+
+/* prototypes */
+static void gst_rtptimestampparse_dispose (GObject *object);
+static gboolean gst_rtptimestampparse_start (GstBaseTransform * trans);
+static gboolean gst_rtptimestampparse_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_rtptimestampparse_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_EXTENSION_ID,
+  PROP_POST_MESSAGES,
+  PROP_POST_PACKET_MESSAGES,
+  PROP_TIME_SOURCE
+};
+
+static void
+gst_rtptimestampparse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (object);
+
+  switch (prop_id) {
+  case PROP_EXTENSION_ID:
+    parse->extension_id = g_value_get_uint (value);
+    break;
+  case PROP_POST_MESSAGES:
+    parse->post_messages = g_value_get_boolean (value);
+    break;
+  case PROP_POST_PACKET_MESSAGES:
+    parse->post_packet_messages = g_value_get_boolean (value);
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&parse->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_rtptimestampparse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (object);
+
+  switch (prop_id) {
+  case PROP_EXTENSION_ID:
+    g_value_set_uint (value, parse->extension_id);
+    break;
+  case PROP_POST_MESSAGES:
+    g_value_set_boolean (value, parse->post_messages);
+    break;
+  case PROP_POST_PACKET_MESSAGES:
+    g_value_set_boolean (value, parse->post_packet_messages);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&parse->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define RTP_CAPS "application/x-rtp"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstRtpTimestampParse, gst_rtptimestampparse,
+  GST_TYPE_BASE_TRANSFORM,
+  GST_DEBUG_CATEGORY_INIT (gst_rtptimestampparse_debug_category,
+  "rtptimestampparse", 0,
+  "debug category for rtptimestampparse element"));
+
+static void
+gst_rtptimestampparse_class_init (GstRtpTimestampParseClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (RTP_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (RTP_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RtpTimestampParse", "Network/RTP",
+      "Reports the transit time of packets stamped by rtptimestampinsert",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_rtptimestampparse_set_property;
+  gobject_class->get_property = gst_rtptimestampparse_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_EXTENSION_ID,
+    g_param_spec_uint ("extension-id", "Extension id",
+                       "ID of the one-byte RTP header extension element",
+                       1, 14, GST_TIMESTAMP_RTP_HDREXT_DEFAULT_ID,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+    g_param_spec_boolean ("post-messages", "Post messages",
+                          "Post an element message for every frame",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_PACKET_MESSAGES,
+    g_param_spec_boolean ("post-packet-messages", "Post packet messages",
+                          "Post an element message for every packet",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the receive time is read from.  "
+      "Must be the source the rtptimestampinsert uses");
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_rtptimestampparse_dispose);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampparse_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampparse_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_rtptimestampparse_transform_ip);
+}
+
+static void
+gst_rtptimestampparse_init (GstRtpTimestampParse *parse)
+{
+  parse->extension_id = GST_TIMESTAMP_RTP_HDREXT_DEFAULT_ID;
+  parse->post_messages = FALSE;
+  parse->post_packet_messages = FALSE;
+  parse->have_frame = FALSE;
+
+  /* Only reads the packets */
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (parse), TRUE);
+  gst_timestamp_systime_init (&parse->time_source);
+}
+
+static void
+gst_rtptimestampparse_dispose (GObject *object)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (object);
+
+  gst_timestamp_systime_clear (&parse->time_source);
+
+  G_OBJECT_CLASS (gst_rtptimestampparse_parent_class)->dispose (object);
+}
+
+static gboolean
+gst_rtptimestampparse_start (GstBaseTransform * trans)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (trans);
+
+  parse->have_frame = FALSE;
+  return gst_timestamp_systime_start (&parse->time_source,
+      GST_ELEMENT (parse));
+}
+
+static gboolean
+gst_rtptimestampparse_stop (GstBaseTransform * trans)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (trans);
+
+  gst_timestamp_systime_stop (&parse->time_source);
+  return TRUE;
+}
+
+/* Reports the frame whose packets have been collected so far */
+static void
+gst_rtptimestampparse_finish_frame (GstRtpTimestampParse *parse)
+{
+  GstClockTimeDiff transit;
+
+  if (!parse->have_frame)
+    return;
+  parse->have_frame = FALSE;
+
+  transit = GST_CLOCK_DIFF (parse->first_sent, parse->last_received);
+  GST_INFO_OBJECT (parse, "Frame-id: %" G_GUINT64_FORMAT "; Packets: %u; "
+      "Transit: %" G_GINT64_FORMAT, parse->frame_id, parse->packets, transit);
+
+  if (parse->post_messages) {
+    gst_element_post_message (GST_ELEMENT (parse),
+        gst_message_new_element (GST_OBJECT (parse),
+            gst_structure_new ("rtptimestampparse",
+                "frame-id", G_TYPE_UINT64, parse->frame_id,
+                "packets", G_TYPE_UINT, parse->packets,
+                "remote-time", G_TYPE_UINT64, parse->first_sent,
+                "receive-time", G_TYPE_UINT64, parse->last_received,
+                "transit", G_TYPE_INT64, transit,
+                NULL)));
+  }
+}
+
+static GstFlowReturn
+gst_rtptimestampparse_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstRtpTimestampParse *parse = GST_RTPTIMESTAMPPARSE (trans);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstClockTime systime, remote_time;
+  gpointer data;
+  guint size;
+  guint64 frame_id;
+  gboolean marker;
+  guint16 seqnum;
+
+  systime = gst_timestamp_systime_now (&parse->time_source,
+      GST_ELEMENT (parse));
+
+  if (!gst_rtp_buffer_map (buf, GST_MAP_READ, &rtp))
+    return GST_FLOW_OK;
+  if (!gst_rtp_buffer_get_extension_onebyte_header (&rtp, parse->extension_id,
+          0, &data, &size) || size != GST_TIMESTAMP_RTP_HDREXT_SIZE) {
+    gst_rtp_buffer_unmap (&rtp);
+    GST_LOG_OBJECT (parse, "Packet isn't stamped");
+    return GST_FLOW_OK;
+  }
+  remote_time = GST_READ_UINT64_BE (data);
+  frame_id = GST_READ_UINT32_BE ((guint8 *) data + 8);
+  marker = gst_rtp_buffer_get_marker (&rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  GST_LOG_OBJECT (parse, "Seqnum: %u; Frame-id: %" G_GUINT64_FORMAT
+      "; Transit: %" G_GINT64_FORMAT, seqnum, frame_id,
+      GST_CLOCK_DIFF (remote_time, systime));
+  if (parse->post_packet_messages) {
+    gst_element_post_message (GST_ELEMENT (parse),
+        gst_message_new_element (GST_OBJECT (parse),
+            gst_structure_new ("rtptimestampparse-packet",
+                "seqnum", G_TYPE_UINT, (guint) seqnum,
+                "frame-id", G_TYPE_UINT64, frame_id,
+                "remote-time", G_TYPE_UINT64, remote_time,
+                "receive-time", G_TYPE_UINT64, systime,
+                "transit", G_TYPE_INT64, GST_CLOCK_DIFF (remote_time, systime),
+                NULL)));
+  }
+
+  /* A frame ends with its marker packet, or when the next frame starts if
+   * the marker packet got lost */
+  if (parse->have_frame && parse->frame_id != frame_id)
+    gst_rtptimestampparse_finish_frame (parse);
+  if (!parse->have_frame) {
+    parse->have_frame = TRUE;
+    parse->frame_id = frame_id;
+    parse->packets = 0;
+    parse->first_sent = remote_time;
+  }
+  parse->packets++;
+  parse->first_sent = MIN (parse->first_sent, remote_time);
+  parse->last_received = systime;
+  if (marker)
+    gst_rtptimestampparse_finish_frame (parse);
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,62 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_RTPTIMESTAMPPARSE_H_
+#define _GST_RTPTIMESTAMPPARSE_H_
+
+#include <gst/base/gstbasetransform.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RTPTIMESTAMPPARSE   (gst_rtptimestampparse_get_type())
+#define GST_RTPTIMESTAMPPARSE(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RTPTIMESTAMPPARSE,GstRtpTimestampParse))
+#define GST_RTPTIMESTAMPPARSE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RTPTIMESTAMPPARSE,GstRtpTimestampParseClass))
+#define GST_IS_RTPTIMESTAMPPARSE(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RTPTIMESTAMPPARSE))
+#define GST_IS_RTPTIMESTAMPPARSE_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RTPTIMESTAMPPARSE))
+
+typedef struct _GstRtpTimestampParse GstRtpTimestampParse;
+typedef struct _GstRtpTimestampParseClass GstRtpTimestampParseClass;
+
+struct _GstRtpTimestampParse
+{
+  GstBaseTransform base_rtptimestampparse;
+  guint extension_id;
+  gboolean post_messages;
+  gboolean post_packet_messages;
+
+  /* the frame whose packets are arriving */
+  gboolean have_frame;
+  guint64 frame_id;
+  guint packets;
+  GstClockTime first_sent;
+  GstClockTime last_received;
+
+  GstTimestampSystime time_source;
+};
+
+struct _GstRtpTimestampParseClass
+{
+  GstBaseTransformClass base_rtptimestampparse_class;
+};
+
+GType gst_rtptimestampparse_get_type (void);
+
+G_END_DECLS
+
+#endif
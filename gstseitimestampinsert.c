@@ -0,0 +1,273 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstseitimestampinsert
+ *
+ * The seitimestampinsert element inserts the same payload as
+ * timestampoverlay into every access unit of an H.264 or H.265 byte-stream,
+ * as a SEI user_data_unregistered message in front of the first slice.
+ * seitimestampparse reads it back without decoding the pictures.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 videotestsrc ! timestampoverlay ! x264enc tune=zerolatency ! h264parse ! video/x-h264,stream-format=byte-stream,alignment=au ! seitimestampinsert ! rtph264pay ! udpsink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include "gstseitimestampinsert.h"
+
+#include <inttypes.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_seitimestampinsert_debug_category);
+#define GST_CAT_DEFAULT gst_seitimestampinsert_debug_category
+
+/* prototypes */
+static void gst_seitimestampinsert_dispose (GObject *object);
+static gboolean gst_seitimestampinsert_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static gboolean gst_seitimestampinsert_start (GstBaseTransform * trans);
+static gboolean gst_seitimestampinsert_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_seitimestampinsert_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_FEC_SCHEME,
+  PROP_TIME_SOURCE
+};
+
+/* The first word and the exact send time.  The SEI isn't limited by rows of
+ * boxes, so the send time goes in full. */
+#define SEI_WORDS 2
+
+static void
+gst_seitimestampinsert_set_fec_scheme (GstSeiTimestampInsert *insert,
+                                       fec_scheme fs)
+{
+  LatencyClockCodec *codec = latency_clock_codec_new (fs, SEI_WORDS);
+
+  insert->fec_scheme = fs;
+  GST_INFO_OBJECT (insert, "set_property: fec_scheme n:%u k:%u rows:%u",
+                   codec->fec_n, codec->fec_k, codec->rows);
+  gst_timestamp_codec_publish (&insert->pending_codec, codec);
+}
+
+static void
+gst_seitimestampinsert_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    gst_seitimestampinsert_set_fec_scheme (insert, g_value_get_enum (value));
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&insert->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_seitimestampinsert_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    g_value_set_enum (value, insert->fec_scheme);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&insert->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define SEI_CAPS \
+    "video/x-h264, stream-format=(string)byte-stream, alignment=(string)au; " \
+    "video/x-h265, stream-format=(string)byte-stream, alignment=(string)au"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstSeiTimestampInsert, gst_seitimestampinsert,
+  GST_TYPE_BASE_TRANSFORM,
+  GST_DEBUG_CATEGORY_INIT (gst_seitimestampinsert_debug_category,
+  "seitimestampinsert", 0,
+  "debug category for seitimestampinsert element"));
+
+static void
+gst_seitimestampinsert_class_init (GstSeiTimestampInsertClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (SEI_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (SEI_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "SeiTimestampInsert", "Codec/Video",
+      "Inserts timestamps into an H.264/H.265 stream as SEI messages",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_seitimestampinsert_set_property;
+  gobject_class->get_property = gst_seitimestampinsert_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FEC_SCHEME,
+    g_param_spec_enum ("fec-scheme", "Foward Error Correction Scheme",
+                       "FEC Scheme to use",
+                       GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the send time is read from");
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_seitimestampinsert_dispose);
+  base_transform_class->set_caps =
+      GST_DEBUG_FUNCPTR (gst_seitimestampinsert_set_caps);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_seitimestampinsert_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_seitimestampinsert_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_seitimestampinsert_transform_ip);
+}
+
+static void
+gst_seitimestampinsert_init (GstSeiTimestampInsert *insert)
+{
+  insert->frame_id = 0;
+  insert->h265 = FALSE;
+
+  insert->codec = NULL;
+  insert->pending_codec = NULL;
+  gst_seitimestampinsert_set_fec_scheme (insert, LIQUID_FEC_NONE);
+  gst_timestamp_systime_init (&insert->time_source);
+}
+
+static void
+gst_seitimestampinsert_dispose (GObject *object)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (object);
+
+  latency_clock_codec_free (insert->codec);
+  insert->codec = NULL;
+  gst_timestamp_codec_publish (&insert->pending_codec, NULL);
+  gst_timestamp_systime_clear (&insert->time_source);
+
+  G_OBJECT_CLASS (gst_seitimestampinsert_parent_class)->dispose (object);
+}
+
+static gboolean
+gst_seitimestampinsert_start (GstBaseTransform * trans)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (trans);
+
+  return gst_timestamp_systime_start (&insert->time_source,
+      GST_ELEMENT (insert));
+}
+
+static gboolean
+gst_seitimestampinsert_stop (GstBaseTransform * trans)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (trans);
+
+  gst_timestamp_systime_stop (&insert->time_source);
+  return TRUE;
+}
+
+static gboolean
+gst_seitimestampinsert_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (trans);
+
+  insert->h265 = gst_structure_has_name (gst_caps_get_structure (incaps, 0),
+      "video/x-h265");
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_seitimestampinsert_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstSeiTimestampInsert *insert = GST_SEITIMESTAMPINSERT (trans);
+  LatencyClockCodec *codec;
+  uint64_t systime0, words[SEI_WORDS];
+  GstMapInfo map;
+  GstMemory *sei;
+  GstBuffer *tail;
+  gsize offset, size;
+  guint i;
+
+  systime0 = gst_timestamp_systime_now (&insert->time_source,
+      GST_ELEMENT (insert));
+
+  insert->frame_id++;
+  words[0] = (systime0 & LATENCY_CLOCK_SYSTIME_MASK) |
+      (insert->frame_id & LATENCY_CLOCK_FRAME_ID_MASK);
+  words[1] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_SEND_TIME, systime0);
+  GST_INFO_OBJECT (insert, "systime: %" PRIx64 ", frame_id: %" PRIx64,
+                   systime0, insert->frame_id);
+
+  codec = gst_timestamp_codec_acquire (&insert->pending_codec, &insert->codec);
+  sei = gst_timestamp_sei_new (codec, words, insert->h265);
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
+    gst_memory_unref (sei);
+    return GST_FLOW_ERROR;
+  }
+  offset = gst_timestamp_sei_insert_offset (map.data, map.size, insert->h265);
+  size = map.size;
+  gst_buffer_unmap (buf, &map);
+
+  /* Splice the SEI in without copying the slices */
+  if (offset == 0) {
+    gst_buffer_prepend_memory (buf, sei);
+  } else if (offset == size) {
+    GST_DEBUG_OBJECT (insert, "No slice in access unit, appending SEI");
+    gst_buffer_append_memory (buf, sei);
+  } else {
+    tail = gst_buffer_copy_region (buf, GST_BUFFER_COPY_MEMORY, offset, -1);
+    gst_buffer_resize (buf, 0, offset);
+    gst_buffer_append_memory (buf, sei);
+    for (i = 0; i < gst_buffer_n_memory (tail); i++)
+      gst_buffer_append_memory (buf, gst_buffer_get_memory (tail, i));
+    gst_buffer_unref (tail);
+  }
+
+  return GST_FLOW_OK;
+}
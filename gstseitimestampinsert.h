@@ -0,0 +1,57 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_SEITIMESTAMPINSERT_H_
+#define _GST_SEITIMESTAMPINSERT_H_
+
+#include <gst/base/gstbasetransform.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SEITIMESTAMPINSERT   (gst_seitimestampinsert_get_type())
+#define GST_SEITIMESTAMPINSERT(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SEITIMESTAMPINSERT,GstSeiTimestampInsert))
+#define GST_SEITIMESTAMPINSERT_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_SEITIMESTAMPINSERT,GstSeiTimestampInsertClass))
+#define GST_IS_SEITIMESTAMPINSERT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_SEITIMESTAMPINSERT))
+#define GST_IS_SEITIMESTAMPINSERT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SEITIMESTAMPINSERT))
+
+typedef struct _GstSeiTimestampInsert GstSeiTimestampInsert;
+typedef struct _GstSeiTimestampInsertClass GstSeiTimestampInsertClass;
+
+struct _GstSeiTimestampInsert
+{
+  GstBaseTransform base_seitimestampinsert;
+  uint64_t frame_id;
+  gboolean h265;
+
+  fec_scheme fec_scheme;
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+  GstTimestampSystime time_source;
+};
+
+struct _GstSeiTimestampInsertClass
+{
+  GstBaseTransformClass base_seitimestampinsert_class;
+};
+
+GType gst_seitimestampinsert_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,287 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gstseitimestampparse
+ *
+ * The seitimestampparse element reads the timestamps inserted by
+ * seitimestampinsert from an H.264 or H.265 byte-stream without decoding
+ * it.  It logs the latency up to this point of the pipeline, and attaches
+ * the sent and received times to the buffer as reference timestamp metas
+ * so timeoverlayparse can split the total latency after decoding.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 udpsrc ! application/x-rtp,encoding-name=H264 ! rtph264depay ! h264parse ! video/x-h264,stream-format=byte-stream,alignment=au ! seitimestampparse ! avdec_h264 ! videoconvert ! timeoverlayparse ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+#include "gstseitimestampparse.h"
+
+#include <inttypes.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_seitimestampparse_debug_category);
+#define GST_CAT_DEFAULT gst_seitimestampparse_debug_category
+
+/* prototypes */
+static void gst_seitimestampparse_finalize (GObject *object);
+static gboolean gst_seitimestampparse_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static gboolean gst_seitimestampparse_start (GstBaseTransform * trans);
+static gboolean gst_seitimestampparse_stop (GstBaseTransform * trans);
+static GstFlowReturn gst_seitimestampparse_transform_ip (GstBaseTransform *
+    trans, GstBuffer * buf);
+
+enum
+{
+  PROP_0,
+  PROP_POST_MESSAGES,
+  PROP_TIME_SOURCE
+};
+
+static void
+gst_seitimestampparse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (object);
+
+  switch (prop_id) {
+  case PROP_POST_MESSAGES:
+    parse->post_messages = g_value_get_boolean (value);
+    break;
+  default:
+    if (!gst_timestamp_systime_set_property (&parse->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_seitimestampparse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (object);
+
+  switch (prop_id) {
+  case PROP_POST_MESSAGES:
+    g_value_set_boolean (value, parse->post_messages);
+    break;
+  default:
+    if (!gst_timestamp_systime_get_property (&parse->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+#define SEI_CAPS \
+    "video/x-h264, stream-format=(string)byte-stream, alignment=(string)au; " \
+    "video/x-h265, stream-format=(string)byte-stream, alignment=(string)au"
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstSeiTimestampParse, gst_seitimestampparse,
+  GST_TYPE_BASE_TRANSFORM,
+  GST_DEBUG_CATEGORY_INIT (gst_seitimestampparse_debug_category,
+  "seitimestampparse", 0,
+  "debug category for seitimestampparse element"));
+
+static void
+gst_seitimestampparse_class_init (GstSeiTimestampParseClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (SEI_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (SEI_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "SeiTimestampParse", "Codec/Video",
+      "Reads the timestamps inserted by seitimestampinsert",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_seitimestampparse_set_property;
+  gobject_class->get_property = gst_seitimestampparse_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+    g_param_spec_boolean ("post-messages", "Post messages",
+                          "Post an element message for every parsed "
+                          "access unit",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the receive time is read from.  "
+      "Must be the source the seitimestampinsert uses");
+
+  gobject_class->finalize = gst_seitimestampparse_finalize;
+  base_transform_class->set_caps =
+      GST_DEBUG_FUNCPTR (gst_seitimestampparse_set_caps);
+  base_transform_class->start =
+      GST_DEBUG_FUNCPTR (gst_seitimestampparse_start);
+  base_transform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_seitimestampparse_stop);
+  base_transform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_seitimestampparse_transform_ip);
+}
+
+static void
+gst_seitimestampparse_init (GstSeiTimestampParse *parse)
+{
+  parse->h265 = FALSE;
+  parse->post_messages = FALSE;
+  parse->codec = NULL;
+  parse->sent_caps = gst_caps_new_empty_simple (GST_SEI_TIMESTAMP_SENT_CAPS);
+  parse->received_caps =
+      gst_caps_new_empty_simple (GST_SEI_TIMESTAMP_RECEIVED_CAPS);
+  gst_timestamp_systime_init (&parse->time_source);
+}
+
+static void
+gst_seitimestampparse_finalize (GObject *object)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (object);
+
+  gst_caps_unref (parse->sent_caps);
+  gst_caps_unref (parse->received_caps);
+  latency_clock_codec_free (parse->codec);
+  gst_timestamp_systime_clear (&parse->time_source);
+
+  G_OBJECT_CLASS (gst_seitimestampparse_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_seitimestampparse_start (GstBaseTransform * trans)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (trans);
+
+  return gst_timestamp_systime_start (&parse->time_source,
+      GST_ELEMENT (parse));
+}
+
+static gboolean
+gst_seitimestampparse_stop (GstBaseTransform * trans)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (trans);
+
+  gst_timestamp_systime_stop (&parse->time_source);
+  return TRUE;
+}
+
+static gboolean
+gst_seitimestampparse_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (trans);
+
+  parse->h265 = gst_structure_has_name (gst_caps_get_structure (incaps, 0),
+      "video/x-h265");
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_seitimestampparse_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstSeiTimestampParse *parse = GST_SEITIMESTAMPPARSE (trans);
+  guint8 payload[GST_TIMESTAMP_SEI_MAX_PAYLOAD];
+  guint64 rows[LATENCY_CLOCK_MAX_ROWS];
+  guint64 words[LATENCY_CLOCK_MAX_WORDS];
+  GstClockTime systime, remote_time;
+  GstClockTimeDiff latency;
+  GstMapInfo map;
+  fec_scheme fs;
+  guint n_words, version, r;
+  gsize size;
+  uint64_t frame_id;
+
+  /* The SEI is read before anything else is done with the access unit */
+  systime = gst_timestamp_systime_now (&parse->time_source,
+      GST_ELEMENT (parse));
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+  size = gst_timestamp_sei_find (map.data, map.size, parse->h265, payload);
+  gst_buffer_unmap (buf, &map);
+  if (size < 8) {
+    GST_DEBUG_OBJECT (parse, "No timestamp SEI in access unit");
+    return GST_FLOW_OK;
+  }
+
+  if (!latency_clock_header_unpack (GST_READ_UINT64_BE (payload), &fs,
+          &n_words, &version, NULL)) {
+    GST_DEBUG_OBJECT (parse, "Timestamp SEI with invalid header");
+    return GST_FLOW_OK;
+  }
+  if (!parse->codec || parse->codec->fec_scheme != fs ||
+      parse->codec->words != n_words || parse->codec->version != version) {
+    GST_INFO_OBJECT (parse, "Following header: fec_scheme %d, %u words",
+        fs, n_words);
+    latency_clock_codec_free (parse->codec);
+    parse->codec = latency_clock_codec_new_version (fs, n_words, version);
+  }
+  if (size < (1 + parse->codec->rows) * 8) {
+    GST_WARNING_OBJECT (parse, "Timestamp SEI is truncated");
+    return GST_FLOW_OK;
+  }
+
+  for (r = 0; r < parse->codec->rows; r++)
+    rows[r] = GST_READ_UINT64_BE (payload + 8 + r * 8);
+  latency_clock_decode (parse->codec, (const guint8 *) rows, words);
+
+  frame_id = words[0] & LATENCY_CLOCK_FRAME_ID_MASK;
+  remote_time = latency_clock_send_time (words, n_words, NULL);
+  latency = systime - remote_time;
+
+  GST_INFO_OBJECT (parse, "Systime: %ld; Latency: %ld; Frame-id: %lu",
+      GST_TIME_AS_NSECONDS(systime),
+      GST_TIME_AS_NSECONDS(latency),
+      frame_id);
+
+  gst_buffer_add_reference_timestamp_meta (buf, parse->sent_caps,
+      remote_time, GST_CLOCK_TIME_NONE);
+  gst_buffer_add_reference_timestamp_meta (buf, parse->received_caps,
+      systime, GST_CLOCK_TIME_NONE);
+
+  if (parse->post_messages) {
+    gst_element_post_message (GST_ELEMENT (parse),
+        gst_message_new_element (GST_OBJECT (parse),
+            gst_structure_new ("seitimestampparse",
+                "pts", G_TYPE_UINT64, GST_BUFFER_PTS (buf),
+                "frame-id", G_TYPE_UINT64, frame_id,
+                "remote-time", G_TYPE_UINT64, remote_time,
+                "receive-time", G_TYPE_UINT64, systime,
+                "latency", G_TYPE_INT64, latency,
+                NULL)));
+  }
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,63 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_SEITIMESTAMPPARSE_H_
+#define _GST_SEITIMESTAMPPARSE_H_
+
+#include <gst/base/gstbasetransform.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_SEITIMESTAMPPARSE   (gst_seitimestampparse_get_type())
+#define GST_SEITIMESTAMPPARSE(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SEITIMESTAMPPARSE,GstSeiTimestampParse))
+#define GST_SEITIMESTAMPPARSE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_SEITIMESTAMPPARSE,GstSeiTimestampParseClass))
+#define GST_IS_SEITIMESTAMPPARSE(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_SEITIMESTAMPPARSE))
+#define GST_IS_SEITIMESTAMPPARSE_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SEITIMESTAMPPARSE))
+
+/* seitimestampparse attaches the sender's time and the time the access unit
+ * was parsed as reference timestamp metas with these caps.  They survive
+ * decoding, so timeoverlayparse can compare them with the pixel timestamp. */
+#define GST_SEI_TIMESTAMP_SENT_CAPS "timestamp/x-latency-clock-sei-sent"
+#define GST_SEI_TIMESTAMP_RECEIVED_CAPS "timestamp/x-latency-clock-sei-received"
+
+typedef struct _GstSeiTimestampParse GstSeiTimestampParse;
+typedef struct _GstSeiTimestampParseClass GstSeiTimestampParseClass;
+
+struct _GstSeiTimestampParse
+{
+  GstBaseTransform base_seitimestampparse;
+  gboolean h265;
+  gboolean post_messages;
+
+  LatencyClockCodec *codec;
+  GstCaps *sent_caps;
+  GstCaps *received_caps;
+  GstTimestampSystime time_source;
+};
+
+struct _GstSeiTimestampParseClass
+{
+  GstBaseTransformClass base_seitimestampparse_class;
+};
+
+GType gst_seitimestampparse_get_type (void);
+
+G_END_DECLS
+
+#endif
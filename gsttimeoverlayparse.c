@@ -44,53 +44,88 @@
 #include <inttypes.h>
 
 #include "gsttimestampcommon.h"
+#include "gstseitimestampparse.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_timeoverlayparse_debug_category);
 #define GST_CAT_DEFAULT gst_timeoverlayparse_debug_category
 
 /* prototypes */
+static void gst_timeoverlayparse_finalize (GObject *object);
+static gboolean gst_timeoverlayparse_start (GstBaseTransform * trans);
+static gboolean gst_timeoverlayparse_stop (GstBaseTransform * trans);
+static gboolean gst_timeoverlayparse_propose_allocation (GstBaseTransform *
+    trans, GstQuery * decide_query, GstQuery * query);
 static GstFlowReturn gst_timeoverlayparse_transform_frame_ip (GstVideoFilter * filter,
     GstVideoFrame * frame);
 
 enum
 {
   PROP_0,
-  PROP_FEC_SCHEME
+  PROP_FEC_SCHEME,
+  PROP_HEADER,
+  PROP_POST_MESSAGES,
+  PROP_RECEIVE_TIME,
+  PROP_PTS_OFFSET,
+  PROP_TIME_SOURCE,
+  PROP_NET_CLOCK_ADDRESS,
+  PROP_NET_CLOCK_PORT,
+  PROP_PTP_DOMAIN,
+  PROP_DRIFT_WINDOW,
+  PROP_DRIFT_CORRECTION,
+  PROP_FEEDBACK_ADDRESS,
+  PROP_FEEDBACK_PORT,
+  PROP_FEEDBACK_INTERVAL,
+  PROP_STEREO_LAYOUT,
+  PROP_ROI,
+  PROP_COST,
+  PROP_COST_PERF,
+  PROP_COST_INTERVAL,
+  PROP_COST_STATS
 };
 
+/* Rows of the region of interest beyond the ones in use */
+#define ROI_SPARE_ROWS 4
+
+/* Latencies further off than this are taken as a payload that didn't
+ * decode */
+#define PLAUSIBLE_LATENCY (10 * GST_SECOND)
+
+#define DEFAULT_DRIFT_WINDOW (10 * GST_SECOND)
+
+GType
+gst_timeoverlayparse_receive_time_get_type (void)
+{
+  static GType receive_time_type = 0;
+
+  if (!receive_time_type) {
+    static GEnumValue receive_time_types[] = {
+      { GST_TIMEOVERLAYPARSE_RECEIVE_TIME_NOW,
+        "CLOCK_REALTIME when the frame is parsed", "now" },
+      { GST_TIMEOVERLAYPARSE_RECEIVE_TIME_PTS,
+        "Stream time of the buffer PTS plus pts-offset", "pts" },
+      { GST_TIMEOVERLAYPARSE_RECEIVE_TIME_REFERENCE_TIMESTAMP,
+        "timestamp/x-unix reference timestamp meta of the buffer",
+        "reference-timestamp" },
+      { 0, NULL, NULL },
+    };
+
+    receive_time_type = g_enum_register_static ("receive_time",
+        receive_time_types);
+  }
+
+  return receive_time_type;
+}
+
 static void
 gst_timeoverlayparse_set_fec_scheme (GstTimeOverlayParse *overlay,
                                      fec_scheme fs)
 {
-  overlay->fec_scheme = fs;
+  LatencyClockCodec *codec = latency_clock_codec_new (fs, 1);
 
-  if (overlay->decoder) {
-      fec_destroy(overlay->decoder);
-      overlay->decoder = NULL;
-  }
-  free(overlay->msg_dec);
-  free(overlay->msg_enc);
-  overlay->msg_dec = NULL;
-  overlay->msg_enc = NULL;
-
-  overlay->decoder =  fec_create(fs, NULL);
-
-  // decoded message length (bytes)
-  unsigned int n = 8;
-  // compute encoded message length
-  unsigned int k = fec_get_enc_msg_length(fs, n);
-
-  overlay->fec_n = n;
-  overlay->fec_k = k;
-  overlay->msg_dec = malloc(sizeof(char)* n);
-  overlay->msg_enc = malloc(sizeof(char) * (8 + k));
-  memset(overlay->msg_enc, 0, sizeof(char) * (8 + k));
-  overlay->rows = k / 8;
-  if (overlay->rows * 8 != n) {
-    overlay->rows ++;
-  }
+  overlay->fec_scheme = fs;
   GST_INFO_OBJECT (overlay, "set_property: fec_scheme n:%u k:%u rows:%u",
-                   n, k, overlay->rows);
+                   codec->fec_n, codec->fec_k, codec->rows);
+  gst_timestamp_codec_publish (&overlay->pending_codec, codec);
 }
 
 static void
@@ -104,7 +139,52 @@ gst_timeoverlayparse_set_property (GObject * object, guint prop_id,
   case PROP_FEC_SCHEME:
     gst_timeoverlayparse_set_fec_scheme (overlay, g_value_get_enum (value));
     break;
+  case PROP_HEADER:
+    overlay->header = g_value_get_boolean (value);
+    break;
+  case PROP_POST_MESSAGES:
+    overlay->post_messages = g_value_get_boolean (value);
+    break;
+  case PROP_RECEIVE_TIME:
+    overlay->receive_time = g_value_get_enum (value);
+    break;
+  case PROP_PTS_OFFSET:
+    overlay->pts_offset = g_value_get_int64 (value);
+    break;
+  case PROP_DRIFT_WINDOW:
+    overlay->drift_window = g_value_get_uint64 (value);
+    break;
+  case PROP_DRIFT_CORRECTION:
+    overlay->drift_correction = g_value_get_boolean (value);
+    break;
+  case PROP_FEEDBACK_ADDRESS:
+    g_free (overlay->feedback_address);
+    overlay->feedback_address = g_value_dup_string (value);
+    break;
+  case PROP_FEEDBACK_PORT:
+    overlay->feedback_port = g_value_get_int (value);
+    break;
+  case PROP_FEEDBACK_INTERVAL:
+    overlay->feedback_interval = g_value_get_uint64 (value);
+    break;
+  case PROP_STEREO_LAYOUT:
+    overlay->stereo_layout = g_value_get_enum (value);
+    break;
+  case PROP_ROI:
+    overlay->roi = g_value_get_boolean (value);
+    break;
+  case PROP_COST:
+    overlay->cost.enabled = g_value_get_boolean (value);
+    break;
+  case PROP_COST_PERF:
+    overlay->cost.perf = g_value_get_boolean (value);
+    break;
+  case PROP_COST_INTERVAL:
+    overlay->cost.interval = g_value_get_uint64 (value);
+    break;
   default:
+    gst_timestamp_systime_set_property (&overlay->time_source,
+        PROP_TIME_SOURCE, prop_id, value);
     break;
   }
 }
@@ -119,8 +199,58 @@ gst_timeoverlayparse_get_property (GObject * object, guint prop_id,
   case PROP_FEC_SCHEME:
     g_value_set_enum (value, overlay->fec_scheme);
     break;
+  case PROP_HEADER:
+    g_value_set_boolean (value, overlay->header);
+    break;
+  case PROP_POST_MESSAGES:
+    g_value_set_boolean (value, overlay->post_messages);
+    break;
+  case PROP_RECEIVE_TIME:
+    g_value_set_enum (value, overlay->receive_time);
+    break;
+  case PROP_PTS_OFFSET:
+    g_value_set_int64 (value, overlay->pts_offset);
+    break;
+  case PROP_DRIFT_WINDOW:
+    g_value_set_uint64 (value, overlay->drift_window);
+    break;
+  case PROP_DRIFT_CORRECTION:
+    g_value_set_boolean (value, overlay->drift_correction);
+    break;
+  case PROP_FEEDBACK_ADDRESS:
+    g_value_set_string (value, overlay->feedback_address);
+    break;
+  case PROP_FEEDBACK_PORT:
+    g_value_set_int (value, overlay->feedback_port);
+    break;
+  case PROP_FEEDBACK_INTERVAL:
+    g_value_set_uint64 (value, overlay->feedback_interval);
+    break;
+  case PROP_STEREO_LAYOUT:
+    g_value_set_enum (value, overlay->stereo_layout);
+    break;
+  case PROP_ROI:
+    g_value_set_boolean (value, overlay->roi);
+    break;
+  case PROP_COST:
+    g_value_set_boolean (value, overlay->cost.enabled);
+    break;
+  case PROP_COST_PERF:
+    g_value_set_boolean (value, overlay->cost.perf);
+    break;
+  case PROP_COST_INTERVAL:
+    g_value_set_uint64 (value, overlay->cost.interval);
+    break;
+  case PROP_COST_STATS:
+    GST_OBJECT_LOCK (overlay);
+    g_value_take_boxed (value, gst_timestamp_cost_stats (&overlay->cost,
+            "timeoverlayparse-cost"));
+    GST_OBJECT_UNLOCK (overlay);
+    break;
   default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    if (!gst_timestamp_systime_get_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
   }
 }
@@ -129,11 +259,11 @@ gst_timeoverlayparse_get_property (GObject * object, guint prop_id,
 
 /* FIXME: add/remove formats you can handle */
 #define VIDEO_SRC_CAPS \
-    GST_VIDEO_CAPS_MAKE("{RGB, xRGB, BGR, BGRx}")
+    GST_VIDEO_CAPS_MAKE("{RGB, xRGB, BGR, BGRx, GRAY8}")
 
 /* FIXME: add/remove formats you can handle */
 #define VIDEO_SINK_CAPS \
-    GST_VIDEO_CAPS_MAKE("{RGB, xRGB, BGR, BGRx}")
+    GST_VIDEO_CAPS_MAKE("{RGB, xRGB, BGR, BGRx, GRAY8}")
 
 
 /* class initialization */
@@ -146,6 +276,7 @@ static void
 gst_timeoverlayparse_class_init (GstTimeOverlayParseClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class = GST_BASE_TRANSFORM_CLASS (klass);
   GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
 
   /* Setting up pads and setting metadata should be moved to
@@ -169,50 +300,660 @@ gst_timeoverlayparse_class_init (GstTimeOverlayParseClass * klass)
   /* define properties */
   g_object_class_install_property (gobject_class, PROP_FEC_SCHEME,
     g_param_spec_enum ("fec-scheme", "Foward Error Correction Scheme",
-                       "FEC Scheme to use",
+                       "FEC Scheme to use when the stream has no header",
                        GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HEADER,
+    g_param_spec_boolean ("header", "Header",
+                          "Look for the header row written by "
+                          "timestampoverlay and follow its fec-scheme",
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+    g_param_spec_boolean ("post-messages", "Post messages",
+                          "Post an element message for every parsed frame",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RECEIVE_TIME,
+    g_param_spec_enum ("receive-time", "Receive time",
+                       "Source of the local time the latency is measured "
+                       "against.  Use pts or reference-timestamp to analyse "
+                       "recordings offline",
+                       GST_TYPE_TIMEOVERLAYPARSE_RECEIVE_TIME,
+                       GST_TIMEOVERLAYPARSE_RECEIVE_TIME_NOW,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PTS_OFFSET,
+    g_param_spec_int64 ("pts-offset", "PTS offset",
+                        "Nanoseconds added to the stream time of the PTS to "
+                        "get CLOCK_REALTIME when receive-time=pts",
+                        G_MININT64, G_MAXINT64, 0,
+                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the receive time is read from when "
+      "receive-time=now.  Must be the source the timestampoverlay uses");
+
+  g_object_class_install_property (gobject_class, PROP_DRIFT_WINDOW,
+    g_param_spec_uint64 ("drift-window", "Drift window",
+                         "Nanoseconds of remote time whose lowest latency "
+                         "is one point of the clock drift estimate, or 0 "
+                         "not to estimate the drift",
+                         0, G_MAXUINT64, DEFAULT_DRIFT_WINDOW,
+                         G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DRIFT_CORRECTION,
+    g_param_spec_boolean ("drift-correction", "Drift correction",
+                          "Also report the latency with the estimated clock "
+                          "drift since the first frame taken out",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FEEDBACK_ADDRESS,
+    g_param_spec_string ("feedback-address", "Feedback address",
+                         "IP address to send the decoding reports for the "
+                         "adaptive FEC of timestampoverlay to, or NULL not "
+                         "to send them",
+                         NULL,
+                         G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FEEDBACK_PORT,
+    g_param_spec_int ("feedback-port", "Feedback port",
+                      "UDP port to send the decoding reports to",
+                      1, 65535, GST_TIMESTAMP_FEC_FEEDBACK_DEFAULT_PORT,
+                      G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                      G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FEEDBACK_INTERVAL,
+    g_param_spec_uint64 ("feedback-interval", "Feedback interval",
+                         "Nanoseconds between decoding reports",
+                         1, G_MAXUINT64, GST_SECOND,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STEREO_LAYOUT,
+    g_param_spec_enum ("stereo-layout", "Stereo layout",
+                       "How the eye views are packed into the frame.  With "
+                       "a stereo layout the left eye is measured and the "
+                       "right eye compared with it",
+                       GST_TYPE_TIMESTAMP_STEREO_LAYOUT,
+                       LATENCY_CLOCK_LAYOUT_MONO,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ROI,
+    g_param_spec_boolean ("roi", "Region of interest",
+                          "Accept crop metas from upstream and post a "
+                          "timeoverlayparse-roi message with the region "
+                          "the frames can be cropped to whenever it "
+                          "changes",
+                          FALSE,
+                          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST,
+    g_param_spec_boolean ("cost", "Cost",
+                          "Measure how long parsing every frame takes, add "
+                          "it to the frame's message and post "
+                          "timeoverlayparse-cost messages",
+                          FALSE,
+                          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_PERF,
+    g_param_spec_boolean ("cost-perf", "Cost perf counters",
+                          "Also count the CPU cycles and cache misses of "
+                          "parsing with perf_event_open ()",
+                          FALSE,
+                          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_INTERVAL,
+    g_param_spec_uint64 ("cost-interval", "Cost interval",
+                         "Nanoseconds between timeoverlayparse-cost "
+                         "messages, or 0 for none",
+                         0, G_MAXUINT64, GST_SECOND,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_STATS,
+    g_param_spec_boxed ("cost-stats", "Cost statistics",
+                        "Frames, mean and max time in ns, perf counters "
+                        "and log2 histogram of the time of parsing",
+                        GST_TYPE_STRUCTURE,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  gobject_class->finalize = gst_timeoverlayparse_finalize;
+  base_transform_class->start = GST_DEBUG_FUNCPTR (gst_timeoverlayparse_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_timeoverlayparse_stop);
+  base_transform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_timeoverlayparse_propose_allocation);
   video_filter_class->transform_frame_ip = GST_DEBUG_FUNCPTR (gst_timeoverlayparse_transform_frame_ip);
 }
 
 static void
 gst_timeoverlayparse_init (GstTimeOverlayParse *obj)
 {
-  obj->decoder = NULL;
-  obj->msg_enc = NULL;
-  obj->msg_dec = NULL;
+  obj->header = TRUE;
+  obj->have_last_frame_id = FALSE;
+  obj->last_frame_id = 0;
+  obj->last_header = 0;
+  obj->last_header_valid = FALSE;
+  obj->seen_header = FALSE;
+  obj->stereo_layout = LATENCY_CLOCK_LAYOUT_MONO;
+  obj->last_mode = 0;
+  obj->roi = FALSE;
+  obj->roi_height = 0;
+  gst_timestamp_cost_init (&obj->cost);
+  memset (obj->stage_codecs, 0, sizeof (obj->stage_codecs));
+  obj->codec = NULL;
+  obj->pending_codec = NULL;
   gst_timeoverlayparse_set_fec_scheme (obj, LIQUID_FEC_NONE);
+
+  obj->post_messages = FALSE;
+  obj->receive_time = GST_TIMEOVERLAYPARSE_RECEIVE_TIME_NOW;
+  obj->pts_offset = 0;
+  gst_timestamp_systime_init (&obj->time_source);
+  obj->drift_window = DEFAULT_DRIFT_WINDOW;
+  obj->drift_correction = FALSE;
+  gst_timestamp_drift_init (&obj->drift, obj->drift_window);
+
+  obj->feedback_address = NULL;
+  obj->feedback_port = GST_TIMESTAMP_FEC_FEEDBACK_DEFAULT_PORT;
+  obj->feedback_interval = GST_SECOND;
+  obj->feedback_socket = NULL;
+  obj->feedback_dest = NULL;
+  obj->reference_caps = gst_caps_new_empty_simple ("timestamp/x-unix");
+  obj->sei_sent_caps = gst_caps_new_empty_simple (GST_SEI_TIMESTAMP_SENT_CAPS);
+  obj->sei_received_caps =
+      gst_caps_new_empty_simple (GST_SEI_TIMESTAMP_RECEIVED_CAPS);
+}
+
+static void
+gst_timeoverlayparse_finalize (GObject *object)
+{
+  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (object);
+  guint i;
+
+  gst_caps_unref (overlay->reference_caps);
+  gst_caps_unref (overlay->sei_sent_caps);
+  gst_caps_unref (overlay->sei_received_caps);
+  latency_clock_codec_free (overlay->codec);
+  gst_timestamp_codec_publish (&overlay->pending_codec, NULL);
+  for (i = 0; i < LATENCY_CLOCK_MAX_STAGES; i++)
+    latency_clock_codec_free (overlay->stage_codecs[i]);
+  gst_timestamp_systime_clear (&overlay->time_source);
+  g_free (overlay->feedback_address);
+  g_clear_object (&overlay->feedback_socket);
+  g_clear_object (&overlay->feedback_dest);
+
+  G_OBJECT_CLASS (gst_timeoverlayparse_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_timeoverlayparse_start_feedback (GstTimeOverlayParse *overlay)
+{
+  GError *err = NULL;
+
+  overlay->feedback_dest = g_inet_socket_address_new_from_string (
+      overlay->feedback_address, overlay->feedback_port);
+  if (!overlay->feedback_dest) {
+    GST_ELEMENT_ERROR (overlay, LIBRARY, SETTINGS, (NULL),
+        ("Invalid feedback-address %s", overlay->feedback_address));
+    return FALSE;
+  }
+  overlay->feedback_socket = g_socket_new (
+      g_socket_address_get_family (overlay->feedback_dest),
+      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+  if (!overlay->feedback_socket) {
+    GST_ELEMENT_ERROR (overlay, RESOURCE, OPEN_WRITE, (NULL),
+        ("Failed to create the feedback socket: %s", err->message));
+    g_error_free (err);
+    g_clear_object (&overlay->feedback_dest);
+    return FALSE;
+  }
+  g_socket_set_blocking (overlay->feedback_socket, FALSE);
+
+  overlay->feedback_last = GST_CLOCK_TIME_NONE;
+  overlay->feedback_frames = overlay->feedback_errors = 0;
+  overlay->feedback_corrected = overlay->feedback_bits = 0;
+  return TRUE;
+}
+
+static gboolean
+gst_timeoverlayparse_start (GstBaseTransform * trans)
+{
+  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (trans);
+
+  gst_timestamp_drift_init (&overlay->drift, overlay->drift_window);
+  overlay->roi_height = 0;
+  overlay->seen_header = FALSE;
+  gst_timestamp_cost_reset (&overlay->cost);
+  if (overlay->feedback_address &&
+      !gst_timeoverlayparse_start_feedback (overlay))
+    return FALSE;
+  return gst_timestamp_systime_start (&overlay->time_source,
+      GST_ELEMENT (overlay));
+}
+
+static gboolean
+gst_timeoverlayparse_stop (GstBaseTransform * trans)
+{
+  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (trans);
+
+  gst_timestamp_systime_stop (&overlay->time_source);
+  g_clear_object (&overlay->feedback_socket);
+  g_clear_object (&overlay->feedback_dest);
+  gst_timestamp_cost_close (&overlay->cost);
+  return TRUE;
 }
 
+/* With the crop meta upstream can crop the frames to the region of interest
+ * without copying them */
+static gboolean
+gst_timeoverlayparse_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (trans);
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_timeoverlayparse_parent_class)->
+      propose_allocation (trans, decide_query, query))
+    return FALSE;
+  if (overlay->roi)
+    gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+        NULL);
+  return TRUE;
+}
+
+/* Counts the frame into the current report and sends the report once the
+ * feedback interval is over */
+static void
+gst_timeoverlayparse_feedback (GstTimeOverlayParse *overlay,
+    LatencyClockCodec *codec, const guint8 *enc, const guint64 *words,
+    gboolean error)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+  GEnumClass *klass;
+  GEnumValue *scheme;
+  GError *err = NULL;
+  gchar *report;
+
+  overlay->feedback_frames++;
+  if (error) {
+    overlay->feedback_errors++;
+  } else {
+    overlay->feedback_corrected += latency_clock_distance (codec, enc, words);
+    overlay->feedback_bits += 8 * (codec->fec_k ? codec->fec_k : codec->fec_n);
+  }
+  if (!GST_CLOCK_TIME_IS_VALID (overlay->feedback_last))
+    overlay->feedback_last = now;
+  if (now - overlay->feedback_last < overlay->feedback_interval)
+    return;
+
+  klass = g_type_class_ref (GST_TYPE_FEC_SCHEME);
+  scheme = g_enum_get_value (klass, codec->fec_scheme);
+  report = g_strdup_printf (GST_TIMESTAMP_FEC_FEEDBACK_PREFIX " scheme=%s "
+      "frames=%" G_GUINT64_FORMAT " errors=%" G_GUINT64_FORMAT
+      " corrected=%" G_GUINT64_FORMAT " bits=%" G_GUINT64_FORMAT,
+      scheme ? scheme->value_nick : "unknown", overlay->feedback_frames,
+      overlay->feedback_errors, overlay->feedback_corrected,
+      overlay->feedback_bits);
+  g_type_class_unref (klass);
+
+  GST_DEBUG_OBJECT (overlay, "Sending %s", report);
+  if (g_socket_send_to (overlay->feedback_socket, overlay->feedback_dest,
+          report, strlen (report), NULL, &err) < 0) {
+    GST_WARNING_OBJECT (overlay, "Failed to send report: %s", err->message);
+    g_error_free (err);
+  }
+  g_free (report);
+
+  overlay->feedback_last = now;
+  overlay->feedback_frames = overlay->feedback_errors = 0;
+  overlay->feedback_corrected = overlay->feedback_bits = 0;
+}
+
+/* Returns the time the frame was received according to the receive-time
+ * property, or GST_CLOCK_TIME_NONE if the buffer doesn't carry it. */
 static GstClockTime
-read_timestamp(int lineoffset, unsigned char* buf, size_t stride, int pxsize)
+gst_timeoverlayparse_get_receive_time (GstTimeOverlayParse *overlay,
+    GstBuffer *buffer, GstClockTime systime)
 {
-  int bit;
-  GstClockTime timestamp = 0;
+  GstSegment *segment = &GST_BASE_TRANSFORM (overlay)->segment;
+  GstReferenceTimestampMeta *meta;
+  GstClockTime stream_time;
 
-  buf += (lineoffset * 8 + 4) * stride;
+  switch (overlay->receive_time) {
+  case GST_TIMEOVERLAYPARSE_RECEIVE_TIME_PTS:
+    /* Stream time rather than running time so the result doesn't depend on
+     * where playback was started from */
+    stream_time = gst_segment_to_stream_time (segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer));
+    if (!GST_CLOCK_TIME_IS_VALID (stream_time))
+      return GST_CLOCK_TIME_NONE;
+    return stream_time + overlay->pts_offset;
+  case GST_TIMEOVERLAYPARSE_RECEIVE_TIME_REFERENCE_TIMESTAMP:
+    meta = gst_buffer_get_reference_timestamp_meta (buffer,
+        overlay->reference_caps);
+    return meta ? meta->timestamp : GST_CLOCK_TIME_NONE;
+  case GST_TIMEOVERLAYPARSE_RECEIVE_TIME_NOW:
+  default:
+    return systime;
+  }
+}
+
+/* Reads the header row of the view of eye and makes sure overlay->codec
+ * matches it, or with follow=FALSE only checks that it does.  The header
+ * only changes when the sender is reconfigured, so the last one is cached and
+ * only a changed header gets decoded.  Returns FALSE if there is no valid
+ * header for eye. */
+static gboolean
+gst_timeoverlayparse_follow_header (GstTimeOverlayParse *overlay,
+    const guint8 *data, gint width, gint height, gint stride, gint pxsize,
+    guint eye, gboolean follow)
+{
+  guint64 header;
 
-  for (bit = 0; bit < 64; bit++) {
-    char color = buf[bit * pxsize * 8 + 4];
-    timestamp |= (color & 0x80) ?  (guint64) 1 << (63 - bit) : 0;
+  if (!latency_clock_read_header (data, width, height, stride, pxsize,
+          &header))
+    return FALSE;
+
+  if (header != overlay->last_header) {
+    overlay->last_header = header;
+    overlay->last_header_valid = latency_clock_header_unpack (header,
+        &overlay->header_fec_scheme, &overlay->header_words,
+        &overlay->header_version, &overlay->header_eye);
+    if (!overlay->last_header_valid)
+      GST_DEBUG_OBJECT (overlay, "No valid header: %" PRIx64, header);
+  }
+  if (!overlay->last_header_valid)
+    return FALSE;
+  if (overlay->header_eye != eye) {
+    GST_DEBUG_OBJECT (overlay, "Header of eye %u where eye %u was expected",
+        overlay->header_eye, eye);
+    return FALSE;
   }
 
-  return timestamp;
+  if (overlay->codec->fec_scheme != overlay->header_fec_scheme ||
+      overlay->codec->words != overlay->header_words ||
+      overlay->codec->version != overlay->header_version) {
+    if (!follow)
+      return FALSE;
+    GST_INFO_OBJECT (overlay, "Following header: version %u, fec_scheme %d, "
+        "%u words", overlay->header_version, overlay->header_fec_scheme,
+        overlay->header_words);
+    latency_clock_codec_free (overlay->codec);
+    overlay->codec = latency_clock_codec_new_version (
+        overlay->header_fec_scheme, overlay->header_words,
+        overlay->header_version);
+  }
+  return TRUE;
 }
 
-static GstFlowReturn
-gst_timeoverlayparse_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
+/* Returns the top-left pixel of the view of eye and sets width and height to
+ * its size.  A frame with a crop meta is only the region the meta
+ * describes. */
+static guint8 *
+gst_timeoverlayparse_view (GstTimeOverlayParse *overlay, GstVideoFrame *frame,
+    guint eye, gint *width, gint *height)
 {
-  struct timespec systime_st;
-  clock_gettime(CLOCK_REALTIME, &systime_st);
-  GstClockTime systime = (GstClockTime)systime_st.tv_sec * 1000000000 + systime_st.tv_nsec;
+  gint stride = frame->info.stride[0];
+  gint pxsize = frame->info.finfo->pixel_stride[0];
+  guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  GstVideoCropMeta *crop = gst_buffer_get_video_crop_meta (frame->buffer);
 
-  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (filter);
-  unsigned char * imgdata;
+  *width = GST_VIDEO_FRAME_WIDTH (frame);
+  *height = GST_VIDEO_FRAME_HEIGHT (frame);
+  if (crop && crop->width > 0 && crop->height > 0) {
+    data += crop->y * stride + crop->x * pxsize;
+    *width = crop->width;
+    *height = crop->height;
+  }
+  return latency_clock_view (data, width, height, stride, pxsize,
+      overlay->stereo_layout, eye);
+}
 
-  GST_DEBUG_OBJECT (overlay, "transform_frame_ip");
+/* Reads the payload of the view of eye into words, and the rows as
+ * received into enc if it isn't NULL.  The view without a valid header is
+ * read with the last codec in use, except with follow=FALSE, and below the
+ * header row once the stream has shown one.  Returns FALSE if there is
+ * nothing to read. */
+static gboolean
+gst_timeoverlayparse_read_view (GstTimeOverlayParse *overlay,
+    GstVideoFrame *frame, guint eye, gboolean follow, guint8 *enc,
+    guint64 *words, gboolean *header)
+{
+  gint width, height;
+  gint stride = frame->info.stride[0];
+  gint pxsize = frame->info.finfo->pixel_stride[0];
+  guint8 *data = gst_timeoverlayparse_view (overlay, frame, eye, &width,
+      &height);
+
+  *header = overlay->header && gst_timeoverlayparse_follow_header (overlay,
+      data, width, height, stride, pxsize, eye, follow);
+  if (overlay->header && !*header && !follow)
+    return FALSE;
+  if (*header)
+    overlay->seen_header = TRUE;
+
+  /* A header that didn't decode still takes up its row: only a stream
+   * that never drew one has the payload at the top */
+  if (!latency_clock_read (overlay->codec,
+          overlay->header && overlay->seen_header, data, width, height,
+          stride, pxsize, enc, words)) {
+    GST_WARNING_OBJECT (overlay, "Can't read timestamps: the view is too "
+        "small for %u rows", overlay->codec->rows);
+    return FALSE;
+  }
+  return TRUE;
+}
 
+/* Reads the bands that later hops appended below the code block of the view
+ * of eye.  Returns their number and fills in their stage ids and systimes. */
+static guint
+gst_timeoverlayparse_read_stages (GstTimeOverlayParse *overlay,
+    GstVideoFrame *frame, guint eye, GstClockTime remote_time,
+    guint *stage_ids, GstClockTime *stage_times)
+{
+  gint width, height;
+  gint stride = frame->info.stride[0];
+  gint pxsize = frame->info.finfo->pixel_stride[0];
+  guint8 *data = gst_timeoverlayparse_view (overlay, frame, eye, &width,
+      &height);
+  guint8 *band = latency_clock_block (data, width, height, stride, pxsize, 0,
+      TRUE);
+  guint rows = overlay->codec->rows, n;
+
+  for (n = 0; band && n < LATENCY_CLOCK_MAX_STAGES; n++) {
+    LatencyClockCodec **codec = &overlay->stage_codecs[n];
+    guint8 *next;
+    fec_scheme fs;
+    guint words, version;
+    guint64 word;
+
+    next = latency_clock_next_band (data, height, stride, band, rows, 0);
+    if (!next || !latency_clock_header_unpack (latency_clock_read_row (0,
+                next, stride, pxsize), &fs, &words, &version, NULL) ||
+        words != 1)
+      break;
+    if (!*codec || (*codec)->fec_scheme != fs ||
+        (*codec)->version != version) {
+      latency_clock_codec_free (*codec);
+      *codec = latency_clock_codec_new_version (fs, words, version);
+    }
+    if (!latency_clock_next_band (data, height, stride, band, rows,
+            (*codec)->rows))
+      break;
+
+    latency_clock_read_band (*codec, next, stride, pxsize, &word);
+    if (LATENCY_CLOCK_EXT_TAG (word) != LATENCY_CLOCK_EXT_STAGE)
+      break;
+    stage_ids[n] = LATENCY_CLOCK_STAGE_ID (word);
+    stage_times[n] = latency_clock_stage_time (word, remote_time);
+    band = next;
+    rows = (*codec)->rows;
+  }
+  return n;
+}
+
+/* Posts the region of interest of the frame when it has changed: the code
+ * block and the bands read from it, and ROI_SPARE_ROWS more rows so that a
+ * new band or a heavier fec-scheme still shows up in the cropped frames.
+ * The region is in the coordinates of the view, which is the crop of the
+ * frame if it has one. */
+static void
+gst_timeoverlayparse_update_roi (GstTimeOverlayParse *overlay,
+    GstVideoFrame *frame, guint n_stages)
+{
+  guint rows = overlay->codec->rows + ROI_SPARE_ROWS, i;
+  gint x, y, width, height;
+
+  for (i = 0; i < n_stages; i++)
+    rows += 1 + overlay->stage_codecs[i]->rows;
+  gst_timeoverlayparse_view (overlay, frame, LATENCY_CLOCK_EYE_NONE, &width,
+      &height);
+  latency_clock_roi (width, height, rows, &x, &y, &width, &height);
+  if (x == overlay->roi_x && y == overlay->roi_y &&
+      width == overlay->roi_width && height == overlay->roi_height)
+    return;
+
+  overlay->roi_x = x;
+  overlay->roi_y = y;
+  overlay->roi_width = width;
+  overlay->roi_height = height;
+  GST_INFO_OBJECT (overlay, "Region of interest: %dx%d at %d,%d; %u rows",
+      width, height, x, y, rows);
+  gst_element_post_message (GST_ELEMENT (overlay),
+      gst_message_new_element (GST_OBJECT (overlay),
+          gst_structure_new ("timeoverlayparse-roi",
+              "x", G_TYPE_INT, x,
+              "y", G_TYPE_INT, y,
+              "width", G_TYPE_INT, width,
+              "height", G_TYPE_INT, height,
+              "rows", G_TYPE_UINT, rows,
+              NULL)));
+}
+
+/* Posts a timeoverlayparse-dropped message for dropped frames from
+ * frame_id on, sent at sent if it is known */
+static void
+gst_timeoverlayparse_post_dropped (GstTimeOverlayParse *overlay,
+    guint64 frame_id, guint64 dropped, GstClockTime sent,
+    GstClockTime systime)
+{
+  gst_element_post_message (GST_ELEMENT (overlay),
+      gst_message_new_element (GST_OBJECT (overlay),
+          gst_structure_new ("timeoverlayparse-dropped",
+              "frame-id", G_TYPE_UINT64, frame_id,
+              "dropped", G_TYPE_UINT64, dropped,
+              "remote-time", G_TYPE_UINT64, sent,
+              "receive-time", G_TYPE_UINT64, systime,
+              "age", G_TYPE_INT64, GST_CLOCK_TIME_IS_VALID (sent) ?
+                  (gint64) (systime - sent) : G_MININT64,
+              NULL)));
+}
+
+/* Reports the frames that were sent between the last parsed frame and this
+ * one but never made it here.  The frames the history extension of this
+ * frame covers are reported one by one with their send times, any older
+ * ones together, so a frame id garbled into a large gap costs one
+ * message. */
+static void
+gst_timeoverlayparse_account_dropped (GstTimeOverlayParse *overlay,
+    const guint64 *words, guint n_words, guint64 frame_id,
+    GstClockTime remote_time, GstClockTime systime)
+{
+  guint64 history[LATENCY_CLOCK_MAX_WORDS];
+  guint n_history = 0, w;
+  guint64 gap, j, window;
+
+  gap = (frame_id - overlay->last_frame_id) & LATENCY_CLOCK_FRAME_ID_MASK;
+  if (!overlay->have_last_frame_id || gap < 2 ||
+      gap > LATENCY_CLOCK_FRAME_ID_MASK / 2) {
+    /* First frame, repeated frame, or the sender restarted */
+    return;
+  }
+
+  for (w = 1; w < n_words; w++) {
+    if (LATENCY_CLOCK_EXT_TAG (words[w]) == LATENCY_CLOCK_EXT_HISTORY)
+      history[n_history++] = LATENCY_CLOCK_EXT_DATA (words[w]);
+  }
+  window = MIN ((guint64) n_history * LATENCY_CLOCK_HISTORY_PER_WORD,
+      LATENCY_CLOCK_HISTORY_LEN);
+
+  if (gap - 1 > window) {
+    guint64 first = (overlay->last_frame_id + 1) & LATENCY_CLOCK_FRAME_ID_MASK;
+
+    GST_INFO_OBJECT (overlay, "Dropped %lu frames from Frame-id: %lu; "
+        "send times unknown", gap - 1 - window, first);
+    if (overlay->post_messages)
+      gst_timeoverlayparse_post_dropped (overlay, first, gap - 1 - window,
+          GST_CLOCK_TIME_NONE, systime);
+  }
+
+  for (j = MIN (gap - 1, window); j >= 1; j--) {
+    guint64 dropped_id = (frame_id - j) & LATENCY_CLOCK_FRAME_ID_MASK;
+    guint shift = (LATENCY_CLOCK_HISTORY_PER_WORD - 1 -
+        (j - 1) % LATENCY_CLOCK_HISTORY_PER_WORD) * LATENCY_CLOCK_HISTORY_BITS;
+    guint64 delta = (history[(j - 1) / LATENCY_CLOCK_HISTORY_PER_WORD] >>
+        shift) & LATENCY_CLOCK_HISTORY_UNKNOWN;
+    GstClockTime sent;
+
+    if (delta == LATENCY_CLOCK_HISTORY_UNKNOWN) {
+      GST_INFO_OBJECT (overlay, "Dropped Frame-id: %lu; send time unknown",
+          dropped_id);
+      sent = GST_CLOCK_TIME_NONE;
+    } else {
+      sent = remote_time - delta * 1000;
+      GST_INFO_OBJECT (overlay, "Dropped Frame-id: %lu; Sent: %ld; Age: %ld",
+          dropped_id, GST_TIME_AS_NSECONDS (sent),
+          GST_TIME_AS_NSECONDS (systime - sent));
+    }
+
+    if (overlay->post_messages)
+      gst_timeoverlayparse_post_dropped (overlay, dropped_id, 1, sent,
+          systime);
+  }
+}
+
+static const gchar *timestamp_fields[] = {
+  "buffer-time", "stream-time", "running-time", "clock-time", "render-time",
+  "render-realtime"
+};
+
+/* Fills times[] with the timestamps carried in the extension words, in the
+ * order of timestamp_fields, or GST_CLOCK_TIME_NONE for the ones not sent.
+ * Only render-realtime can exceed 60 bits, so it is unwrapped to the value
+ * nearest to remote_time. */
+static void
+gst_timeoverlayparse_read_timestamps (const guint64 *words, guint n_words,
+    GstClockTime remote_time, GstClockTime *times)
+{
+  const guint64 wrap = LATENCY_CLOCK_EXT_DATA (G_MAXUINT64) + 1;
+  guint w, i;
+
+  for (i = 0; i < G_N_ELEMENTS (timestamp_fields); i++)
+    times[i] = GST_CLOCK_TIME_NONE;
+
+  for (w = 1; w < n_words; w++) {
+    guint tag = LATENCY_CLOCK_EXT_TAG (words[w]);
+    guint64 data = LATENCY_CLOCK_EXT_DATA (words[w]);
+
+    if (tag < LATENCY_CLOCK_EXT_BUFFER_TIME ||
+        tag > LATENCY_CLOCK_EXT_RENDER_REALTIME ||
+        data == LATENCY_CLOCK_EXT_DATA (GST_CLOCK_TIME_NONE))
+      continue;
+    if (tag == LATENCY_CLOCK_EXT_RENDER_REALTIME) {
+      guint64 t = (remote_time & ~(wrap - 1)) | data;
+
+      if (t > remote_time && t - remote_time > wrap / 2 && t >= wrap)
+        t -= wrap;
+      else if (t < remote_time && remote_time - t > wrap / 2)
+        t += wrap;
+      data = t;
+    }
+    times[tag - LATENCY_CLOCK_EXT_BUFFER_TIME] = data;
+  }
+}
+
+/* Reads the payload of frame.  With post-messages set, a frame that decoded
+ * leaves its timeoverlayparse message in message for the caller to post. */
+static GstFlowReturn
+gst_timeoverlayparse_parse (GstTimeOverlayParse *overlay,
+    GstVideoFrame *frame, GstStructure **message)
+{
+  GstVideoFilter *filter = GST_VIDEO_FILTER (overlay);
+  GstClockTime systime = gst_timestamp_systime_now (&overlay->time_source,
+      GST_ELEMENT (overlay));
+  LatencyClockCodec *codec;
   GstClockTimeDiff latency;
   GstSegment *segment = &GST_BASE_TRANSFORM (overlay)->segment;
 
@@ -221,40 +962,270 @@ gst_timeoverlayparse_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame
     return GST_FLOW_OK;
   }
 
-  imgdata = frame->data[0];
+  gst_timestamp_codec_acquire (&overlay->pending_codec, &overlay->codec);
 
-  /* Centre Vertically: */
-  unsigned int rows = overlay->rows;
-  imgdata += (frame->info.height - rows * 8) * frame->info.stride[0] / 2;
+  /* In a stereo frame the left eye is measured like a mono frame, and the
+   * right eye read with the same codec and compared with it */
+  gboolean stereo = overlay->stereo_layout != LATENCY_CLOCK_LAYOUT_MONO;
+  guint eye = stereo ? LATENCY_CLOCK_EYE_LEFT : LATENCY_CLOCK_EYE_NONE;
+  gboolean header;
+  guint8 enc[LATENCY_CLOCK_MAX_ROWS * 8];
+  guint64 words[LATENCY_CLOCK_MAX_WORDS];
+  if (!gst_timeoverlayparse_read_view (overlay, frame, eye, TRUE, enc, words,
+          &header))
+    return GST_FLOW_OK;
+  codec = overlay->codec;
 
-  /* Centre Horizontally: */
-  imgdata += (frame->info.width - 64 * 8) * frame->info.finfo->pixel_stride[0]
-      / 2;
+  guint64 info = words[0];
 
-  uint64_t *msg = (uint64_t*)overlay->msg_enc;
-  for (int r = 0; r < overlay->rows; r++) {
-    uint64_t *part = &msg[r];
-    *part = read_timestamp (r,
-                            imgdata,
-                            frame->info.stride[0],
-                            frame->info.finfo->pixel_stride[0]);
-  }
-  uint64_t info;
-  if (overlay->fec_k > 0) {
-    fec_decode(overlay->decoder, overlay->fec_n,
-               overlay->msg_enc, (unsigned char*)&info);
-  } else {
-    memcpy(overlay->msg_enc, &info, sizeof(info));
+  uint64_t frame_id = LATENCY_CLOCK_FRAME_ID_MASK & info;
+  gboolean exact;
+  GstClockTime remote_time = latency_clock_send_time (words, codec->words,
+      &exact);
+  systime = gst_timeoverlayparse_get_receive_time (overlay, frame->buffer,
+      systime);
+  if (!GST_CLOCK_TIME_IS_VALID (systime)) {
+    GST_WARNING_OBJECT (filter, "Can't determine receive time of frame %lu",
+        frame_id);
+    return GST_FLOW_OK;
   }
-
-  uint64_t frame_id = 0xffFFffULL & info;
-  GstClockTime remote_time = (GstClockTime)( info & 0xFFffFFffFF000000ULL );
   latency = systime - remote_time;
 
+  gboolean plausible = latency <= PLAUSIBLE_LATENCY &&
+      latency >= -PLAUSIBLE_LATENCY;
+
+  /* A missing header, an implausible latency or a frame id from the past
+   * mean the payload didn't decode */
+  if (overlay->feedback_socket)
+    gst_timeoverlayparse_feedback (overlay, codec, enc, words,
+        (overlay->header && !header) || !plausible ||
+        (overlay->have_last_frame_id &&
+            ((frame_id - overlay->last_frame_id) &
+                LATENCY_CLOCK_FRAME_ID_MASK) > LATENCY_CLOCK_FRAME_ID_MASK / 2));
+
   GST_INFO_OBJECT (filter, "Systime: %ld; Latency: %ld; Frame-id: %lu",
       GST_TIME_AS_NSECONDS(systime),
       GST_TIME_AS_NSECONDS(latency),
       frame_id);
 
+  /* The compositor may reproject the eyes separately, so the right eye can
+   * show another frame than the left one */
+  guint64 right_words[LATENCY_CLOCK_MAX_WORDS];
+  gboolean right_header, have_right = stereo &&
+      gst_timeoverlayparse_read_view (overlay, frame, LATENCY_CLOCK_EYE_RIGHT,
+          FALSE, NULL, right_words, &right_header);
+  uint64_t right_frame_id = 0;
+  GstClockTimeDiff right_latency = 0;
+  gboolean right_exact = FALSE;
+  if (have_right) {
+    /* A skew of a frame or less is only visible with the exact send times
+     * of both eyes */
+    right_frame_id = right_words[0] & LATENCY_CLOCK_FRAME_ID_MASK;
+    right_latency = systime - latency_clock_send_time (right_words,
+        codec->words, &right_exact);
+    GST_INFO_OBJECT (filter, "Frame-id: %lu; Right eye frame-id: %lu; "
+        "Left latency: %ld; Right latency: %ld; Eye skew: %ld", frame_id,
+        right_frame_id, latency, right_latency, right_latency - latency);
+  }
+
+  /* The bands of later hops break the latency down stage by stage.  The
+   * stage times are exact, so the first stage is only measured against an
+   * exact send time */
+  guint stage_ids[LATENCY_CLOCK_MAX_STAGES];
+  GstClockTime stage_times[LATENCY_CLOCK_MAX_STAGES];
+  guint n_stages = header ? gst_timeoverlayparse_read_stages (overlay, frame,
+      eye, remote_time, stage_ids, stage_times) : 0;
+  for (guint i = exact ? 0 : 1; i < n_stages; i++)
+    GST_INFO_OBJECT (filter, "Frame-id: %lu; Stage %u -> %u: %"
+        G_GINT64_FORMAT, frame_id, i ? stage_ids[i - 1] : 0, stage_ids[i],
+        GST_CLOCK_DIFF (i ? stage_times[i - 1] : remote_time,
+            stage_times[i]));
+  if (n_stages > 0)
+    GST_INFO_OBJECT (filter, "Frame-id: %lu; Stage %u -> receiver: %"
+        G_GINT64_FORMAT, frame_id, stage_ids[n_stages - 1],
+        GST_CLOCK_DIFF (stage_times[n_stages - 1], systime));
+
+  /* Only the header row can tell where the code block is */
+  if (overlay->roi && header && !stereo)
+    gst_timeoverlayparse_update_roi (overlay, frame, n_stages);
+
+  /* A reflection from timestampreflect: remote_time is our own send time
+   * and the reflector says how long it held on to it */
+  GstClockTime hold = GST_CLOCK_TIME_NONE;
+  for (int w = 1; w < codec->words; w++) {
+    if (LATENCY_CLOCK_EXT_TAG (words[w]) == LATENCY_CLOCK_EXT_HOLD)
+      hold = LATENCY_CLOCK_EXT_DATA (words[w]);
+  }
+  if (GST_CLOCK_TIME_IS_VALID (hold))
+    GST_INFO_OBJECT (filter, "Frame-id: %lu; Hold: %" G_GUINT64_FORMAT
+        "; Round-trip time: %" G_GINT64_FORMAT, frame_id, hold,
+        latency - (GstClockTimeDiff) hold);
+
+  /* The sender's video mode, which changes during a mode sweep */
+  guint64 mode = 0;
+  for (int w = 1; w < codec->words; w++) {
+    if (LATENCY_CLOCK_EXT_TAG (words[w]) == LATENCY_CLOCK_EXT_MODE)
+      mode = words[w];
+  }
+  if (mode && mode != overlay->last_mode)
+    GST_INFO_OBJECT (filter, "Frame-id: %lu; Mode: %ux%u@%u/%u", frame_id,
+        LATENCY_CLOCK_MODE_WIDTH (mode), LATENCY_CLOCK_MODE_HEIGHT (mode),
+        LATENCY_CLOCK_MODE_FPS_N (mode), LATENCY_CLOCK_MODE_FPS_D (mode));
+  overlay->last_mode = mode;
+
+  /* A frame that didn't decode would throw the estimate off */
+  if (overlay->drift_window > 0 && plausible &&
+      gst_timestamp_drift_add (&overlay->drift, remote_time, latency))
+    GST_INFO_OBJECT (filter, "Drift: %.3f ppm; Offset: %" G_GINT64_FORMAT,
+        GST_TIMESTAMP_DRIFT_PPM (&overlay->drift),
+        gst_timestamp_drift_offset (&overlay->drift, remote_time));
+
+  GstClockTime times[G_N_ELEMENTS (timestamp_fields)];
+  gst_timeoverlayparse_read_timestamps (words, codec->words, remote_time,
+      times);
+  for (int i = 0; i < G_N_ELEMENTS (timestamp_fields); i++) {
+    if (GST_CLOCK_TIME_IS_VALID (times[i]))
+      GST_INFO_OBJECT (filter, "Frame-id: %lu; %s: %" GST_TIME_FORMAT,
+          frame_id, timestamp_fields[i], GST_TIME_ARGS (times[i]));
+  }
+
+  if (overlay->post_messages) {
+    GstStructure *s = gst_structure_new ("timeoverlayparse",
+        "pts", G_TYPE_UINT64, GST_BUFFER_PTS (frame->buffer),
+        "frame-id", G_TYPE_UINT64, frame_id,
+        "remote-time", G_TYPE_UINT64, remote_time,
+        "receive-time", G_TYPE_UINT64, systime,
+        "latency", G_TYPE_INT64, latency,
+        "exact", G_TYPE_BOOLEAN, exact,
+        NULL);
+    GstClockTime clock_time = times[LATENCY_CLOCK_EXT_CLOCK_TIME -
+        LATENCY_CLOCK_EXT_BUFFER_TIME];
+    GstClockTime render_time = times[LATENCY_CLOCK_EXT_RENDER_TIME -
+        LATENCY_CLOCK_EXT_BUFFER_TIME];
+    GstClockTime render_realtime = times[LATENCY_CLOCK_EXT_RENDER_REALTIME -
+        LATENCY_CLOCK_EXT_BUFFER_TIME];
+
+    for (int i = 0; i < G_N_ELEMENTS (timestamp_fields); i++) {
+      if (GST_CLOCK_TIME_IS_VALID (times[i]))
+        gst_structure_set (s, timestamp_fields[i], G_TYPE_UINT64, times[i],
+            NULL);
+    }
+    /* Split the latency into the time spent in the sending pipeline before
+     * the frame was due to be rendered and the time after that */
+    if (GST_CLOCK_TIME_IS_VALID (render_realtime))
+      gst_structure_set (s,
+          "pipeline-delay", G_TYPE_INT64,
+              GST_CLOCK_DIFF (remote_time, render_realtime),
+          "display-delay", G_TYPE_INT64,
+              GST_CLOCK_DIFF (render_realtime, systime),
+          NULL);
+    /* Left by seitimestampparse before the frame was decoded */
+    GstReferenceTimestampMeta *sei_sent =
+        gst_buffer_get_reference_timestamp_meta (frame->buffer,
+            overlay->sei_sent_caps);
+    GstReferenceTimestampMeta *sei_received =
+        gst_buffer_get_reference_timestamp_meta (frame->buffer,
+            overlay->sei_received_caps);
+    if (sei_sent && sei_received)
+      gst_structure_set (s,
+          "sei-remote-time", G_TYPE_UINT64, sei_sent->timestamp,
+          "sei-receive-time", G_TYPE_UINT64, sei_received->timestamp,
+          "network-latency", G_TYPE_INT64,
+              GST_CLOCK_DIFF (sei_sent->timestamp, sei_received->timestamp),
+          "decode-latency", G_TYPE_INT64,
+              GST_CLOCK_DIFF (sei_received->timestamp, systime),
+          NULL);
+    if (overlay->drift.valid) {
+      gst_structure_set (s,
+          "drift-ppm", G_TYPE_DOUBLE,
+              GST_TIMESTAMP_DRIFT_PPM (&overlay->drift),
+          "drift-offset", G_TYPE_INT64,
+              gst_timestamp_drift_offset (&overlay->drift, remote_time),
+          NULL);
+      if (overlay->drift_correction)
+        gst_structure_set (s, "corrected-latency", G_TYPE_INT64,
+            gst_timestamp_drift_correct (&overlay->drift, remote_time,
+                latency), NULL);
+    }
+    for (guint i = 0; i < n_stages; i++) {
+      gchar name[32];
+
+      g_snprintf (name, sizeof (name), "stage-%u-time", stage_ids[i]);
+      gst_structure_set (s, name, G_TYPE_UINT64, stage_times[i], NULL);
+      if (i == 0 && !exact)
+        continue;
+      g_snprintf (name, sizeof (name), "stage-%u-latency", stage_ids[i]);
+      gst_structure_set (s, name, G_TYPE_INT64,
+          GST_CLOCK_DIFF (i ? stage_times[i - 1] : remote_time,
+              stage_times[i]), NULL);
+    }
+    if (n_stages > 0)
+      gst_structure_set (s, "last-stage-latency", G_TYPE_INT64,
+          GST_CLOCK_DIFF (stage_times[n_stages - 1], systime), NULL);
+    if (have_right)
+      gst_structure_set (s,
+          "left-latency", G_TYPE_INT64, latency,
+          "right-frame-id", G_TYPE_UINT64, right_frame_id,
+          "right-latency", G_TYPE_INT64, right_latency,
+          NULL);
+    if (have_right && exact && right_exact)
+      gst_structure_set (s,
+          "eye-skew", G_TYPE_INT64, right_latency - latency,
+          NULL);
+    if (mode)
+      gst_structure_set (s,
+          "mode-width", G_TYPE_INT, LATENCY_CLOCK_MODE_WIDTH (mode),
+          "mode-height", G_TYPE_INT, LATENCY_CLOCK_MODE_HEIGHT (mode),
+          "mode-framerate", GST_TYPE_FRACTION,
+              LATENCY_CLOCK_MODE_FPS_N (mode), LATENCY_CLOCK_MODE_FPS_D (mode),
+          NULL);
+    if (GST_CLOCK_TIME_IS_VALID (hold))
+      gst_structure_set (s,
+          "hold", G_TYPE_UINT64, hold,
+          "round-trip-time", G_TYPE_INT64,
+              latency - (GstClockTimeDiff) hold,
+          NULL);
+    if (GST_CLOCK_TIME_IS_VALID (clock_time) &&
+        GST_CLOCK_TIME_IS_VALID (render_time))
+      gst_structure_set (s, "render-latency", G_TYPE_INT64,
+          GST_CLOCK_DIFF (clock_time, render_time), NULL);
+
+    /* Posted once the cost of the frame is known */
+    *message = s;
+  }
+
+  /* A frame whose latency is implausible didn't decode, and its frame id
+   * can't be trusted either */
+  if (plausible) {
+    gst_timeoverlayparse_account_dropped (overlay, words, codec->words,
+        frame_id, remote_time, systime);
+    overlay->last_frame_id = frame_id;
+    overlay->have_last_frame_id = TRUE;
+  }
+
   return GST_FLOW_OK;
 }
+
+static GstFlowReturn
+gst_timeoverlayparse_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
+{
+  GstTimeOverlayParse *overlay = GST_TIMEOVERLAYPARSE (filter);
+  GstStructure *message = NULL;
+  GstClockTime cost;
+  GstFlowReturn ret;
+
+  GST_DEBUG_OBJECT (overlay, "transform_frame_ip");
+
+  gst_timestamp_cost_begin (&overlay->cost, GST_ELEMENT (overlay));
+  ret = gst_timeoverlayparse_parse (overlay, frame, &message);
+  cost = gst_timestamp_cost_end (&overlay->cost, GST_ELEMENT (overlay),
+      "timeoverlayparse-cost");
+
+  if (message) {
+    if (GST_CLOCK_TIME_IS_VALID (cost))
+      gst_structure_set (message, "cost", G_TYPE_UINT64, cost, NULL);
+    gst_element_post_message (GST_ELEMENT (overlay),
+        gst_message_new_element (GST_OBJECT (overlay), message));
+  }
+  return ret;
+}
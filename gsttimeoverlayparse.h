@@ -22,8 +22,9 @@
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
+#include <gio/gio.h>
 
-#include <liquid.h>
+#include "gsttimestampcommon.h"
 
 G_BEGIN_DECLS
 
@@ -36,17 +37,77 @@ G_BEGIN_DECLS
 typedef struct _GstTimeOverlayParse GstTimeOverlayParse;
 typedef struct _GstTimeOverlayParseClass GstTimeOverlayParseClass;
 
+/* Where the local (receive) side of the latency measurement comes from. */
+typedef enum {
+  GST_TIMEOVERLAYPARSE_RECEIVE_TIME_NOW,
+  GST_TIMEOVERLAYPARSE_RECEIVE_TIME_PTS,
+  GST_TIMEOVERLAYPARSE_RECEIVE_TIME_REFERENCE_TIMESTAMP,
+} GstTimeOverlayParseReceiveTime;
+
+#define GST_TYPE_TIMEOVERLAYPARSE_RECEIVE_TIME \
+    (gst_timeoverlayparse_receive_time_get_type ())
+GType gst_timeoverlayparse_receive_time_get_type (void);
+
 struct _GstTimeOverlayParse
 {
   GstVideoFilter base_timeoverlayparse;
 
   fec_scheme fec_scheme;
-  fec decoder;
-  unsigned int rows;
-  unsigned int fec_n;
-  unsigned int fec_k;
-  unsigned char *msg_enc;
-  unsigned char *msg_dec;
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+
+  gboolean header;
+  guint64 last_header;
+  gboolean last_header_valid;
+  /* Whether the stream has shown a valid header since start */
+  gboolean seen_header;
+  fec_scheme header_fec_scheme;
+  guint header_words;
+  guint header_version;
+  guint header_eye;
+
+  LatencyClockLayout stereo_layout;
+
+  /* The last region of interest posted with roi set */
+  gboolean roi;
+  gint roi_x;
+  gint roi_y;
+  gint roi_width;
+  gint roi_height;
+
+  /* Codecs of the bands appended by later hops */
+  LatencyClockCodec *stage_codecs[LATENCY_CLOCK_MAX_STAGES];
+
+  gboolean have_last_frame_id;
+  guint64 last_frame_id;
+  /* Mode word of the last frame, 0 if it had none */
+  guint64 last_mode;
+
+  gboolean post_messages;
+  GstTimeOverlayParseReceiveTime receive_time;
+  gint64 pts_offset;
+  GstTimestampSystime time_source;
+
+  GstClockTime drift_window;
+  gboolean drift_correction;
+  GstTimestampDrift drift;
+
+  GstTimestampCost cost;
+
+  /* Reports for the adaptive FEC of timestampoverlay */
+  gchar *feedback_address;
+  gint feedback_port;
+  GstClockTime feedback_interval;
+  GSocket *feedback_socket;
+  GSocketAddress *feedback_dest;
+  GstClockTime feedback_last;
+  guint64 feedback_frames;
+  guint64 feedback_errors;
+  guint64 feedback_corrected;
+  guint64 feedback_bits;
+  GstCaps *reference_caps;
+  GstCaps *sei_sent_caps;
+  GstCaps *sei_received_caps;
 };
 
 struct _GstTimeOverlayParseClass
@@ -15,7 +15,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <liquid.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include "gsttimestampcommon.h"
 
@@ -39,6 +45,7 @@ gst_fec_scheme_get_type (void)
       { LIQUID_FEC_SECDED3932, "SEC-DED (39,32) block code", "secded3932" },
       { LIQUID_FEC_SECDED7264, "SEC-DED (72,64) block code, r8/9", "secdec7264" },
 
+#ifdef HAVE_LIQUID
       { LIQUID_FEC_CONV_V27,  "r1/2, K=7, dfree=10",      "conv_v27" },
       { LIQUID_FEC_CONV_V29,  "r1/2, K=9, dfree=12",      "conv_v29" },
       { LIQUID_FEC_CONV_V39,  "r1/3, K=9, dfree=18",      "conv_v39" },
@@ -58,6 +65,7 @@ gst_fec_scheme_get_type (void)
       { LIQUID_FEC_CONV_V29P56, "r5/6, K=9, dfree=5", "conv_v29p56" },
       { LIQUID_FEC_CONV_V29P67, "r6/7, K=9, dfree=4", "conv_v29p67" },
       { LIQUID_FEC_CONV_V29P78, "r7/8, K=9, dfree=4", "conv_v29p78" },
+#endif
 
       // Reed-Solomon codes
       { LIQUID_FEC_RS_M8,     "Reed-Solomon, m=8, n=255, k=223", "rs_m8" },
@@ -69,3 +77,737 @@ gst_fec_scheme_get_type (void)
 
   return fec_scheme_type;
 }
+
+/* Hands a freshly built codec over to the streaming thread.  A codec that was
+ * published earlier but never picked up can't be in use, so it's freed. */
+void
+gst_timestamp_codec_publish (gpointer *pending, LatencyClockCodec *codec)
+{
+  latency_clock_codec_free (g_atomic_pointer_exchange (pending, codec));
+}
+
+/* Called by the streaming thread before it touches the codec.  Returns the
+ * codec to use for this frame, swapping in a pending one if there is one. */
+LatencyClockCodec *
+gst_timestamp_codec_acquire (gpointer *pending, LatencyClockCodec **active)
+{
+  LatencyClockCodec *codec = g_atomic_pointer_exchange (pending, NULL);
+
+  if (codec) {
+    latency_clock_codec_free (*active);
+    *active = codec;
+  }
+  return *active;
+}
+
+/* UUID of the user_data_unregistered SEI messages carrying the timestamp */
+static const guint8 sei_uuid[16] = {
+  0x6c, 0x61, 0x74, 0x65, 0x6e, 0x63, 0x79, 0x2d,
+  0x63, 0x6c, 0x6f, 0x63, 0x6b, 0x2d, 0x74, 0x73
+};
+
+#define SEI_USER_DATA_UNREGISTERED 5
+
+/* Returns the offset of the next start code at or after pos, including the
+ * zero_byte of a 4-byte start code, or size if there is none.  *nal is set
+ * to the offset of the NAL unit header that follows it. */
+static gsize
+next_nal (const guint8 *data, gsize size, gsize pos, gsize *nal)
+{
+  for (; pos + 3 <= size; pos++) {
+    if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1) {
+      *nal = pos + 3;
+      return (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+    }
+  }
+  *nal = size;
+  return size;
+}
+
+static guint
+nal_type (const guint8 *nal, gboolean h265)
+{
+  return h265 ? (nal[0] >> 1) & 0x3f : nal[0] & 0x1f;
+}
+
+static gboolean
+nal_is_vcl (guint type, gboolean h265)
+{
+  return h265 ? type < 32 : type >= 1 && type <= 5;
+}
+
+/* Appends byte to the escaped RBSP at out, inserting an
+ * emulation_prevention_three_byte where needed */
+static gsize
+put_rbsp_byte (guint8 *out, gsize len, guint8 byte)
+{
+  if (len >= 2 && out[len - 1] == 0 && out[len - 2] == 0 && byte <= 3)
+    out[len++] = 3;
+  out[len++] = byte;
+  return len;
+}
+
+/* Builds a complete SEI NAL unit, start code included, carrying the header
+ * and words encoded with codec */
+GstMemory *
+gst_timestamp_sei_new (const LatencyClockCodec *codec, const guint64 *words,
+    gboolean h265)
+{
+  guint8 rbsp[16 + GST_TIMESTAMP_SEI_MAX_PAYLOAD];
+  guint payload_size = 16 + (1 + codec->rows) * 8, i, n;
+  guint64 rows[LATENCY_CLOCK_MAX_ROWS];
+  guint8 *out;
+  gsize len = 0;
+
+  latency_clock_encode (codec, words, (guint8 *) rows);
+
+  memcpy (rbsp, sei_uuid, 16);
+  GST_WRITE_UINT64_BE (rbsp + 16, latency_clock_header_pack (codec,
+      LATENCY_CLOCK_EYE_NONE));
+  for (i = 0; i < codec->rows; i++)
+    GST_WRITE_UINT64_BE (rbsp + 24 + i * 8, rows[i]);
+
+  /* Escaping grows the RBSP by at most a half */
+  out = g_malloc (6 + 4 + payload_size * 3 / 2 + 1);
+  out[len++] = 0;
+  out[len++] = 0;
+  out[len++] = 0;
+  out[len++] = 1;
+  if (h265) {
+    out[len++] = 39 << 1;       /* PREFIX_SEI_NUT, layer 0 */
+    out[len++] = 1;             /* temporal id 0 */
+  } else {
+    out[len++] = 6;             /* SEI, nal_ref_idc 0 */
+  }
+  len = put_rbsp_byte (out, len, SEI_USER_DATA_UNREGISTERED);
+  for (n = payload_size; n >= 255; n -= 255)
+    len = put_rbsp_byte (out, len, 255);
+  len = put_rbsp_byte (out, len, n);
+  for (i = 0; i < payload_size; i++)
+    len = put_rbsp_byte (out, len, rbsp[i]);
+  out[len++] = 0x80;            /* rbsp_trailing_bits */
+
+  return gst_memory_new_wrapped (0, out, len, 0, len, out, g_free);
+}
+
+/* Returns where a SEI should be inserted into the access unit: before the
+ * start code of its first VCL NAL unit */
+gsize
+gst_timestamp_sei_insert_offset (const guint8 *data, gsize size,
+    gboolean h265)
+{
+  gsize pos = 0, start, nal;
+
+  while ((start = next_nal (data, size, pos, &nal)) < size) {
+    if (nal < size && nal_is_vcl (nal_type (data + nal, h265), h265))
+      return start;
+    pos = nal;
+  }
+  return size;
+}
+
+/* Looks for the timestamp SEI in the access unit.  Copies its user data
+ * (after the UUID) to payload, which must hold GST_TIMESTAMP_SEI_MAX_PAYLOAD
+ * bytes, and returns its size, or 0 if the access unit doesn't carry one. */
+gsize
+gst_timestamp_sei_find (const guint8 *data, gsize size, gboolean h265,
+    guint8 *payload)
+{
+  gsize pos = 0, nal;
+
+  while (next_nal (data, size, pos, &nal) < size) {
+    guint8 rbsp[16 + GST_TIMESTAMP_SEI_MAX_PAYLOAD + 8];
+    gsize end, i, len = 0, m = 0;
+    guint zeros = 0, type;
+
+    pos = nal;
+    if (nal >= size || nal_is_vcl (nal_type (data + nal, h265), h265))
+      break;
+    if (nal_type (data + nal, h265) != (h265 ? 39 : 6))
+      continue;
+
+    /* Strip the emulation_prevention_three_bytes */
+    end = next_nal (data, size, nal, &i);
+    pos = end;
+    for (i = nal + (h265 ? 2 : 1); i < end && len < sizeof (rbsp); i++) {
+      if (zeros >= 2 && data[i] == 3) {
+        zeros = 0;
+        continue;
+      }
+      zeros = data[i] == 0 ? zeros + 1 : 0;
+      rbsp[len++] = data[i];
+    }
+
+    /* A SEI NAL unit may hold several messages */
+    while (m + 2 <= len && rbsp[m] != 0x80) {
+      guint payload_size = 0;
+
+      for (type = 0; m < len && rbsp[m] == 255; m++)
+        type += 255;
+      if (m >= len)
+        break;
+      type += rbsp[m++];
+      while (m < len && rbsp[m] == 255)
+        payload_size += rbsp[m++];
+      if (m >= len)
+        break;
+      payload_size += rbsp[m++];
+      if (m + payload_size > len)
+        break;
+
+      if (type == SEI_USER_DATA_UNREGISTERED && payload_size > 16 &&
+          payload_size - 16 <= GST_TIMESTAMP_SEI_MAX_PAYLOAD &&
+          memcmp (rbsp + m, sei_uuid, 16) == 0) {
+        memcpy (payload, rbsp + m + 16, payload_size - 16);
+        return payload_size - 16;
+      }
+      m += payload_size;
+    }
+  }
+  return 0;
+}
+
+GType
+gst_timestamp_time_source_get_type (void)
+{
+  static GType time_source_type = 0;
+
+  if (!time_source_type) {
+    static GEnumValue time_source_types[] = {
+      { GST_TIMESTAMP_TIME_SOURCE_REALTIME, "CLOCK_REALTIME", "realtime" },
+      { GST_TIMESTAMP_TIME_SOURCE_TAI, "CLOCK_TAI", "tai" },
+      { GST_TIMESTAMP_TIME_SOURCE_PIPELINE,
+        "Pipeline clock, offset to CLOCK_REALTIME once", "pipeline" },
+      { GST_TIMESTAMP_TIME_SOURCE_NET_CLIENT,
+        "GstNetClientClock synchronised to a GstNetTimeProvider",
+        "net-client" },
+      { GST_TIMESTAMP_TIME_SOURCE_PTP, "GstPtpClock (IEEE 1588)", "ptp" },
+      { 0, NULL, NULL },
+    };
+
+    time_source_type = g_enum_register_static ("time_source",
+        time_source_types);
+  }
+
+  return time_source_type;
+}
+
+GType
+gst_timestamp_stereo_layout_get_type (void)
+{
+  static GType stereo_layout_type = 0;
+
+  if (!stereo_layout_type) {
+    static GEnumValue stereo_layout_types[] = {
+      { LATENCY_CLOCK_LAYOUT_MONO, "One view", "mono" },
+      { LATENCY_CLOCK_LAYOUT_SIDE_BY_SIDE,
+        "Left eye in the left half, right eye in the right half",
+        "side-by-side" },
+      { LATENCY_CLOCK_LAYOUT_TOP_BOTTOM,
+        "Left eye in the top half, right eye in the bottom half",
+        "top-bottom" },
+      { 0, NULL, NULL },
+    };
+
+    stereo_layout_type = g_enum_register_static ("stereo_layout",
+        stereo_layout_types);
+  }
+
+  return stereo_layout_type;
+}
+
+static GstClockTime
+systime_posix (clockid_t clock_id)
+{
+  struct timespec ts;
+
+  clock_gettime (clock_id, &ts);
+  return (GstClockTime) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+void
+gst_timestamp_systime_init (GstTimestampSystime *st)
+{
+  st->source = GST_TIMESTAMP_TIME_SOURCE_REALTIME;
+  st->address = g_strdup (GST_TIMESTAMP_NET_CLOCK_DEFAULT_ADDRESS);
+  st->port = GST_TIMESTAMP_NET_CLOCK_DEFAULT_PORT;
+  st->ptp_domain = 0;
+  st->clock = NULL;
+  st->synced = FALSE;
+  st->pipeline_clock = NULL;
+  st->offset = 0;
+}
+
+void
+gst_timestamp_systime_clear (GstTimestampSystime *st)
+{
+  gst_timestamp_systime_stop (st);
+  g_clear_pointer (&st->address, g_free);
+}
+
+/* Creates the clock of the net-client and ptp sources.  Neither waits for
+ * the clock to synchronise: until it has, the readings are logged as
+ * unsynchronised and the latencies they give are meaningless. */
+gboolean
+gst_timestamp_systime_start (GstTimestampSystime *st, GstElement *element)
+{
+  gst_timestamp_systime_stop (st);
+
+  switch (st->source) {
+  case GST_TIMESTAMP_TIME_SOURCE_NET_CLIENT:
+    st->clock = gst_net_client_clock_new ("timestamp-net-clock", st->address,
+        st->port, 0);
+    if (!st->clock) {
+      GST_ELEMENT_ERROR (element, RESOURCE, FAILED, (NULL),
+          ("Failed to create a network clock for %s:%d", st->address,
+              st->port));
+      return FALSE;
+    }
+    GST_INFO_OBJECT (element, "Using network clock %s:%d", st->address,
+        st->port);
+    break;
+  case GST_TIMESTAMP_TIME_SOURCE_PTP:
+    if (!gst_ptp_is_initialized () &&
+        !gst_ptp_init (GST_PTP_CLOCK_ID_NONE, NULL)) {
+      GST_ELEMENT_ERROR (element, RESOURCE, FAILED, (NULL),
+          ("Failed to initialise PTP"));
+      return FALSE;
+    }
+    st->clock = gst_ptp_clock_new ("timestamp-ptp-clock", st->ptp_domain);
+    if (!st->clock) {
+      GST_ELEMENT_ERROR (element, RESOURCE, FAILED, (NULL),
+          ("Failed to create a PTP clock for domain %u", st->ptp_domain));
+      return FALSE;
+    }
+    GST_INFO_OBJECT (element, "Using PTP clock of domain %u", st->ptp_domain);
+    break;
+  default:
+    break;
+  }
+
+  return TRUE;
+}
+
+void
+gst_timestamp_systime_stop (GstTimestampSystime *st)
+{
+  if (st->clock)
+    gst_object_unref (st->clock);
+  st->clock = NULL;
+  st->synced = FALSE;
+  if (st->pipeline_clock)
+    gst_object_unref (st->pipeline_clock);
+  st->pipeline_clock = NULL;
+}
+
+/* Returns the current time according to the time source, in nanoseconds */
+GstClockTime
+gst_timestamp_systime_now (GstTimestampSystime *st, GstElement *element)
+{
+  GstClockTime now;
+  GstClock *clock;
+
+  switch (st->source) {
+  case GST_TIMESTAMP_TIME_SOURCE_TAI:
+    return systime_posix (CLOCK_TAI);
+  case GST_TIMESTAMP_TIME_SOURCE_PIPELINE:
+    /* The pipeline clock is mapped to CLOCK_REALTIME once, when it is first
+     * read, so that slewing of CLOCK_REALTIME after that doesn't show */
+    clock = gst_element_get_clock (element);
+    if (!clock)
+      return systime_posix (CLOCK_REALTIME);
+    now = gst_clock_get_time (clock);
+    if (clock != st->pipeline_clock) {
+      if (st->pipeline_clock)
+        gst_object_unref (st->pipeline_clock);
+      st->pipeline_clock = gst_object_ref (clock);
+      st->offset = GST_CLOCK_DIFF (now, systime_posix (CLOCK_REALTIME));
+      GST_INFO_OBJECT (element, "Offset of %" GST_PTR_FORMAT " to "
+          "CLOCK_REALTIME: %" G_GINT64_FORMAT, clock, st->offset);
+    }
+    gst_object_unref (clock);
+    return now + st->offset;
+  case GST_TIMESTAMP_TIME_SOURCE_NET_CLIENT:
+  case GST_TIMESTAMP_TIME_SOURCE_PTP:
+    if (!st->clock)
+      return systime_posix (CLOCK_REALTIME);
+    if (!st->synced && gst_clock_is_synced (st->clock)) {
+      st->synced = TRUE;
+      GST_INFO_OBJECT (element, "%" GST_PTR_FORMAT " is synchronised",
+          st->clock);
+    } else if (!st->synced) {
+      GST_LOG_OBJECT (element, "%" GST_PTR_FORMAT " is not synchronised yet",
+          st->clock);
+    }
+    return gst_clock_get_time (st->clock);
+  case GST_TIMESTAMP_TIME_SOURCE_REALTIME:
+  default:
+    return systime_posix (CLOCK_REALTIME);
+  }
+}
+
+void
+gst_timestamp_systime_install_properties (GObjectClass *klass,
+    guint first_prop, const gchar *time_source_blurb)
+{
+  g_object_class_install_property (klass, first_prop,
+    g_param_spec_enum ("time-source", "Time source", time_source_blurb,
+                       GST_TYPE_TIMESTAMP_TIME_SOURCE,
+                       GST_TIMESTAMP_TIME_SOURCE_REALTIME,
+                       G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                       G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (klass, first_prop + 1,
+    g_param_spec_string ("net-clock-address", "Network clock address",
+                         "Address of the GstNetTimeProvider when "
+                         "time-source=net-client",
+                         GST_TIMESTAMP_NET_CLOCK_DEFAULT_ADDRESS,
+                         G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (klass, first_prop + 2,
+    g_param_spec_int ("net-clock-port", "Network clock port",
+                      "Port of the GstNetTimeProvider when "
+                      "time-source=net-client",
+                      1, 65535, GST_TIMESTAMP_NET_CLOCK_DEFAULT_PORT,
+                      G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                      G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (klass, first_prop + 3,
+    g_param_spec_uint ("ptp-domain", "PTP domain",
+                       "PTP domain when time-source=ptp",
+                       0, G_MAXUINT8, 0,
+                       G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                       G_PARAM_STATIC_STRINGS));
+}
+
+gboolean
+gst_timestamp_systime_set_property (GstTimestampSystime *st,
+    guint first_prop, guint prop_id, const GValue *value)
+{
+  if (prop_id < first_prop ||
+      prop_id >= first_prop + GST_TIMESTAMP_SYSTIME_N_PROPS)
+    return FALSE;
+
+  switch (prop_id - first_prop) {
+  case 0:
+    st->source = g_value_get_enum (value);
+    break;
+  case 1:
+    g_free (st->address);
+    st->address = g_value_dup_string (value);
+    break;
+  case 2:
+    st->port = g_value_get_int (value);
+    break;
+  case 3:
+    st->ptp_domain = g_value_get_uint (value);
+    break;
+  }
+  return TRUE;
+}
+
+gboolean
+gst_timestamp_systime_get_property (GstTimestampSystime *st,
+    guint first_prop, guint prop_id, GValue *value)
+{
+  if (prop_id < first_prop ||
+      prop_id >= first_prop + GST_TIMESTAMP_SYSTIME_N_PROPS)
+    return FALSE;
+
+  switch (prop_id - first_prop) {
+  case 0:
+    g_value_set_enum (value, st->source);
+    break;
+  case 1:
+    g_value_set_string (value, st->address);
+    break;
+  case 2:
+    g_value_set_int (value, st->port);
+    break;
+  case 3:
+    g_value_set_uint (value, st->ptp_domain);
+    break;
+  }
+  return TRUE;
+}
+
+void
+gst_timestamp_drift_init (GstTimestampDrift *drift, GstClockTime window)
+{
+  memset (drift, 0, sizeof (*drift));
+  drift->window = window;
+  drift->window_start = GST_CLOCK_TIME_NONE;
+}
+
+static int
+compare_double (const void *a, const void *b)
+{
+  gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+
+  return (x > y) - (x < y);
+}
+
+static gdouble
+median (gdouble *values, guint n)
+{
+  qsort (values, n, sizeof (gdouble), compare_double);
+  return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static void
+gst_timestamp_drift_fit (GstTimestampDrift *drift)
+{
+  gdouble slopes[GST_TIMESTAMP_DRIFT_WINDOWS *
+      (GST_TIMESTAMP_DRIFT_WINDOWS - 1) / 2];
+  gdouble intercepts[GST_TIMESTAMP_DRIFT_WINDOWS];
+  guint i, j, n_slopes = 0;
+  guint last = (drift->next + GST_TIMESTAMP_DRIFT_WINDOWS - 1) %
+      GST_TIMESTAMP_DRIFT_WINDOWS;
+
+  for (i = 0; i < drift->n; i++) {
+    for (j = i + 1; j < drift->n; j++) {
+      if (drift->times[i] == drift->times[j])
+        continue;
+      slopes[n_slopes++] = (gdouble) (drift->mins[j] - drift->mins[i]) /
+          GST_CLOCK_DIFF (drift->times[i], drift->times[j]);
+    }
+  }
+  if (n_slopes == 0)
+    return;
+  drift->slope = median (slopes, n_slopes);
+
+  /* The intercept is the median of the minima moved along the slope to the
+   * newest of them */
+  drift->ref_time = drift->times[last];
+  for (i = 0; i < drift->n; i++)
+    intercepts[i] = drift->mins[i] - drift->slope *
+        GST_CLOCK_DIFF (drift->ref_time, drift->times[i]);
+  drift->ref_latency = median (intercepts, drift->n);
+  drift->valid = TRUE;
+}
+
+/* Adds the latency of a frame.  Returns TRUE when that closed a window and
+ * the fit was updated. */
+gboolean
+gst_timestamp_drift_add (GstTimestampDrift *drift, GstClockTime remote_time,
+    GstClockTimeDiff latency)
+{
+  gboolean refit = FALSE;
+
+  /* The sender restarted or its clock stepped back: start over, but not
+   * for a single frame whose remote time didn't decode */
+  if (GST_CLOCK_TIME_IS_VALID (drift->window_start) &&
+      remote_time < drift->window_start) {
+    if (++drift->backwards < GST_TIMESTAMP_DRIFT_RESTART_FRAMES)
+      return FALSE;
+    gst_timestamp_drift_init (drift, drift->window);
+  }
+  drift->backwards = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID (drift->window_start)) {
+    drift->origin = remote_time;
+  } else if (remote_time - drift->window_start < drift->window) {
+    if (latency < drift->window_min) {
+      drift->window_min = latency;
+      drift->window_time = remote_time;
+    }
+    return FALSE;
+  } else {
+    drift->times[drift->next] = drift->window_time;
+    drift->mins[drift->next] = drift->window_min;
+    drift->next = (drift->next + 1) % GST_TIMESTAMP_DRIFT_WINDOWS;
+    drift->n = MIN (drift->n + 1, GST_TIMESTAMP_DRIFT_WINDOWS);
+    if (drift->n >= GST_TIMESTAMP_DRIFT_MIN_WINDOWS) {
+      gst_timestamp_drift_fit (drift);
+      refit = drift->valid;
+    }
+  }
+
+  drift->window_start = remote_time;
+  drift->window_time = remote_time;
+  drift->window_min = latency;
+  return refit;
+}
+
+/* The lower envelope of the latency at remote_time: the least latency a
+ * frame can have plus the offset between the clocks */
+GstClockTimeDiff
+gst_timestamp_drift_offset (const GstTimestampDrift *drift,
+    GstClockTime remote_time)
+{
+  return drift->ref_latency +
+      drift->slope * GST_CLOCK_DIFF (drift->ref_time, remote_time);
+}
+
+/* The latency with the drift since the first frame taken out */
+GstClockTimeDiff
+gst_timestamp_drift_correct (const GstTimestampDrift *drift,
+    GstClockTime remote_time, GstClockTimeDiff latency)
+{
+  return latency - drift->slope * GST_CLOCK_DIFF (drift->origin, remote_time);
+}
+
+void
+gst_timestamp_cost_init (GstTimestampCost *cost)
+{
+  memset (cost, 0, sizeof (*cost));
+  cost->interval = GST_SECOND;
+  cost->perf_fd = cost->perf_cache_misses_fd = -1;
+}
+
+/* Clears the totals, for a new run of the element */
+void
+gst_timestamp_cost_reset (GstTimestampCost *cost)
+{
+  cost->frames = cost->sum = cost->max = 0;
+  cost->cycles = cost->cache_misses = 0;
+  memset (cost->histogram, 0, sizeof (cost->histogram));
+  cost->last_message = GST_CLOCK_TIME_NONE;
+}
+
+void
+gst_timestamp_cost_close (GstTimestampCost *cost)
+{
+  if (cost->perf_cache_misses_fd >= 0)
+    close (cost->perf_cache_misses_fd);
+  if (cost->perf_fd >= 0)
+    close (cost->perf_fd);
+  cost->perf_fd = cost->perf_cache_misses_fd = -1;
+  cost->perf_thread = NULL;
+}
+
+static int
+perf_event_open (guint64 config, int group_fd)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  /* The calling thread on any CPU */
+  return syscall (SYS_perf_event_open, &attr, 0, -1, group_fd,
+      PERF_FLAG_FD_CLOEXEC);
+}
+
+/* The counters only count the thread that opened them, so they are opened
+ * by the streaming thread, again if it changes */
+static void
+gst_timestamp_cost_open (GstTimestampCost *cost, GstElement *element)
+{
+  gst_timestamp_cost_close (cost);
+  cost->perf_thread = g_thread_self ();
+
+  cost->perf_fd = perf_event_open (PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (cost->perf_fd < 0) {
+    GST_WARNING_OBJECT (element, "Can't count CPU cycles: %s",
+        g_strerror (errno));
+    return;
+  }
+  cost->perf_cache_misses_fd = perf_event_open (PERF_COUNT_HW_CACHE_MISSES,
+      cost->perf_fd);
+  if (cost->perf_cache_misses_fd < 0)
+    GST_WARNING_OBJECT (element, "Can't count cache misses: %s",
+        g_strerror (errno));
+}
+
+/* Reads the cycles and cache misses with a single read () of the group */
+static gboolean
+gst_timestamp_cost_read (GstTimestampCost *cost, guint64 *cycles,
+    guint64 *cache_misses)
+{
+  guint64 values[3] = { 0, 0, 0 };
+
+  if (cost->perf_fd < 0 ||
+      read (cost->perf_fd, values, sizeof (values)) < 16)
+    return FALSE;
+  *cycles = values[1];
+  *cache_misses = values[0] > 1 ? values[2] : 0;
+  return TRUE;
+}
+
+void
+gst_timestamp_cost_begin (GstTimestampCost *cost, GstElement *element)
+{
+  if (!cost->enabled)
+    return;
+  if (cost->perf && cost->perf_thread != g_thread_self ())
+    gst_timestamp_cost_open (cost, element);
+  if (cost->perf)
+    gst_timestamp_cost_read (cost, &cost->begin_cycles,
+        &cost->begin_cache_misses);
+  cost->begin = systime_posix (CLOCK_MONOTONIC);
+}
+
+/* Adds the frame to the totals and posts a message named name with them
+ * every interval.  Returns the time the frame took, or
+ * GST_CLOCK_TIME_NONE if the cost isn't measured. */
+GstClockTime
+gst_timestamp_cost_end (GstTimestampCost *cost, GstElement *element,
+    const gchar *name)
+{
+  GstClockTime end, elapsed;
+  guint64 cycles = 0, cache_misses = 0;
+  GstStructure *stats = NULL;
+
+  if (!cost->enabled)
+    return GST_CLOCK_TIME_NONE;
+  end = systime_posix (CLOCK_MONOTONIC);
+  elapsed = end - cost->begin;
+  if (cost->perf && gst_timestamp_cost_read (cost, &cycles, &cache_misses)) {
+    cycles -= cost->begin_cycles;
+    cache_misses -= cost->begin_cache_misses;
+  }
+
+  GST_OBJECT_LOCK (element);
+  cost->frames++;
+  cost->sum += elapsed;
+  cost->max = MAX (cost->max, elapsed);
+  cost->cycles += cycles;
+  cost->cache_misses += cache_misses;
+  cost->histogram[elapsed == 0 ? 0 : MIN (g_bit_storage (elapsed),
+          GST_TIMESTAMP_COST_BUCKETS - 1)]++;
+  if (cost->interval > 0 && (!GST_CLOCK_TIME_IS_VALID (cost->last_message)
+          || end - cost->last_message >= cost->interval)) {
+    cost->last_message = end;
+    stats = gst_timestamp_cost_stats (cost, name);
+  }
+  GST_OBJECT_UNLOCK (element);
+
+  if (stats)
+    gst_element_post_message (element,
+        gst_message_new_element (GST_OBJECT (element), stats));
+  return elapsed;
+}
+
+/* The totals as a structure named name, for the cost-stats property and the
+ * messages.  The caller holds the object lock. */
+GstStructure *
+gst_timestamp_cost_stats (const GstTimestampCost *cost, const gchar *name)
+{
+  GstStructure *s;
+  GValue histogram = G_VALUE_INIT, bucket = G_VALUE_INIT;
+  guint i;
+
+  s = gst_structure_new (name,
+      "frames", G_TYPE_UINT64, cost->frames,
+      "mean", G_TYPE_UINT64, cost->frames ? cost->sum / cost->frames : 0,
+      "max", G_TYPE_UINT64, cost->max,
+      NULL);
+  if (cost->perf)
+    gst_structure_set (s,
+        "cycles", G_TYPE_UINT64, cost->cycles,
+        "cache-misses", G_TYPE_UINT64, cost->cache_misses,
+        NULL);
+
+  g_value_init (&histogram, GST_TYPE_ARRAY);
+  g_value_init (&bucket, G_TYPE_UINT64);
+  for (i = 0; i < GST_TIMESTAMP_COST_BUCKETS; i++) {
+    g_value_set_uint64 (&bucket, cost->histogram[i]);
+    gst_value_array_append_value (&histogram, &bucket);
+  }
+  gst_structure_take_value (s, "histogram", &histogram);
+  g_value_unset (&bucket);
+  return s;
+}
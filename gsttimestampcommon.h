@@ -22,11 +22,214 @@
 #include "config.h"
 #endif
 #include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/net/net.h>
+
+#include "latencyclock.h"
 
 G_BEGIN_DECLS
 
+/* The audio elements send every timestamp as a BFSK burst: this Barker-13
+ * preamble, MSB first, followed by the FEC-encoded rows, MSB first. */
+#define GST_AUDIO_TIMESTAMP_PREAMBLE 0x1F35
+#define GST_AUDIO_TIMESTAMP_PREAMBLE_LEN 13
+/* Every burst carries the masked send time with the frame id and the exact
+ * send time in a LATENCY_CLOCK_EXT_SEND_TIME word. */
+#define GST_AUDIO_TIMESTAMP_WORDS 2
+
 #define GST_TYPE_FEC_SCHEME (gst_fec_scheme_get_type ())
 GType gst_fec_scheme_get_type (void);
 
+/* The LatencyClockLayout of stereo frames */
+#define GST_TYPE_TIMESTAMP_STEREO_LAYOUT \
+    (gst_timestamp_stereo_layout_get_type ())
+GType gst_timestamp_stereo_layout_get_type (void);
+
+/* The elements hand their codec (see latencyclock.h) over to the streaming
+ * thread.  A codec is never modified after latency_clock_codec_new()
+ * returns, except for the msg_enc scratch buffer which belongs to the
+ * streaming thread.  Changing the scheme builds a new codec in set_property
+ * and publishes it with gst_timestamp_codec_publish(); the streaming thread
+ * picks it up with gst_timestamp_codec_acquire() at the start of the next
+ * frame and frees the old one, so the per-frame path never takes a lock. */
+void gst_timestamp_codec_publish (gpointer *pending, LatencyClockCodec *codec);
+LatencyClockCodec *gst_timestamp_codec_acquire (gpointer *pending,
+    LatencyClockCodec **active);
+
+/* The timestamp can also be carried in an H.264/H.265 byte-stream as a SEI
+ * user_data_unregistered message.  Its user data is the header word followed
+ * by the encoded rows, each as a big-endian 64-bit integer. */
+#define GST_TIMESTAMP_SEI_MAX_PAYLOAD ((1 + LATENCY_CLOCK_MAX_ROWS) * 8)
+
+GstMemory *gst_timestamp_sei_new (const LatencyClockCodec *codec,
+    const guint64 *words, gboolean h265);
+gsize gst_timestamp_sei_insert_offset (const guint8 *data, gsize size,
+    gboolean h265);
+gsize gst_timestamp_sei_find (const guint8 *data, gsize size, gboolean h265,
+    guint8 *payload);
+
+/* Where the systime of the payload, and of the receive side, is taken from.
+ * Both ends of a measurement must use the same source: the latency is the
+ * difference of two readings of it. */
+typedef enum {
+  GST_TIMESTAMP_TIME_SOURCE_REALTIME,
+  GST_TIMESTAMP_TIME_SOURCE_TAI,
+  GST_TIMESTAMP_TIME_SOURCE_PIPELINE,
+  GST_TIMESTAMP_TIME_SOURCE_NET_CLIENT,
+  GST_TIMESTAMP_TIME_SOURCE_PTP,
+} GstTimestampTimeSource;
+
+#define GST_TYPE_TIMESTAMP_TIME_SOURCE (gst_timestamp_time_source_get_type ())
+GType gst_timestamp_time_source_get_type (void);
+
+#define GST_TIMESTAMP_NET_CLOCK_DEFAULT_ADDRESS "127.0.0.1"
+#define GST_TIMESTAMP_NET_CLOCK_DEFAULT_PORT 5637
+
+/* The state behind the time-source property of an element.  The properties
+ * may only change in the NULL and READY states; the clock is created in
+ * gst_timestamp_systime_start() and only read by the streaming thread. */
+typedef struct {
+  GstTimestampTimeSource source;
+  gchar *address;       /* net-client: address of the GstNetTimeProvider */
+  gint port;
+  guint ptp_domain;
+
+  GstClock *clock;      /* net-client and ptp: the synchronised clock */
+  gboolean synced;
+
+  /* pipeline: the element clock the offset to CLOCK_REALTIME was taken
+   * from, when it was first read */
+  GstClock *pipeline_clock;
+  GstClockTimeDiff offset;
+} GstTimestampSystime;
+
+void gst_timestamp_systime_init (GstTimestampSystime *st);
+void gst_timestamp_systime_clear (GstTimestampSystime *st);
+gboolean gst_timestamp_systime_start (GstTimestampSystime *st,
+    GstElement *element);
+void gst_timestamp_systime_stop (GstTimestampSystime *st);
+GstClockTime gst_timestamp_systime_now (GstTimestampSystime *st,
+    GstElement *element);
+
+/* The time-source, net-clock-address, net-clock-port and ptp-domain
+ * properties every element reading the systime has: they take
+ * GST_TIMESTAMP_SYSTIME_N_PROPS property ids from first_prop on.  The
+ * set and get functions return FALSE for the other ids. */
+#define GST_TIMESTAMP_SYSTIME_N_PROPS 4
+
+void gst_timestamp_systime_install_properties (GObjectClass *klass,
+    guint first_prop, const gchar *time_source_blurb);
+gboolean gst_timestamp_systime_set_property (GstTimestampSystime *st,
+    guint first_prop, guint prop_id, const GValue *value);
+gboolean gst_timestamp_systime_get_property (GstTimestampSystime *st,
+    guint first_prop, guint prop_id, GValue *value);
+
+/* Online estimate of the drift between the sender's and the receiver's
+ * clock from the latencies of the frames.  The lowest latency of every
+ * window of remote time is the one least affected by queueing; a Theil-Sen
+ * fit (median of the pairwise slopes) through the last
+ * GST_TIMESTAMP_DRIFT_WINDOWS of those minima gives the drift, and the line
+ * through them the lower envelope of the latency.  The fit is only redone
+ * when a window closes, so memory and time per frame are bounded. */
+#define GST_TIMESTAMP_DRIFT_WINDOWS 32
+#define GST_TIMESTAMP_DRIFT_MIN_WINDOWS 3
+/* Frames in a row from before the current window that mean the sender
+ * restarted; fewer are taken for mis-decoded ones and skipped */
+#define GST_TIMESTAMP_DRIFT_RESTART_FRAMES 8
+
+typedef struct {
+  GstClockTime window;          /* length of a window of remote time */
+
+  GstClockTime origin;          /* remote time of the first frame */
+  GstClockTime window_start;    /* GST_CLOCK_TIME_NONE before the first */
+  GstClockTime window_time;     /* remote time of the current minimum */
+  GstClockTimeDiff window_min;
+  guint backwards;              /* frames in a row from before window_start */
+
+  /* Ring of the minima of the closed windows */
+  GstClockTime times[GST_TIMESTAMP_DRIFT_WINDOWS];
+  GstClockTimeDiff mins[GST_TIMESTAMP_DRIFT_WINDOWS];
+  guint n, next;
+
+  /* The fit: latency = ref_latency + slope * (remote time - ref_time) */
+  gboolean valid;
+  gdouble slope;
+  GstClockTime ref_time;
+  GstClockTimeDiff ref_latency;
+} GstTimestampDrift;
+
+void gst_timestamp_drift_init (GstTimestampDrift *drift, GstClockTime window);
+gboolean gst_timestamp_drift_add (GstTimestampDrift *drift,
+    GstClockTime remote_time, GstClockTimeDiff latency);
+GstClockTimeDiff gst_timestamp_drift_offset (const GstTimestampDrift *drift,
+    GstClockTime remote_time);
+GstClockTimeDiff gst_timestamp_drift_correct (const GstTimestampDrift *drift,
+    GstClockTime remote_time, GstClockTimeDiff latency);
+
+#define GST_TIMESTAMP_DRIFT_PPM(drift) ((drift)->slope * 1e6)
+
+/* The cost of an element's own work on a frame: the CLOCK_MONOTONIC time
+ * from the start to the end of transform_frame_ip and, with perf set, the
+ * CPU cycles and cache misses of the streaming thread in between from
+ * perf_event_open ().  The times go into a histogram of power-of-two
+ * buckets: bucket 0 counts the frames under 1 ns, bucket i the ones of
+ * 2^(i-1) ns up to 2^i ns and the last bucket all the longer ones.
+ * gst_timestamp_cost_begin () and gst_timestamp_cost_end () are only called
+ * by the streaming thread; the totals are protected by the object lock. */
+#define GST_TIMESTAMP_COST_BUCKETS 32
+
+typedef struct {
+  gboolean enabled;
+  gboolean perf;
+  GstClockTime interval;        /* between messages, 0 for none */
+
+  /* The frame being measured */
+  GstClockTime begin;
+  guint64 begin_cycles;
+  guint64 begin_cache_misses;
+
+  /* perf_event_open () group of the streaming thread: the cycles lead and
+   * the cache misses follow, or -1 */
+  int perf_fd;
+  int perf_cache_misses_fd;
+  GThread *perf_thread;
+
+  guint64 frames;
+  GstClockTime sum;
+  GstClockTime max;
+  guint64 cycles;
+  guint64 cache_misses;
+  guint64 histogram[GST_TIMESTAMP_COST_BUCKETS];
+  GstClockTime last_message;
+} GstTimestampCost;
+
+void gst_timestamp_cost_init (GstTimestampCost *cost);
+void gst_timestamp_cost_reset (GstTimestampCost *cost);
+void gst_timestamp_cost_close (GstTimestampCost *cost);
+void gst_timestamp_cost_begin (GstTimestampCost *cost, GstElement *element);
+GstClockTime gst_timestamp_cost_end (GstTimestampCost *cost,
+    GstElement *element, const gchar *name);
+GstStructure *gst_timestamp_cost_stats (const GstTimestampCost *cost,
+    const gchar *name);
+
+/* Adaptive FEC: timeoverlayparse sends a report like
+ *
+ *   latency-clock-fec scheme=hamming84 frames=60 errors=0 corrected=3 bits=8192
+ *
+ * as a UDP datagram every feedback interval, and timestampoverlay steps
+ * along its fec-ladder accordingly.  errors counts the frames that failed
+ * to decode to a plausible payload, corrected the bits the FEC corrected in
+ * the others and bits the encoded bits of those. */
+#define GST_TIMESTAMP_FEC_FEEDBACK_DEFAULT_PORT 5638
+#define GST_TIMESTAMP_FEC_FEEDBACK_PREFIX "latency-clock-fec"
+
+/* In RTP every packet carries a one-byte header extension element with the
+ * systime in nanoseconds (8 bytes) and the frame id (4 bytes), unencoded and
+ * big-endian.  The systime is taken when the packet is stamped and the frame
+ * id counts RTP timestamps. */
+#define GST_TIMESTAMP_RTP_HDREXT_URI "urn:latency-clock:timestamp"
+#define GST_TIMESTAMP_RTP_HDREXT_SIZE 12
+#define GST_TIMESTAMP_RTP_HDREXT_DEFAULT_ID 5
+
 G_END_DECLS
 #endif
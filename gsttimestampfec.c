@@ -0,0 +1,527 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gsttimestampfec.h"
+
+/* A systematic binary block code: k data bits followed by r parity bits,
+ * correcting up to t bit errors per symbol by syndrome lookup. */
+typedef struct {
+  guint64 data_err;
+  guint32 parity_err;
+  gboolean set;
+} Correction;
+
+typedef struct {
+  guint k;
+  guint r;
+  guint t;
+  guint32 parity[8][256];       /* parity of every value of every data byte */
+  Correction *syndromes;        /* 1 << r entries */
+} BlockCode;
+
+enum {
+  CODE_HAMMING74,
+  CODE_HAMMING84,
+  CODE_HAMMING128,
+  CODE_GOLAY2412,
+  CODE_SECDED2216,
+  CODE_SECDED3932,
+  CODE_SECDED7264,
+  N_CODES
+};
+
+static BlockCode codes[N_CODES];
+
+/* Rows of B in the generator [I | B] of the extended Golay code */
+static const guint32 golay_b[12] = {
+  0xdc5, 0xb8b, 0x717, 0xe2d, 0xc5b, 0x8b7,
+  0x16f, 0x2dd, 0x5b9, 0xb71, 0x6e3, 0xffe
+};
+
+#define RS_NROOTS 32
+#define RS_MAX_DATA (255 - RS_NROOTS)
+
+static guint8 gf_exp[512];
+static guint8 gf_log[256];
+static guint8 rs_genpoly[RS_NROOTS + 1];
+
+static guint32
+block_parity (const BlockCode *code, guint64 data)
+{
+  guint32 p = 0;
+  guint j;
+
+  for (j = 0; j * 8 < code->k; j++)
+    p ^= code->parity[j][(data >> (j * 8)) & 0xff];
+  return p;
+}
+
+static void
+add_errors (BlockCode *code, guint *pos, guint w, guint depth, guint first)
+{
+  guint q;
+
+  if (depth == w) {
+    guint64 data_err = 0;
+    guint32 parity_err = 0, syndrome;
+    guint i;
+
+    for (i = 0; i < w; i++) {
+      if (pos[i] < code->k)
+        data_err |= (guint64) 1 << pos[i];
+      else
+        parity_err |= 1U << (pos[i] - code->k);
+    }
+    syndrome = block_parity (code, data_err) ^ parity_err;
+    /* Patterns are added by increasing weight, so the lightest wins */
+    if (!code->syndromes[syndrome].set) {
+      code->syndromes[syndrome].data_err = data_err;
+      code->syndromes[syndrome].parity_err = parity_err;
+      code->syndromes[syndrome].set = TRUE;
+    }
+    return;
+  }
+  for (q = first; q < code->k + code->r; q++) {
+    pos[depth] = q;
+    add_errors (code, pos, w, depth + 1, q + 1);
+  }
+}
+
+/* columns[p] is the parity of data bit p alone */
+static void
+block_code_init (BlockCode *code, guint k, guint r, guint t,
+    const guint32 *columns)
+{
+  guint j, v, b, w, pos[3];
+
+  code->k = k;
+  code->r = r;
+  code->t = t;
+  for (j = 0; j * 8 < k; j++) {
+    for (v = 0; v < 256; v++) {
+      code->parity[j][v] = 0;
+      for (b = 0; b < 8 && j * 8 + b < k; b++) {
+        if (v & (1 << b))
+          code->parity[j][v] ^= columns[j * 8 + b];
+      }
+    }
+  }
+
+  code->syndromes = g_new0 (Correction, 1 << r);
+  code->syndromes[0].set = TRUE;
+  for (w = 1; w <= t; w++)
+    add_errors (code, pos, w, 0, 0);
+}
+
+/* The first n columns of odd weight of at least 3, which makes single and
+ * double errors distinguishable */
+static void
+hsiao_columns (guint32 *columns, guint n, guint r)
+{
+  guint32 c;
+  guint i = 0;
+
+  for (c = 1; c < (1U << r) && i < n; c++) {
+    guint w = __builtin_popcount (c);
+
+    if (w >= 3 && w % 2 == 1)
+      columns[i++] = c;
+  }
+}
+
+static void
+rs_init (void)
+{
+  guint i, j, x = 1;
+
+  for (i = 0; i < 255; i++) {
+    gf_exp[i] = x;
+    gf_log[x] = i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= 0x11d;
+  }
+  for (i = 255; i < 512; i++)
+    gf_exp[i] = gf_exp[i - 255];
+
+  /* g(x) = (x - a^1) (x - a^2) ... (x - a^32), lowest degree first */
+  memset (rs_genpoly, 0, sizeof (rs_genpoly));
+  rs_genpoly[0] = 1;
+  for (i = 1; i <= RS_NROOTS; i++) {
+    for (j = i; j > 0; j--) {
+      rs_genpoly[j] = rs_genpoly[j - 1] ^
+          (rs_genpoly[j] ? gf_exp[gf_log[rs_genpoly[j]] + i] : 0);
+    }
+    rs_genpoly[0] = gf_exp[gf_log[rs_genpoly[0]] + i];
+  }
+}
+
+static void
+fec_init (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    static const guint32 h74[4] = { 3, 5, 6, 7 };
+    static const guint32 h84[4] = { 7, 11, 13, 14 };
+    static const guint32 h128[8] = { 3, 5, 6, 7, 9, 10, 11, 12 };
+    guint32 columns[64];
+
+    block_code_init (&codes[CODE_HAMMING74], 4, 3, 1, h74);
+    block_code_init (&codes[CODE_HAMMING84], 4, 4, 1, h84);
+    block_code_init (&codes[CODE_HAMMING128], 8, 4, 1, h128);
+    block_code_init (&codes[CODE_GOLAY2412], 12, 12, 3, golay_b);
+    hsiao_columns (columns, 16, 6);
+    block_code_init (&codes[CODE_SECDED2216], 16, 6, 1, columns);
+    hsiao_columns (columns, 32, 7);
+    block_code_init (&codes[CODE_SECDED3932], 32, 7, 1, columns);
+    hsiao_columns (columns, 64, 8);
+    block_code_init (&codes[CODE_SECDED7264], 64, 8, 1, columns);
+    rs_init ();
+
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+static const BlockCode *
+block_code (fec_scheme fs)
+{
+  switch (fs) {
+  case LIQUID_FEC_HAMMING74: return &codes[CODE_HAMMING74];
+  case LIQUID_FEC_HAMMING84: return &codes[CODE_HAMMING84];
+  case LIQUID_FEC_HAMMING128: return &codes[CODE_HAMMING128];
+  case LIQUID_FEC_GOLAY2412: return &codes[CODE_GOLAY2412];
+  case LIQUID_FEC_SECDED2216: return &codes[CODE_SECDED2216];
+  case LIQUID_FEC_SECDED3932: return &codes[CODE_SECDED3932];
+  case LIQUID_FEC_SECDED7264: return &codes[CODE_SECDED7264];
+  default: return NULL;
+  }
+}
+
+/* Reads n <= 64 bits at bit offset pos, MSB first; bits past len bytes read
+ * as 0 */
+static guint64
+get_bits (const guint8 *buf, guint len, guint pos, guint n)
+{
+  guint64 v = 0;
+
+  while (n > 0) {
+    guint off = pos & 7, take = MIN (8 - off, n);
+    guint8 byte = (pos >> 3) < len ? buf[pos >> 3] : 0;
+
+    v = v << take | ((byte >> (8 - off - take)) & ((1U << take) - 1));
+    pos += take;
+    n -= take;
+  }
+  return v;
+}
+
+/* Writes the n <= 64 low bits of v at bit offset pos, MSB first, into a
+ * zeroed buf; bits past len bytes are dropped */
+static void
+put_bits (guint8 *buf, guint len, guint pos, guint n, guint64 v)
+{
+  while (n > 0) {
+    guint off = pos & 7, take = MIN (8 - off, n);
+    guint8 bits = (v >> (n - take)) & ((1U << take) - 1);
+
+    if ((pos >> 3) < len)
+      buf[pos >> 3] |= bits << (8 - off - take);
+    pos += take;
+    n -= take;
+  }
+}
+
+static guint
+block_symbols (const BlockCode *code, guint dec_len)
+{
+  return (dec_len * 8 + code->k - 1) / code->k;
+}
+
+static void
+block_encode (const BlockCode *code, guint dec_len, const guint8 *dec,
+    guint8 *enc, guint enc_len)
+{
+  guint n = code->k + code->r, s;
+
+  memset (enc, 0, enc_len);
+  for (s = 0; s < block_symbols (code, dec_len); s++) {
+    guint64 data = get_bits (dec, dec_len, s * code->k, code->k);
+
+    put_bits (enc, enc_len, s * n, code->k, data);
+    put_bits (enc, enc_len, s * n + code->k, code->r,
+        block_parity (code, data));
+  }
+}
+
+static void
+block_decode (const BlockCode *code, guint dec_len, const guint8 *enc,
+    guint enc_len, guint8 *dec)
+{
+  guint n = code->k + code->r, s;
+
+  memset (dec, 0, dec_len);
+  for (s = 0; s < block_symbols (code, dec_len); s++) {
+    guint64 data = get_bits (enc, enc_len, s * n, code->k);
+    guint32 parity = get_bits (enc, enc_len, s * n + code->k, code->r);
+    const Correction *c = &code->syndromes[block_parity (code, data) ^ parity];
+
+    /* Uncorrectable errors leave the data as received */
+    if (c->set)
+      data ^= c->data_err;
+    put_bits (dec, dec_len, s * code->k, code->k, data);
+  }
+}
+
+static guint8
+gf_mul (guint8 a, guint8 b)
+{
+  return (a && b) ? gf_exp[gf_log[a] + gf_log[b]] : 0;
+}
+
+static guint8
+gf_div (guint8 a, guint8 b)
+{
+  return a ? gf_exp[gf_log[a] + 255 - gf_log[b]] : 0;
+}
+
+static guint8
+gf_pow (guint e)
+{
+  return gf_exp[e % 255];
+}
+
+/* Evaluates p (lowest degree first, n coefficients) at x */
+static guint8
+gf_poly_eval (const guint8 *p, guint n, guint8 x)
+{
+  guint8 y = 0;
+
+  while (n-- > 0)
+    y = gf_mul (y, x) ^ p[n];
+  return y;
+}
+
+static void
+rs_encode_block (const guint8 *data, guint len, guint8 *parity)
+{
+  guint i, j;
+
+  memset (parity, 0, RS_NROOTS);
+  for (i = 0; i < len; i++) {
+    guint8 fb = data[i] ^ parity[0];
+
+    for (j = 0; j < RS_NROOTS - 1; j++)
+      parity[j] = parity[j + 1] ^ gf_mul (fb, rs_genpoly[RS_NROOTS - 1 - j]);
+    parity[RS_NROOTS - 1] = gf_mul (fb, rs_genpoly[0]);
+  }
+}
+
+/* Corrects up to RS_NROOTS / 2 byte errors in the len bytes of block (data
+ * followed by parity) in place.  Byte i is the coefficient of x^(len-1-i). */
+static void
+rs_decode_block (guint8 *block, guint len)
+{
+  guint8 s[RS_NROOTS], lambda[RS_NROOTS + 1], b[RS_NROOTS + 1];
+  guint8 t[RS_NROOTS + 1], omega[RS_NROOTS], bb = 1, d;
+  guint i, j, n, l = 0, m = 1, found = 0, positions[RS_NROOTS / 2];
+  gboolean errors = FALSE;
+
+  for (j = 0; j < RS_NROOTS; j++) {
+    s[j] = 0;
+    for (i = 0; i < len; i++)
+      s[j] = gf_mul (s[j], gf_pow (j + 1)) ^ block[i];
+    errors |= s[j] != 0;
+  }
+  if (!errors)
+    return;
+
+  /* Berlekamp-Massey */
+  memset (lambda, 0, sizeof (lambda));
+  memset (b, 0, sizeof (b));
+  lambda[0] = b[0] = 1;
+  for (n = 0; n < RS_NROOTS; n++) {
+    d = s[n];
+    for (i = 1; i <= l; i++)
+      d ^= gf_mul (lambda[i], s[n - i]);
+    if (d == 0) {
+      m++;
+      continue;
+    }
+    memcpy (t, lambda, sizeof (t));
+    for (i = m; i <= RS_NROOTS; i++)
+      lambda[i] ^= gf_mul (gf_div (d, bb), b[i - m]);
+    if (2 * l <= n) {
+      l = n + 1 - l;
+      memcpy (b, t, sizeof (b));
+      bb = d;
+      m = 1;
+    } else {
+      m++;
+    }
+  }
+  if (l > RS_NROOTS / 2)
+    return;
+
+  /* Chien search: an error at degree e makes lambda (a^-e) zero */
+  for (i = 0; i < len && found < l; i++) {
+    if (gf_poly_eval (lambda, l + 1, gf_pow (255 - i)) == 0)
+      positions[found++] = i;
+  }
+  if (found != l)
+    return;
+
+  /* Forney: omega = s * lambda mod x^NROOTS */
+  for (i = 0; i < RS_NROOTS; i++) {
+    omega[i] = 0;
+    for (j = 0; j <= i && j <= l; j++)
+      omega[i] ^= gf_mul (s[i - j], lambda[j]);
+  }
+  for (i = 0; i < found; i++) {
+    guint8 xinv = gf_pow (255 - positions[i]), num, den = 0;
+
+    num = gf_poly_eval (omega, RS_NROOTS, xinv);
+    for (j = 1; j <= l; j += 2)
+      den ^= gf_mul (lambda[j], gf_pow (gf_log[xinv] * (j - 1)));
+    if (den == 0)
+      return;
+    block[len - 1 - positions[i]] ^= gf_div (num, den);
+  }
+}
+
+gboolean
+gst_timestamp_fec_builtin (fec_scheme fs)
+{
+  switch (fs) {
+  case LIQUID_FEC_NONE:
+  case LIQUID_FEC_REP3:
+  case LIQUID_FEC_REP5:
+  case LIQUID_FEC_RS_M8:
+    return TRUE;
+  default:
+    return block_code (fs) != NULL;
+  }
+}
+
+gboolean
+gst_timestamp_fec_liquid_layout (fec_scheme fs)
+{
+  return fs == LIQUID_FEC_NONE || fs == LIQUID_FEC_REP3 ||
+      fs == LIQUID_FEC_REP5;
+}
+
+/* Length of the encoded message in bytes, or 0 if fs isn't built in */
+guint
+gst_timestamp_fec_enc_length (fec_scheme fs, guint dec_len)
+{
+  const BlockCode *code;
+
+  fec_init ();
+  switch (fs) {
+  case LIQUID_FEC_NONE:
+    return dec_len;
+  case LIQUID_FEC_REP3:
+    return 3 * dec_len;
+  case LIQUID_FEC_REP5:
+    return 5 * dec_len;
+  case LIQUID_FEC_RS_M8:
+    return dec_len + RS_NROOTS * ((dec_len + RS_MAX_DATA - 1) / RS_MAX_DATA);
+  default:
+    code = block_code (fs);
+    if (!code)
+      return 0;
+    return (block_symbols (code, dec_len) * (code->k + code->r) + 7) / 8;
+  }
+}
+
+void
+gst_timestamp_fec_encode (fec_scheme fs, guint dec_len, const guint8 *dec,
+    guint8 *enc)
+{
+  guint enc_len = gst_timestamp_fec_enc_length (fs, dec_len), i, pos;
+
+  switch (fs) {
+  case LIQUID_FEC_NONE:
+  case LIQUID_FEC_REP3:
+  case LIQUID_FEC_REP5:
+    for (i = 0; i < enc_len; i += dec_len)
+      memcpy (enc + i, dec, dec_len);
+    break;
+  case LIQUID_FEC_RS_M8:
+    for (i = 0, pos = 0; i < dec_len; i += RS_MAX_DATA) {
+      guint len = MIN (RS_MAX_DATA, dec_len - i);
+
+      memcpy (enc + pos, dec + i, len);
+      rs_encode_block (dec + i, len, enc + pos + len);
+      pos += len + RS_NROOTS;
+    }
+    break;
+  default:
+    block_encode (block_code (fs), dec_len, dec, enc, enc_len);
+    break;
+  }
+}
+
+void
+gst_timestamp_fec_decode (fec_scheme fs, guint dec_len, const guint8 *enc,
+    guint8 *dec)
+{
+  guint enc_len = gst_timestamp_fec_enc_length (fs, dec_len), i, pos;
+  guint8 block[255];
+
+  switch (fs) {
+  case LIQUID_FEC_NONE:
+    memcpy (dec, enc, dec_len);
+    break;
+  case LIQUID_FEC_REP3:
+    for (i = 0; i < dec_len; i++) {
+      guint8 a = enc[i], b = enc[i + dec_len], c = enc[i + 2 * dec_len];
+
+      dec[i] = (a & b) | (a & c) | (b & c);
+    }
+    break;
+  case LIQUID_FEC_REP5:
+    for (i = 0; i < dec_len; i++) {
+      guint8 a = enc[i], b = enc[i + dec_len], c = enc[i + 2 * dec_len];
+      guint8 d = enc[i + 3 * dec_len], e = enc[i + 4 * dec_len];
+
+      /* At least three of the five copies */
+      dec[i] = (a & b & (c | d | e)) | (a & c & (d | e)) | (a & d & e) |
+          (b & c & (d | e)) | (b & d & e) | (c & d & e);
+    }
+    break;
+  case LIQUID_FEC_RS_M8:
+    for (i = 0, pos = 0; i < dec_len; i += RS_MAX_DATA) {
+      guint len = MIN (RS_MAX_DATA, dec_len - i);
+
+      memcpy (block, enc + pos, len + RS_NROOTS);
+      rs_decode_block (block, len + RS_NROOTS);
+      memcpy (dec + i, block, len);
+      pos += len + RS_NROOTS;
+    }
+    break;
+  default:
+    block_decode (block_code (fs), dec_len, enc, enc_len, dec);
+    break;
+  }
+}
@@ -0,0 +1,78 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_TIMESTAMPFEC_H_
+#define _GST_TIMESTAMPFEC_H_
+
+#include <glib.h>
+
+#ifdef HAVE_LIQUID
+#include <liquid.h>
+#else
+/* The same values as liquid-dsp's, as they are sent in the header */
+typedef enum {
+  LIQUID_FEC_UNKNOWN = 0,
+  LIQUID_FEC_NONE,
+  LIQUID_FEC_REP3,
+  LIQUID_FEC_REP5,
+  LIQUID_FEC_HAMMING74,
+  LIQUID_FEC_HAMMING84,
+  LIQUID_FEC_HAMMING128,
+  LIQUID_FEC_GOLAY2412,
+  LIQUID_FEC_SECDED2216,
+  LIQUID_FEC_SECDED3932,
+  LIQUID_FEC_SECDED7264,
+  LIQUID_FEC_CONV_V27,
+  LIQUID_FEC_CONV_V29,
+  LIQUID_FEC_CONV_V39,
+  LIQUID_FEC_CONV_V615,
+  LIQUID_FEC_CONV_V27P23,
+  LIQUID_FEC_CONV_V27P34,
+  LIQUID_FEC_CONV_V27P45,
+  LIQUID_FEC_CONV_V27P56,
+  LIQUID_FEC_CONV_V27P67,
+  LIQUID_FEC_CONV_V27P78,
+  LIQUID_FEC_CONV_V29P23,
+  LIQUID_FEC_CONV_V29P34,
+  LIQUID_FEC_CONV_V29P45,
+  LIQUID_FEC_CONV_V29P56,
+  LIQUID_FEC_CONV_V29P67,
+  LIQUID_FEC_CONV_V29P78,
+  LIQUID_FEC_RS_M8
+} fec_scheme;
+#endif
+
+G_BEGIN_DECLS
+
+/* Built-in block codes.  The message is cut into k-bit symbols, MSB first,
+ * and every symbol is sent as its k data bits followed by its parity bits,
+ * all packed MSB first.  The parity and the syndrome decoding are looked up
+ * in tables built once.  rs_m8 is a Reed-Solomon code over GF(256) with 32
+ * parity bytes per block of up to 223 bytes.
+ *
+ * none, rep3 and rep5 are laid out the same way as by liquid-dsp; the
+ * convolutional codes are only available through liquid-dsp. */
+gboolean gst_timestamp_fec_builtin (fec_scheme fs);
+gboolean gst_timestamp_fec_liquid_layout (fec_scheme fs);
+guint gst_timestamp_fec_enc_length (fec_scheme fs, guint dec_len);
+void gst_timestamp_fec_encode (fec_scheme fs, guint dec_len,
+    const guint8 *dec, guint8 *enc);
+void gst_timestamp_fec_decode (fec_scheme fs, guint dec_len,
+    const guint8 *enc, guint8 *dec);
+
+G_END_DECLS
+#endif
@@ -54,46 +54,94 @@ static GstFlowReturn gst_timestampoverlay_transform_frame_ip (GstVideoFilter * f
     GstVideoFrame * frame);
 static gboolean gst_timestampoverlay_set_clock (GstElement * element,
     GstClock * clock);
+static gboolean gst_timestampoverlay_start (GstBaseTransform * trans);
+static gboolean gst_timestampoverlay_stop (GstBaseTransform * trans);
 
 enum
 {
   PROP_0,
-  PROP_FEC_SCHEME
+  PROP_FEC_SCHEME,
+  PROP_HEADER,
+  PROP_HISTORY,
+  PROP_TIMESTAMPS,
+  PROP_TIME_SOURCE,
+  PROP_NET_CLOCK_ADDRESS,
+  PROP_NET_CLOCK_PORT,
+  PROP_PTP_DOMAIN,
+  PROP_FEEDBACK_PORT,
+  PROP_FEC_LADDER,
+  PROP_FEC_TARGET,
+  PROP_STEREO_LAYOUT,
+  PROP_STAGE_ID,
+  PROP_APPEND,
+  PROP_MODE,
+  PROP_COST,
+  PROP_COST_PERF,
+  PROP_COST_INTERVAL,
+  PROP_COST_STATS
 };
 
-static void
-gst_timestampoverlay_set_fec_scheme (GstTimeStampOverlay *overlay,
-                                     fec_scheme fs)
+GType
+gst_timestampoverlay_timestamps_get_type (void)
 {
-  overlay->fec_scheme = fs;
+  static GType timestamps_type = 0;
+
+  if (!timestamps_type) {
+    static GFlagsValue timestamps_types[] = {
+      { GST_TIMESTAMPOVERLAY_BUFFER_TIME, "PTS of the buffer", "buffer-time" },
+      { GST_TIMESTAMPOVERLAY_STREAM_TIME, "Stream time of the buffer",
+        "stream-time" },
+      { GST_TIMESTAMPOVERLAY_RUNNING_TIME, "Running time of the buffer",
+        "running-time" },
+      { GST_TIMESTAMPOVERLAY_CLOCK_TIME, "Pipeline clock time of the buffer",
+        "clock-time" },
+      { GST_TIMESTAMPOVERLAY_RENDER_TIME,
+        "Pipeline clock time the buffer will be rendered at", "render-time" },
+      { GST_TIMESTAMPOVERLAY_RENDER_REALTIME,
+        "CLOCK_REALTIME the buffer will be rendered at", "render-realtime" },
+      { 0, NULL, NULL },
+    };
+
+    timestamps_type = g_flags_register_static ("timestamps", timestamps_types);
+  }
+
+  return timestamps_type;
+}
 
-  if (overlay->encoder) {
-      fec_destroy(overlay->encoder);
-      overlay->encoder = NULL;
+/* Builds a codec for the current fec-scheme and payload extensions.  Called
+ * with the object lock held, as the streaming thread steps the fec-scheme
+ * too, so the codec always matches the fields it was built from. */
+static void
+gst_timestampoverlay_update_codec (GstTimeStampOverlay *overlay)
+{
+  guint words = 1, i;
+  LatencyClockCodec *codec;
+
+  /* An appended band only holds the stage word */
+  if (!overlay->append) {
+    words += LATENCY_CLOCK_HISTORY_WORDS (overlay->history);
+    for (i = 0; i < GST_TIMESTAMPOVERLAY_N_TIMESTAMPS; i++)
+      words += (overlay->timestamps >> i) & 1;
+    words += overlay->mode ? 1 : 0;
+    /* The exact send time.  Without the header the parser only reads the
+     * first word */
+    words += overlay->header ? 1 : 0;
   }
-  free(overlay->msg_org);
-  free(overlay->msg_enc);
-  overlay->msg_org = NULL;
-  overlay->msg_enc = NULL;
-
-  overlay->encoder =  fec_create(fs, NULL);
-
-  // decoded message length (bytes)
-  unsigned int n = 8;
-  // compute encoded message length
-  unsigned int k = fec_get_enc_msg_length(fs, n);
-
-  overlay->fec_n = n;
-  overlay->fec_k = k;
-  overlay->msg_org = malloc(sizeof(char)* n);
-  overlay->msg_enc = malloc(sizeof(char) * (8 + k));
-  memset(overlay->msg_enc, 0, sizeof(char) * (8 + k));
-  overlay->rows = k / 8;
-  if (overlay->rows * 8 != n) {
-    overlay->rows ++;
+
+  codec = latency_clock_codec_new (overlay->fec_scheme, words);
+  /* The streaming thread packs the words from the codec alone, so a
+   * property set while it stamps can't make the two disagree */
+  if (!overlay->append) {
+    codec->history = overlay->history;
+    codec->timestamps = overlay->timestamps;
+    codec->mode = overlay->mode;
+    codec->send_time = overlay->header;
   }
+  codec->header = overlay->header;
+  codec->append = overlay->append;
   GST_INFO_OBJECT (overlay, "set_property: fec_scheme n:%u k:%u rows:%u",
-                   n, k, overlay->rows);
+                   codec->fec_n, codec->fec_k, codec->rows);
+  gst_timestamp_codec_publish (&overlay->pending_codec, codec);
 }
 
 static void
@@ -104,9 +152,69 @@ gst_timestampoverlay_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
   case PROP_FEC_SCHEME:
-    gst_timestampoverlay_set_fec_scheme (overlay, g_value_get_enum (value));
+    GST_OBJECT_LOCK (overlay);
+    overlay->fec_scheme = g_value_get_enum (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_HISTORY:
+    GST_OBJECT_LOCK (overlay);
+    overlay->history = g_value_get_uint (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_TIMESTAMPS:
+    GST_OBJECT_LOCK (overlay);
+    overlay->timestamps = g_value_get_flags (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_HEADER:
+    GST_OBJECT_LOCK (overlay);
+    overlay->header = g_value_get_boolean (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_FEEDBACK_PORT:
+    overlay->feedback_port = g_value_get_int (value);
+    break;
+  case PROP_FEC_LADDER:
+    g_free (overlay->fec_ladder);
+    overlay->fec_ladder = g_value_dup_string (value);
+    break;
+  case PROP_FEC_TARGET:
+    overlay->fec_target = g_value_get_double (value);
+    break;
+  case PROP_STEREO_LAYOUT:
+    overlay->stereo_layout = g_value_get_enum (value);
+    break;
+  case PROP_STAGE_ID:
+    overlay->stage_id = g_value_get_uint (value);
+    break;
+  case PROP_APPEND:
+    GST_OBJECT_LOCK (overlay);
+    overlay->append = g_value_get_boolean (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_MODE:
+    GST_OBJECT_LOCK (overlay);
+    overlay->mode = g_value_get_boolean (value);
+    gst_timestampoverlay_update_codec (overlay);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_COST:
+    overlay->cost.enabled = g_value_get_boolean (value);
+    break;
+  case PROP_COST_PERF:
+    overlay->cost.perf = g_value_get_boolean (value);
+    break;
+  case PROP_COST_INTERVAL:
+    overlay->cost.interval = g_value_get_uint64 (value);
     break;
   default:
+    gst_timestamp_systime_set_property (&overlay->time_source,
+        PROP_TIME_SOURCE, prop_id, value);
     break;
   }
 }
@@ -119,10 +227,59 @@ gst_timestampoverlay_get_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
   case PROP_FEC_SCHEME:
+    GST_OBJECT_LOCK (overlay);
     g_value_set_enum (value, overlay->fec_scheme);
+    GST_OBJECT_UNLOCK (overlay);
+    break;
+  case PROP_HEADER:
+    g_value_set_boolean (value, overlay->header);
+    break;
+  case PROP_HISTORY:
+    g_value_set_uint (value, overlay->history);
+    break;
+  case PROP_TIMESTAMPS:
+    g_value_set_flags (value, overlay->timestamps);
+    break;
+  case PROP_FEEDBACK_PORT:
+    g_value_set_int (value, overlay->feedback_port);
+    break;
+  case PROP_FEC_LADDER:
+    g_value_set_string (value, overlay->fec_ladder);
+    break;
+  case PROP_FEC_TARGET:
+    g_value_set_double (value, overlay->fec_target);
+    break;
+  case PROP_STEREO_LAYOUT:
+    g_value_set_enum (value, overlay->stereo_layout);
+    break;
+  case PROP_STAGE_ID:
+    g_value_set_uint (value, overlay->stage_id);
+    break;
+  case PROP_APPEND:
+    g_value_set_boolean (value, overlay->append);
+    break;
+  case PROP_MODE:
+    g_value_set_boolean (value, overlay->mode);
+    break;
+  case PROP_COST:
+    g_value_set_boolean (value, overlay->cost.enabled);
+    break;
+  case PROP_COST_PERF:
+    g_value_set_boolean (value, overlay->cost.perf);
+    break;
+  case PROP_COST_INTERVAL:
+    g_value_set_uint64 (value, overlay->cost.interval);
+    break;
+  case PROP_COST_STATS:
+    GST_OBJECT_LOCK (overlay);
+    g_value_take_boxed (value, gst_timestamp_cost_stats (&overlay->cost,
+            "timestampoverlay-cost"));
+    GST_OBJECT_UNLOCK (overlay);
     break;
   default:
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    if (!gst_timestamp_systime_get_property (&overlay->time_source,
+            PROP_TIME_SOURCE, prop_id, value))
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
   }
 }
@@ -176,10 +333,114 @@ gst_timestampoverlay_class_init (GstTimeStampOverlayClass * klass)
                        "FEC Scheme to use",
                        GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HEADER,
+    g_param_spec_boolean ("header", "Header",
+                          "Draw a header row describing the payload so "
+                          "timeoverlayparse can detect the fec-scheme, and "
+                          "send the exact send time along with it",
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HISTORY,
+    g_param_spec_uint ("history", "History",
+                       "Number of previous frames whose send times are "
+                       "repeated in every frame, so timeoverlayparse can "
+                       "account for dropped frames.  Needs the header",
+                       0, LATENCY_CLOCK_HISTORY_LEN - 1, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TIMESTAMPS,
+    g_param_spec_flags ("timestamps", "Timestamps",
+                        "Timestamps to send in addition to the systime, "
+                        "one FEC-protected word each.  Needs the header",
+                        GST_TYPE_TIMESTAMPOVERLAY_TIMESTAMPS, 0,
+                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MODE,
+    g_param_spec_boolean ("mode", "Mode",
+                          "Send the width, height and framerate of the "
+                          "video in a FEC-protected word, so results can "
+                          "be told apart when the mode changes.  Needs the "
+                          "header",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STEREO_LAYOUT,
+    g_param_spec_enum ("stereo-layout", "Stereo layout",
+                       "How the eye views are packed into the frame.  "
+                       "Every eye view gets its own code block, with the "
+                       "eye in its header",
+                       GST_TYPE_TIMESTAMP_STEREO_LAYOUT,
+                       LATENCY_CLOCK_LAYOUT_MONO,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STAGE_ID,
+    g_param_spec_uint ("stage-id", "Stage id",
+                       "Id of this hop in the band it appends.  The code "
+                       "block itself is stage 0",
+                       0, LATENCY_CLOCK_MAX_STAGES - 1, 1,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_APPEND,
+    g_param_spec_boolean ("append", "Append",
+                          "Leave the code block of an earlier "
+                          "timestampoverlay and the bands of earlier hops "
+                          "alone and append a band with stage-id and the "
+                          "systime below them",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  gst_timestamp_systime_install_properties (gobject_class, PROP_TIME_SOURCE,
+      "Clock the systime sent in every frame is read from.  "
+      "timeoverlayparse must use the same source");
+
+  g_object_class_install_property (gobject_class, PROP_FEEDBACK_PORT,
+    g_param_spec_int ("feedback-port", "Feedback port",
+                      "UDP port to receive the reports of timeoverlayparse "
+                      "on and adapt the fec-scheme to, or 0 to keep the "
+                      "fec-scheme.  Needs the header",
+                      0, 65535, 0,
+                      G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                      G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FEC_LADDER,
+    g_param_spec_string ("fec-ladder", "FEC ladder",
+                         "Comma-separated fec-schemes the adaptive FEC "
+                         "steps along, lightest first",
+                         GST_TIMESTAMPOVERLAY_DEFAULT_FEC_LADDER,
+                         G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FEC_TARGET,
+    g_param_spec_double ("fec-target", "FEC target",
+                         "Fraction of frames that must decode for the "
+                         "adaptive FEC not to step to a heavier scheme",
+                         0.0, 1.0, 0.99,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_COST,
+    g_param_spec_boolean ("cost", "Cost",
+                          "Measure how long stamping every frame takes and "
+                          "post timestampoverlay-cost messages",
+                          FALSE,
+                          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_PERF,
+    g_param_spec_boolean ("cost-perf", "Cost perf counters",
+                          "Also count the CPU cycles and cache misses of "
+                          "stamping with perf_event_open ()",
+                          FALSE,
+                          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+                          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_INTERVAL,
+    g_param_spec_uint64 ("cost-interval", "Cost interval",
+                         "Nanoseconds between timestampoverlay-cost "
+                         "messages, or 0 for none",
+                         0, G_MAXUINT64, GST_SECOND,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COST_STATS,
+    g_param_spec_boxed ("cost-stats", "Cost statistics",
+                        "Frames, mean and max time in ns, perf counters "
+                        "and log2 histogram of the time of stamping",
+                        GST_TYPE_STRUCTURE,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_timestampoverlay_dispose);
   gstelement_class->set_clock = GST_DEBUG_FUNCPTR (gst_timestampoverlay_set_clock);
   base_transform_class->src_event = GST_DEBUG_FUNCPTR (gst_timestampoverlay_src_event);
+  base_transform_class->start = GST_DEBUG_FUNCPTR (gst_timestampoverlay_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_timestampoverlay_stop);
   video_filter_class->transform_frame_ip = GST_DEBUG_FUNCPTR (gst_timestampoverlay_transform_frame_ip);
 }
 
@@ -195,10 +456,26 @@ gst_timestampoverlay_init (GstTimeStampOverlay *overlay)
   GST_OBJECT_FLAG_SET (overlay->realtime_clock,
       GST_CLOCK_FLAG_CAN_SET_MASTER);
 
-  overlay->encoder = NULL;
-  overlay->msg_org = NULL;
-  overlay->msg_enc = NULL;
-  gst_timestampoverlay_set_fec_scheme (overlay, LIQUID_FEC_NONE);
+  overlay->header = TRUE;
+  overlay->history = 0;
+  overlay->timestamps = 0;
+  overlay->stereo_layout = LATENCY_CLOCK_LAYOUT_MONO;
+  overlay->stage_id = 1;
+  overlay->append = FALSE;
+  overlay->mode = FALSE;
+  overlay->fec_scheme = LIQUID_FEC_NONE;
+  overlay->codec = NULL;
+  overlay->pending_codec = NULL;
+  gst_timestampoverlay_update_codec (overlay);
+  gst_timestamp_systime_init (&overlay->time_source);
+
+  overlay->feedback_port = 0;
+  overlay->fec_ladder = g_strdup (GST_TIMESTAMPOVERLAY_DEFAULT_FEC_LADDER);
+  overlay->fec_target = 0.99;
+  overlay->ladder_len = 0;
+  overlay->clean_reports = 0;
+  overlay->feedback_socket = NULL;
+  gst_timestamp_cost_init (&overlay->cost);
 }
 
 static void
@@ -207,13 +484,189 @@ gst_timestampoverlay_dispose (GObject *object)
   GstTimeStampOverlay *timeoverlay = GST_TIMESTAMPOVERLAY (object);
   g_clear_object (&timeoverlay->realtime_clock);
 
-  if (timeoverlay->encoder) {
-    fec_destroy(timeoverlay->encoder);
+  latency_clock_codec_free (timeoverlay->codec);
+  timeoverlay->codec = NULL;
+  gst_timestamp_codec_publish (&timeoverlay->pending_codec, NULL);
+  gst_timestamp_systime_clear (&timeoverlay->time_source);
+  g_clear_pointer (&timeoverlay->fec_ladder, g_free);
+  g_clear_object (&timeoverlay->feedback_socket);
+
+  G_OBJECT_CLASS (gst_timestampoverlay_parent_class)->dispose (object);
+}
+
+/* Parses fec-ladder and opens the socket the reports arrive on */
+static gboolean
+gst_timestampoverlay_start_feedback (GstTimeStampOverlay *overlay)
+{
+  GEnumClass *klass = g_type_class_ref (GST_TYPE_FEC_SCHEME);
+  GSocketAddress *address;
+  GInetAddress *any;
+  GError *err = NULL;
+  gchar **nicks;
+  guint i;
+
+  overlay->ladder_len = 0;
+  overlay->clean_reports = 0;
+  nicks = g_strsplit (overlay->fec_ladder ? overlay->fec_ladder : "", ",", -1);
+  for (i = 0; nicks[i]; i++) {
+    GEnumValue *value = g_enum_get_value_by_nick (klass, g_strstrip (nicks[i]));
+
+    if (!value || value->value == LIQUID_FEC_UNKNOWN) {
+      GST_WARNING_OBJECT (overlay, "Unknown fec-scheme %s in fec-ladder",
+          nicks[i]);
+      continue;
+    }
+    if (overlay->ladder_len < GST_TIMESTAMPOVERLAY_MAX_FEC_LADDER)
+      overlay->ladder[overlay->ladder_len++] = value->value;
+  }
+  g_strfreev (nicks);
+  g_type_class_unref (klass);
+  if (overlay->ladder_len == 0) {
+    GST_ELEMENT_ERROR (overlay, LIBRARY, SETTINGS, (NULL),
+        ("No fec-scheme in fec-ladder %s", overlay->fec_ladder));
+    return FALSE;
+  }
+
+  overlay->feedback_socket = g_socket_new (G_SOCKET_FAMILY_IPV4,
+      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+  if (overlay->feedback_socket) {
+    any = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+    address = g_inet_socket_address_new (any, overlay->feedback_port);
+    if (!g_socket_bind (overlay->feedback_socket, address, TRUE, &err))
+      g_clear_object (&overlay->feedback_socket);
+    g_object_unref (address);
+    g_object_unref (any);
+  }
+  if (!overlay->feedback_socket) {
+    GST_ELEMENT_ERROR (overlay, RESOURCE, OPEN_READ, (NULL),
+        ("Failed to listen on UDP port %d: %s", overlay->feedback_port,
+            err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+  /* Polled once a frame from the streaming thread */
+  g_socket_set_blocking (overlay->feedback_socket, FALSE);
+  GST_INFO_OBJECT (overlay, "Adapting the fec-scheme to the reports on "
+      "port %d", overlay->feedback_port);
+  return TRUE;
+}
+
+/* Moves the fec-scheme step rungs along the ladder, towards the heavier
+ * schemes for positive steps */
+static void
+gst_timestampoverlay_step_fec (GstTimeStampOverlay *overlay, gint step)
+{
+  gint i, pos = -1;
+
+  /* The application may set the fec-scheme at the same time */
+  GST_OBJECT_LOCK (overlay);
+  for (i = 0; i < (gint) overlay->ladder_len; i++) {
+    if (overlay->ladder[i] == overlay->fec_scheme)
+      pos = i;
+  }
+  /* A fec-scheme that isn't on the ladder steps onto its first rung */
+  pos = CLAMP (pos + step, 0, (gint) overlay->ladder_len - 1);
+  if (overlay->ladder[pos] == overlay->fec_scheme) {
+    GST_OBJECT_UNLOCK (overlay);
+    return;
+  }
+
+  GST_INFO_OBJECT (overlay, "Stepping %s to fec_scheme %d",
+      step > 0 ? "up" : "down", overlay->ladder[pos]);
+  overlay->fec_scheme = overlay->ladder[pos];
+  gst_timestampoverlay_update_codec (overlay);
+  GST_OBJECT_UNLOCK (overlay);
+  g_object_notify (G_OBJECT (overlay), "fec-scheme");
+}
+
+/* Acts on a report of timeoverlayparse.  Reports on any other scheme than
+ * the current one are from before the last step and are ignored. */
+static void
+gst_timestampoverlay_handle_report (GstTimeStampOverlay *overlay,
+    const gchar *report)
+{
+  GEnumClass *klass;
+  GEnumValue *scheme = NULL;
+  fec_scheme current;
+  guint64 frames = 0, errors = 0, corrected = 0;
+  gchar **fields = g_strsplit (report, " ", -1);
+  guint i;
+
+  if (!fields[0] || g_strcmp0 (fields[0], GST_TIMESTAMP_FEC_FEEDBACK_PREFIX)) {
+    GST_DEBUG_OBJECT (overlay, "Ignoring datagram %s", report);
+    g_strfreev (fields);
+    return;
+  }
+  klass = g_type_class_ref (GST_TYPE_FEC_SCHEME);
+  for (i = 1; fields[i]; i++) {
+    if (g_str_has_prefix (fields[i], "scheme="))
+      scheme = g_enum_get_value_by_nick (klass, fields[i] + 7);
+    else if (g_str_has_prefix (fields[i], "frames="))
+      frames = g_ascii_strtoull (fields[i] + 7, NULL, 10);
+    else if (g_str_has_prefix (fields[i], "errors="))
+      errors = g_ascii_strtoull (fields[i] + 7, NULL, 10);
+    else if (g_str_has_prefix (fields[i], "corrected="))
+      corrected = g_ascii_strtoull (fields[i] + 10, NULL, 10);
+  }
+  g_type_class_unref (klass);
+  g_strfreev (fields);
+
+  GST_DEBUG_OBJECT (overlay, "Report: %s", report);
+  GST_OBJECT_LOCK (overlay);
+  current = overlay->fec_scheme;
+  GST_OBJECT_UNLOCK (overlay);
+  if (!scheme || scheme->value != current || frames == 0)
+    return;
+
+  if (1.0 - (gdouble) errors / frames < overlay->fec_target) {
+    overlay->clean_reports = 0;
+    gst_timestampoverlay_step_fec (overlay, 1);
+  } else if (errors == 0 && corrected == 0) {
+    /* Nothing needed correcting for a while: a lighter scheme will do */
+    if (++overlay->clean_reports >= GST_TIMESTAMPOVERLAY_FEC_CLEAN_REPORTS) {
+      overlay->clean_reports = 0;
+      gst_timestampoverlay_step_fec (overlay, -1);
+    }
+  } else {
+    overlay->clean_reports = 0;
+  }
+}
+
+static void
+gst_timestampoverlay_poll_feedback (GstTimeStampOverlay *overlay)
+{
+  gchar buf[256];
+  gssize len;
+
+  while ((len = g_socket_receive (overlay->feedback_socket, buf,
+              sizeof (buf) - 1, NULL, NULL)) > 0) {
+    buf[len] = '\0';
+    gst_timestampoverlay_handle_report (overlay, g_strchomp (buf));
   }
-  free(timeoverlay->msg_org);
-  free(timeoverlay->msg_enc);
-  timeoverlay->msg_org = NULL;
-  timeoverlay->msg_enc = NULL;
+}
+
+static gboolean
+gst_timestampoverlay_start (GstBaseTransform * trans)
+{
+  GstTimeStampOverlay *overlay = GST_TIMESTAMPOVERLAY (trans);
+
+  if (overlay->feedback_port > 0 &&
+      !gst_timestampoverlay_start_feedback (overlay))
+    return FALSE;
+  gst_timestamp_cost_reset (&overlay->cost);
+  return gst_timestamp_systime_start (&overlay->time_source,
+      GST_ELEMENT (overlay));
+}
+
+static gboolean
+gst_timestampoverlay_stop (GstBaseTransform * trans)
+{
+  GstTimeStampOverlay *overlay = GST_TIMESTAMPOVERLAY (trans);
+
+  gst_timestamp_systime_stop (&overlay->time_source);
+  g_clear_object (&overlay->feedback_socket);
+  gst_timestamp_cost_close (&overlay->cost);
+  return TRUE;
 }
 
 static gboolean
@@ -261,79 +714,200 @@ gst_timestampoverlay_set_clock (GstElement * element, GstClock * clock)
       clock);
 }
 
+/* Fills words[1..] with the history extension for the frame that is about to
+ * be sent at systime */
 static void
-draw_timestamp(int lineoffset, GstClockTime timestamp, unsigned char* buf,
-    size_t stride, int pxsize)
+gst_timestampoverlay_pack_history (GstTimeStampOverlay *overlay,
+    LatencyClockCodec *codec, GstClockTime systime, guint64 *words)
 {
-  int bit, line;
-  buf += lineoffset * 8 * stride;
-
-  for (line = 0; line < 8; line++) {
-    for (bit = 0; bit < 64; bit++) {
-      char color = ((timestamp >> (63 - bit)) & 1) * 255;
-      memset(buf + bit * pxsize * 8, color, pxsize * 8);
+  guint w, i, j = 1;
+  guint end = MIN (1 + LATENCY_CLOCK_HISTORY_WORDS (codec->history),
+      codec->words);
+
+  for (w = 1; w < end; w++) {
+    guint64 data = 0;
+
+    for (i = 0; i < LATENCY_CLOCK_HISTORY_PER_WORD; i++, j++) {
+      guint64 delta = LATENCY_CLOCK_HISTORY_UNKNOWN;
+
+      if (j <= codec->history && j < overlay->frame_id) {
+        delta = (systime -
+            overlay->sent[(overlay->frame_id - j) % LATENCY_CLOCK_HISTORY_LEN])
+            / 1000;
+        delta = MIN (delta, LATENCY_CLOCK_HISTORY_UNKNOWN - 1);
+      }
+      data = data << LATENCY_CLOCK_HISTORY_BITS | delta;
     }
-    buf += stride;
+    words[w] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_HISTORY, data);
   }
 }
 
-static GstFlowReturn
-gst_timestampoverlay_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
+/* Appends the selected timestamps of the frame to words, starting at
+ * words[first].  Returns the index of the next word. */
+static guint
+gst_timestampoverlay_pack_timestamps (GstTimeStampOverlay *overlay,
+    LatencyClockCodec *codec, GstBuffer *buffer, guint64 *words, guint first)
 {
-  GstTimeStampOverlay *overlay = GST_TIMESTAMPOVERLAY (filter);
+  GstSegment *segment = &GST_BASE_TRANSFORM (overlay)->segment;
+  GstClockTime times[GST_TIMESTAMPOVERLAY_N_TIMESTAMPS];
+  GstClockTime latency, internal, external, rate_num, rate_denom;
+  guint i, w = first;
+
+  GST_OBJECT_LOCK (overlay);
+  latency = overlay->latency;
+  GST_OBJECT_UNLOCK (overlay);
+
+  times[0] = GST_BUFFER_PTS (buffer);
+  times[1] = gst_segment_to_stream_time (segment, GST_FORMAT_TIME, times[0]);
+  times[2] = gst_segment_to_running_time (segment, GST_FORMAT_TIME, times[0]);
+  times[3] = GST_CLOCK_TIME_IS_VALID (times[2]) ?
+      times[2] + gst_element_get_base_time (GST_ELEMENT (overlay)) : GST_CLOCK_TIME_NONE;
+  times[4] = GST_CLOCK_TIME_IS_VALID (times[3]) &&
+      GST_CLOCK_TIME_IS_VALID (latency) ? times[3] + latency :
+      GST_CLOCK_TIME_NONE;
+  /* realtime_clock is slaved to the pipeline clock, so its calibration maps
+   * pipeline clock time to CLOCK_REALTIME */
+  gst_clock_get_calibration (overlay->realtime_clock, &internal, &external,
+      &rate_num, &rate_denom);
+  times[5] = GST_CLOCK_TIME_IS_VALID (times[4]) ?
+      gst_clock_unadjust_with_calibration (overlay->realtime_clock, times[4],
+          internal, external, rate_num, rate_denom) : GST_CLOCK_TIME_NONE;
+
+  for (i = 0; i < GST_TIMESTAMPOVERLAY_N_TIMESTAMPS && w < codec->words; i++) {
+    if (codec->timestamps & (1 << i))
+      words[w++] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_BUFFER_TIME + i,
+          times[i]);
+  }
+  return w;
+}
 
-  GST_DEBUG_OBJECT (overlay, "transform_frame_ip");
+/* The mode of the frame as negotiated, for telling the results of a mode
+ * sweep apart */
+static guint64
+gst_timestampoverlay_mode_word (GstVideoFrame *frame)
+{
+  guint width = GST_VIDEO_FRAME_WIDTH (frame);
+  guint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  guint fps_n = GST_VIDEO_INFO_FPS_N (&frame->info);
+  guint fps_d = GST_VIDEO_INFO_FPS_D (&frame->info);
+
+  if (!LATENCY_CLOCK_MODE_FITS (width, height, fps_n, fps_d)) {
+    fps_n = 0;
+    fps_d = 1;
+  }
+  return LATENCY_CLOCK_MODE (width, height, fps_n, fps_d);
+}
+
+/* append=true: adds this hop's band to every eye view, below what the
+ * earlier hops drew */
+static GstFlowReturn
+gst_timestampoverlay_append (GstTimeStampOverlay *overlay,
+    LatencyClockCodec *codec, GstVideoFrame *frame, GstClockTime systime)
+{
+  guint64 word = LATENCY_CLOCK_STAGE (overlay->stage_id, systime);
+  guint eye, first_eye, last_eye;
+
+  first_eye = overlay->stereo_layout == LATENCY_CLOCK_LAYOUT_MONO ?
+      LATENCY_CLOCK_EYE_NONE : LATENCY_CLOCK_EYE_LEFT;
+  last_eye = overlay->stereo_layout == LATENCY_CLOCK_LAYOUT_MONO ?
+      LATENCY_CLOCK_EYE_NONE : LATENCY_CLOCK_EYE_RIGHT;
+  for (eye = first_eye; eye <= last_eye; eye++) {
+    gint width = GST_VIDEO_FRAME_WIDTH (frame);
+    gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+    guint8 *data = latency_clock_view (GST_VIDEO_FRAME_PLANE_DATA (frame, 0),
+        &width, &height, frame->info.stride[0],
+        frame->info.finfo->pixel_stride[0], overlay->stereo_layout, eye);
+
+    if (!latency_clock_append (codec, word, eye, data, width, height,
+            frame->info.stride[0], frame->info.finfo->pixel_stride[0])) {
+      GST_WARNING_OBJECT (overlay, "Can't append stage %u: no code block or "
+          "no room below it", overlay->stage_id);
+      return GST_FLOW_OK;
+    }
+  }
+  GST_INFO_OBJECT (overlay, "stage %u systime: %" G_GUINT64_FORMAT,
+      overlay->stage_id, systime);
+  return GST_FLOW_OK;
+}
 
-  struct timespec systime_st;
+static GstFlowReturn
+gst_timestampoverlay_stamp (GstTimeStampOverlay *overlay,
+    GstVideoFrame *frame)
+{
+  GstVideoFilter *filter = GST_VIDEO_FILTER (overlay);
+  LatencyClockCodec *codec;
   GstClockTime systime0;
   uint64_t systime;
+  guint64 words[LATENCY_CLOCK_MAX_WORDS] = { 0 };
+  guint eye, first_eye, last_eye, w;
   GstSegment *segment = &GST_BASE_TRANSFORM (overlay)->segment;
-  unsigned char * imgdata;
-
 
   if (frame->info.stride[0] < (8 * frame->info.finfo->pixel_stride[0] * 64)) {
     GST_WARNING_OBJECT (filter, "Can't draw timestamps: video-frame is to narrow");
     return GST_FLOW_OK;
   }
 
-  clock_gettime(CLOCK_REALTIME, &systime_st);
-  systime0 = (GstClockTime)systime_st.tv_sec * 1000000000 + systime_st.tv_nsec;
-  systime = (uint64_t)systime0 & 0xFFffFFffFF000000ULL;
+  systime0 = gst_timestamp_systime_now (&overlay->time_source,
+      GST_ELEMENT (overlay));
+  if (overlay->feedback_socket && !overlay->append)
+    gst_timestampoverlay_poll_feedback (overlay);
+  codec = gst_timestamp_codec_acquire (&overlay->pending_codec,
+      &overlay->codec);
+  if (codec->append)
+    return gst_timestampoverlay_append (overlay, codec, frame, systime0);
+  systime = (uint64_t)systime0 & LATENCY_CLOCK_SYSTIME_MASK;
 
   overlay->frame_id++;
-  systime |= overlay->frame_id;
+  systime |= overlay->frame_id & LATENCY_CLOCK_FRAME_ID_MASK;
   GST_INFO_OBJECT (filter, "systime: %" PRIx64 ", frame_id: %" PRIx64,
                    systime, overlay->frame_id);
 
-
-  if (overlay->fec_k > 0) {
-    fec_encode(overlay->encoder, overlay->fec_n,
-               (unsigned char*)&systime, overlay->msg_enc);
-  } else {
-    // scheme == unknown, or some other corner case.
-    memcpy(overlay->msg_enc, &systime, sizeof(systime));
+  words[0] = systime;
+  gst_timestampoverlay_pack_history (overlay, codec, systime0, words);
+  w = gst_timestampoverlay_pack_timestamps (overlay, codec, frame->buffer,
+      words, 1 + LATENCY_CLOCK_HISTORY_WORDS (codec->history));
+  if (codec->mode && w < codec->words)
+    words[w++] = gst_timestampoverlay_mode_word (frame);
+  if (codec->send_time && w < codec->words)
+    words[w] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_SEND_TIME, systime0);
+  overlay->sent[overlay->frame_id % LATENCY_CLOCK_HISTORY_LEN] = systime0;
+
+  /* Both eyes of a stereo frame carry the same payload, each in the middle
+   * of its own view */
+  first_eye = overlay->stereo_layout == LATENCY_CLOCK_LAYOUT_MONO ?
+      LATENCY_CLOCK_EYE_NONE : LATENCY_CLOCK_EYE_LEFT;
+  last_eye = overlay->stereo_layout == LATENCY_CLOCK_LAYOUT_MONO ?
+      LATENCY_CLOCK_EYE_NONE : LATENCY_CLOCK_EYE_RIGHT;
+  for (eye = first_eye; eye <= last_eye; eye++) {
+    gint width = GST_VIDEO_FRAME_WIDTH (frame);
+    gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+    guint8 *data = latency_clock_view (GST_VIDEO_FRAME_PLANE_DATA (frame, 0),
+        &width, &height, frame->info.stride[0],
+        frame->info.finfo->pixel_stride[0], overlay->stereo_layout, eye);
+
+    if (!latency_clock_stamp (codec, words, codec->header, eye, data,
+            width, height, frame->info.stride[0],
+            frame->info.finfo->pixel_stride[0])) {
+      GST_WARNING_OBJECT (filter, "Can't draw timestamps: the view is too "
+          "small for %u rows", codec->rows);
+      return GST_FLOW_OK;
+    }
   }
 
-  imgdata = frame->data[0];
-
-  /* Centre Vertically: */
-  unsigned int rows = overlay->rows;
-  imgdata += (frame->info.height - rows * 8) * frame->info.stride[0] / 2;
-
-  /* Centre Horizontally: */
-  imgdata += (frame->info.width - 64 * 8) * frame->info.finfo->pixel_stride[0]
-      / 2;
+  return GST_FLOW_OK;
+}
 
+static GstFlowReturn
+gst_timestampoverlay_transform_frame_ip (GstVideoFilter * filter, GstVideoFrame * frame)
+{
+  GstTimeStampOverlay *overlay = GST_TIMESTAMPOVERLAY (filter);
+  GstFlowReturn ret;
 
-  uint64_t *msg = (uint64_t*)overlay->msg_enc;
-  for (int r = 0; r < overlay->rows; r++) {
-    uint64_t part = msg[r];
-    draw_timestamp (r,
-                    part,
-                    imgdata,
-                    frame->info.stride[0],
-                    frame->info.finfo->pixel_stride[0]);
-  }
+  GST_DEBUG_OBJECT (overlay, "transform_frame_ip");
 
-  return GST_FLOW_OK;
+  gst_timestamp_cost_begin (&overlay->cost, GST_ELEMENT (overlay));
+  ret = gst_timestampoverlay_stamp (overlay, frame);
+  gst_timestamp_cost_end (&overlay->cost, GST_ELEMENT (overlay),
+      "timestampoverlay-cost");
+  return ret;
 }
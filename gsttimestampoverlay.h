@@ -22,8 +22,7 @@
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
-
-#include <liquid.h>
+#include <gio/gio.h>
 
 #include "gsttimestampcommon.h"
 
@@ -38,6 +37,30 @@ G_BEGIN_DECLS
 typedef struct _GstTimeStampOverlay GstTimeStampOverlay;
 typedef struct _GstTimeStampOverlayClass GstTimeStampOverlayClass;
 
+/* Timestamps that can be sent in addition to the systime.  Flag 1 << i is
+ * sent as extension LATENCY_CLOCK_EXT_BUFFER_TIME + i. */
+typedef enum {
+  GST_TIMESTAMPOVERLAY_BUFFER_TIME = (1 << 0),
+  GST_TIMESTAMPOVERLAY_STREAM_TIME = (1 << 1),
+  GST_TIMESTAMPOVERLAY_RUNNING_TIME = (1 << 2),
+  GST_TIMESTAMPOVERLAY_CLOCK_TIME = (1 << 3),
+  GST_TIMESTAMPOVERLAY_RENDER_TIME = (1 << 4),
+  GST_TIMESTAMPOVERLAY_RENDER_REALTIME = (1 << 5),
+} GstTimeStampOverlayTimestamps;
+
+#define GST_TIMESTAMPOVERLAY_N_TIMESTAMPS 6
+
+/* Steps of the adaptive FEC, lightest first */
+#define GST_TIMESTAMPOVERLAY_DEFAULT_FEC_LADDER \
+    "none,secdec7264,hamming128,hamming84,golay2421,rep5,rs_m8"
+#define GST_TIMESTAMPOVERLAY_MAX_FEC_LADDER 16
+/* Reports without a single error or correction before stepping lighter */
+#define GST_TIMESTAMPOVERLAY_FEC_CLEAN_REPORTS 5
+
+#define GST_TYPE_TIMESTAMPOVERLAY_TIMESTAMPS \
+    (gst_timestampoverlay_timestamps_get_type ())
+GType gst_timestampoverlay_timestamps_get_type (void);
+
 struct _GstTimeStampOverlay
 {
   GstVideoFilter base_timestampoverlay;
@@ -46,13 +69,30 @@ struct _GstTimeStampOverlay
   GstClockTime latency;
   GstClock *realtime_clock;
   fec_scheme fec_scheme;
-  fec encoder;
-  unsigned int rows;
-  unsigned int fec_n;
-  unsigned int fec_k;
-  unsigned char *msg_org;
-  unsigned char *msg_enc;
+  guint history;
+  GstTimeStampOverlayTimestamps timestamps;
+  gboolean header;
+  LatencyClockLayout stereo_layout;
+  guint stage_id;
+  gboolean append;
+  gboolean mode;
+  GstTimestampSystime time_source;
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+
+  /* Adaptive FEC, driven by the reports of timeoverlayparse */
+  gint feedback_port;
+  gchar *fec_ladder;
+  gdouble fec_target;
+  fec_scheme ladder[GST_TIMESTAMPOVERLAY_MAX_FEC_LADDER];
+  guint ladder_len;
+  guint clean_reports;
+  GSocket *feedback_socket;
+
+  GstTimestampCost cost;
 
+  /* systime of the last LATENCY_CLOCK_HISTORY_LEN frames, by frame id */
+  GstClockTime sent[LATENCY_CLOCK_HISTORY_LEN];
 };
 
 struct _GstTimeStampOverlayClass
@@ -0,0 +1,309 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * SECTION:element-gsttimestampreflect
+ *
+ * The timestampreflect element sends the timestamps of timestampoverlay
+ * back to where they came from.  It reads the payload of every frame like
+ * timeoverlayparse and draws a new one in its place, like timestampoverlay,
+ * holding the first word it read and the time it took from reading it to
+ * drawing the reflection.  A timeoverlayparse on the sending host that
+ * captures the reflected video then measures the round-trip time against
+ * its own clock only, with the hold time subtracted.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 v4l2src ! videoconvert ! timestampreflect ! videoconvert ! autovideosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include "gsttimestampreflect.h"
+
+#include <inttypes.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_timestampreflect_debug_category);
+#define GST_CAT_DEFAULT gst_timestampreflect_debug_category
+
+/* prototypes */
+static void gst_timestampreflect_dispose (GObject *object);
+static GstFlowReturn gst_timestampreflect_transform_frame_ip (GstVideoFilter *
+    filter, GstVideoFrame * frame);
+
+enum
+{
+  PROP_0,
+  PROP_FEC_SCHEME,
+  PROP_HEADER
+};
+
+/* The reflection is the first word that was read, the exact send time (or
+ * an empty word if the sender didn't send one) and the hold time */
+#define REFLECT_WORDS 3
+
+static void
+gst_timestampreflect_set_fec_scheme (GstTimestampReflect *reflect,
+                                     fec_scheme fs)
+{
+  LatencyClockCodec *codec = latency_clock_codec_new (fs, 1);
+  LatencyClockCodec *reflect_codec = latency_clock_codec_new (fs,
+      REFLECT_WORDS);
+
+  reflect->fec_scheme = fs;
+  GST_INFO_OBJECT (reflect, "set_property: fec_scheme n:%u k:%u rows:%u",
+                   reflect_codec->fec_n, reflect_codec->fec_k,
+                   reflect_codec->rows);
+  gst_timestamp_codec_publish (&reflect->pending_codec, codec);
+  gst_timestamp_codec_publish (&reflect->pending_reflect_codec,
+      reflect_codec);
+}
+
+static void
+gst_timestampreflect_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstTimestampReflect *reflect = GST_TIMESTAMPREFLECT (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    gst_timestampreflect_set_fec_scheme (reflect, g_value_get_enum (value));
+    break;
+  case PROP_HEADER:
+    reflect->header = g_value_get_boolean (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+gst_timestampreflect_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstTimestampReflect *reflect = GST_TIMESTAMPREFLECT (object);
+
+  switch (prop_id) {
+  case PROP_FEC_SCHEME:
+    g_value_set_enum (value, reflect->fec_scheme);
+    break;
+  case PROP_HEADER:
+    g_value_set_boolean (value, reflect->header);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
+/* pad templates */
+
+/* Formats both timestampoverlay and timeoverlayparse handle */
+#define VIDEO_CAPS \
+    GST_VIDEO_CAPS_MAKE("{RGB, xRGB, BGR, BGRx}")
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstTimestampReflect, gst_timestampreflect,
+  GST_TYPE_VIDEO_FILTER,
+  GST_DEBUG_CATEGORY_INIT (gst_timestampreflect_debug_category,
+  "timestampreflect", 0,
+  "debug category for timestampreflect element"));
+
+static void
+gst_timestampreflect_class_init (GstTimestampReflectClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        gst_caps_from_string (VIDEO_CAPS)));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        gst_caps_from_string (VIDEO_CAPS)));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "TimestampReflect", "Generic",
+      "Draws the timestamps read off the video back onto it, with the time "
+      "they were held for, so their sender can measure the round-trip time",
+      "Felician Nemeth <nemethf@tmit.bme.hu>");
+
+  gobject_class->set_property = gst_timestampreflect_set_property;
+  gobject_class->get_property = gst_timestampreflect_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FEC_SCHEME,
+    g_param_spec_enum ("fec-scheme", "Foward Error Correction Scheme",
+                       "FEC Scheme of the reflection, and of the incoming "
+                       "stream when it has no header",
+                       GST_TYPE_FEC_SCHEME, LIQUID_FEC_NONE,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HEADER,
+    g_param_spec_boolean ("header", "Header",
+                          "Follow the header row of the incoming stream and "
+                          "draw one above the reflection.  Frames without "
+                          "a valid header are not reflected",
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_timestampreflect_dispose);
+  video_filter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_timestampreflect_transform_frame_ip);
+}
+
+static void
+gst_timestampreflect_init (GstTimestampReflect *reflect)
+{
+  reflect->header = TRUE;
+  reflect->last_header = 0;
+  reflect->last_header_valid = FALSE;
+  reflect->codec = NULL;
+  reflect->pending_codec = NULL;
+  reflect->reflect_codec = NULL;
+  reflect->pending_reflect_codec = NULL;
+  gst_timestampreflect_set_fec_scheme (reflect, LIQUID_FEC_NONE);
+}
+
+static void
+gst_timestampreflect_dispose (GObject *object)
+{
+  GstTimestampReflect *reflect = GST_TIMESTAMPREFLECT (object);
+
+  latency_clock_codec_free (reflect->codec);
+  reflect->codec = NULL;
+  gst_timestamp_codec_publish (&reflect->pending_codec, NULL);
+  latency_clock_codec_free (reflect->reflect_codec);
+  reflect->reflect_codec = NULL;
+  gst_timestamp_codec_publish (&reflect->pending_reflect_codec, NULL);
+
+  G_OBJECT_CLASS (gst_timestampreflect_parent_class)->dispose (object);
+}
+
+/* Reads the header row of the incoming payload and makes sure
+ * reflect->codec matches it, as timeoverlayparse does.  Returns FALSE if
+ * there is no valid header. */
+static gboolean
+gst_timestampreflect_follow_header (GstTimestampReflect *reflect,
+    GstVideoFrame *frame)
+{
+  guint64 header;
+
+  if (!latency_clock_read_header (GST_VIDEO_FRAME_PLANE_DATA (frame, 0),
+          GST_VIDEO_FRAME_WIDTH (frame), GST_VIDEO_FRAME_HEIGHT (frame),
+          frame->info.stride[0], frame->info.finfo->pixel_stride[0], &header))
+    return FALSE;
+
+  if (header != reflect->last_header) {
+    reflect->last_header = header;
+    reflect->last_header_valid = latency_clock_header_unpack (header,
+        &reflect->header_fec_scheme, &reflect->header_words,
+        &reflect->header_version, NULL);
+  }
+  if (!reflect->last_header_valid)
+    return FALSE;
+
+  if (reflect->codec->fec_scheme != reflect->header_fec_scheme ||
+      reflect->codec->words != reflect->header_words ||
+      reflect->codec->version != reflect->header_version) {
+    GST_INFO_OBJECT (reflect, "Following header: version %u, fec_scheme %d, "
+        "%u words", reflect->header_version, reflect->header_fec_scheme,
+        reflect->header_words);
+    latency_clock_codec_free (reflect->codec);
+    reflect->codec = latency_clock_codec_new_version (
+        reflect->header_fec_scheme, reflect->header_words,
+        reflect->header_version);
+  }
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_timestampreflect_transform_frame_ip (GstVideoFilter * filter,
+    GstVideoFrame * frame)
+{
+  GstTimestampReflect *reflect = GST_TIMESTAMPREFLECT (filter);
+  GstClockTime received = gst_util_get_timestamp ();
+  LatencyClockCodec *codec, *reflect_codec;
+  guint64 words[LATENCY_CLOCK_MAX_WORDS];
+  guint64 send_time = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_NONE, 0);
+  GstClockTime hold;
+  guint w;
+
+  if (frame->info.stride[0] < (8 * frame->info.finfo->pixel_stride[0] * 64)) {
+    GST_WARNING_OBJECT (filter, "Can't reflect timestamps: video-frame is to "
+        "narrow");
+    return GST_FLOW_OK;
+  }
+
+  gst_timestamp_codec_acquire (&reflect->pending_codec, &reflect->codec);
+  reflect_codec = gst_timestamp_codec_acquire (
+      &reflect->pending_reflect_codec, &reflect->reflect_codec);
+
+  /* A reflection of whatever happens to be in a frame without a header
+   * would give the sender a nonsensical round-trip time */
+  if (reflect->header &&
+      !gst_timestampreflect_follow_header (reflect, frame)) {
+    GST_DEBUG_OBJECT (filter, "No valid header, not reflecting");
+    return GST_FLOW_OK;
+  }
+  codec = reflect->codec;
+
+  if (!latency_clock_read (codec, reflect->header,
+          GST_VIDEO_FRAME_PLANE_DATA (frame, 0), GST_VIDEO_FRAME_WIDTH (frame),
+          GST_VIDEO_FRAME_HEIGHT (frame), frame->info.stride[0],
+          frame->info.finfo->pixel_stride[0], NULL, words)) {
+    GST_WARNING_OBJECT (filter, "Can't read timestamps: video-frame is too "
+        "short for %u rows", codec->rows);
+    return GST_FLOW_OK;
+  }
+
+  /* Without the exact send time the round-trip time would be off by up to
+   * 2^24 ns */
+  for (w = 1; w < codec->words; w++) {
+    if (LATENCY_CLOCK_EXT_TAG (words[w]) == LATENCY_CLOCK_EXT_SEND_TIME)
+      send_time = words[w];
+  }
+
+  /* The hold time stops here: encoding and drawing the words only take a
+   * few microseconds more, which the round-trip time keeps */
+  hold = gst_util_get_timestamp () - received;
+  words[1] = send_time;
+  words[2] = LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_HOLD, hold);
+  GST_INFO_OBJECT (filter, "Reflecting Frame-id: %" G_GUINT64_FORMAT
+      "; Hold: %" G_GUINT64_FORMAT, words[0] & LATENCY_CLOCK_FRAME_ID_MASK,
+      hold);
+
+  if (!latency_clock_stamp (reflect_codec, words, reflect->header,
+          LATENCY_CLOCK_EYE_NONE, GST_VIDEO_FRAME_PLANE_DATA (frame, 0),
+          GST_VIDEO_FRAME_WIDTH (frame), GST_VIDEO_FRAME_HEIGHT (frame),
+          frame->info.stride[0], frame->info.finfo->pixel_stride[0])) {
+    GST_WARNING_OBJECT (filter, "Can't draw timestamps: video-frame is too "
+        "short for %u rows", reflect_codec->rows);
+    return GST_FLOW_OK;
+  }
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GST_TIMESTAMPREFLECT_H_
+#define _GST_TIMESTAMPREFLECT_H_
+
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+#include "gsttimestampcommon.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_TIMESTAMPREFLECT   (gst_timestampreflect_get_type())
+#define GST_TIMESTAMPREFLECT(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_TIMESTAMPREFLECT,GstTimestampReflect))
+#define GST_TIMESTAMPREFLECT_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_TIMESTAMPREFLECT,GstTimestampReflectClass))
+#define GST_IS_TIMESTAMPREFLECT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_TIMESTAMPREFLECT))
+#define GST_IS_TIMESTAMPREFLECT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_TIMESTAMPREFLECT))
+
+typedef struct _GstTimestampReflect GstTimestampReflect;
+typedef struct _GstTimestampReflectClass GstTimestampReflectClass;
+
+struct _GstTimestampReflect
+{
+  GstVideoFilter base_timestampreflect;
+
+  fec_scheme fec_scheme;
+  gboolean header;
+
+  /* Reads the incoming payload, following its header like
+   * timeoverlayparse */
+  LatencyClockCodec *codec;
+  gpointer pending_codec;
+  guint64 last_header;
+  gboolean last_header_valid;
+  fec_scheme header_fec_scheme;
+  guint header_words;
+  guint header_version;
+
+  /* Writes the reflection: the first word and the hold time */
+  LatencyClockCodec *reflect_codec;
+  gpointer pending_reflect_codec;
+};
+
+struct _GstTimestampReflectClass
+{
+  GstVideoFilterClass base_timestampreflect_class;
+};
+
+GType gst_timestampreflect_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,494 @@
+/* latency-clock
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "latencyclock.h"
+
+/* Whether the scheme is encoded with the built-in code in the wire format
+ * of the given header version */
+static gboolean
+codec_builtin (fec_scheme fs, guint version)
+{
+  return gst_timestamp_fec_builtin (fs) &&
+      (version != LATENCY_CLOCK_HEADER_VERSION_LIQUID ||
+          gst_timestamp_fec_liquid_layout (fs));
+}
+
+static guint
+codec_enc_length (fec_scheme fs, guint dec_len, guint version)
+{
+  if (codec_builtin (fs, version))
+    return gst_timestamp_fec_enc_length (fs, dec_len);
+#ifdef HAVE_LIQUID
+  return fec_get_enc_msg_length (fs, dec_len);
+#else
+  return 0;
+#endif
+}
+
+static guint
+codec_rows (fec_scheme fs, guint words, guint version)
+{
+  // without a usable scheme the payload is sent unprotected
+  return MAX ((codec_enc_length (fs, words * 8, version) + 7) / 8, words);
+}
+
+LatencyClockCodec *
+latency_clock_codec_new (fec_scheme fs, guint words)
+{
+  return latency_clock_codec_new_version (fs, words,
+      LATENCY_CLOCK_HEADER_VERSION);
+}
+
+/* Builds a codec for the wire format of an older header version, to read
+ * streams from older senders */
+LatencyClockCodec *
+latency_clock_codec_new_version (fec_scheme fs, guint words, guint version)
+{
+  LatencyClockCodec *codec = g_new0 (LatencyClockCodec, 1);
+
+  codec->fec_scheme = fs;
+  codec->version = version;
+#ifdef HAVE_LIQUID
+  if (!codec_builtin (fs, version))
+    codec->fec = fec_create(fs, NULL);
+#endif
+  codec->words = words;
+
+  // decoded message length (bytes)
+  codec->fec_n = words * 8;
+  // compute encoded message length
+  codec->fec_k = codec_enc_length (fs, codec->fec_n, version);
+
+  codec->rows = codec_rows (fs, words, version);
+  codec->msg_enc = g_malloc0 (codec->rows * 8);
+
+  return codec;
+}
+
+void
+latency_clock_codec_free (LatencyClockCodec *codec)
+{
+  if (!codec)
+    return;
+
+#ifdef HAVE_LIQUID
+  if (codec->fec)
+    fec_destroy(codec->fec);
+#endif
+  g_free (codec->msg_enc);
+  g_free (codec);
+}
+
+/* Number of 64-bit rows a message of the given number of words occupies once
+ * encoded */
+guint
+latency_clock_codec_rows (fec_scheme fs, guint words)
+{
+  return codec_rows (fs, words, LATENCY_CLOCK_HEADER_VERSION);
+}
+
+/* Encodes codec->words words into enc, which must hold codec->rows * 8
+ * bytes */
+void
+latency_clock_encode (const LatencyClockCodec *codec, const guint64 *words,
+    guint8 *enc)
+{
+  if (codec->fec_k == 0) {
+    // scheme == unknown, or some other corner case.
+    memcpy(enc, words, codec->fec_n);
+  } else if (codec_builtin (codec->fec_scheme, codec->version)) {
+    gst_timestamp_fec_encode (codec->fec_scheme, codec->fec_n,
+        (const guint8 *) words, enc);
+  } else {
+#ifdef HAVE_LIQUID
+    fec_encode(codec->fec, codec->fec_n, (unsigned char*)words, enc);
+#endif
+  }
+}
+
+/* Decodes the encoded message in enc into codec->words words */
+void
+latency_clock_decode (const LatencyClockCodec *codec, const guint8 *enc,
+    guint64 *words)
+{
+  if (codec->fec_k == 0) {
+    memcpy(words, enc, codec->fec_n);
+  } else if (codec_builtin (codec->fec_scheme, codec->version)) {
+    gst_timestamp_fec_decode (codec->fec_scheme, codec->fec_n, enc,
+        (guint8 *) words);
+  } else {
+#ifdef HAVE_LIQUID
+    fec_decode(codec->fec, codec->fec_n, (unsigned char*)enc,
+               (unsigned char*)words);
+#endif
+  }
+}
+
+/* The number of bits of the received message enc that differ from the
+ * encoding of the words decoded from it: the bits the FEC corrected */
+guint
+latency_clock_distance (const LatencyClockCodec *codec, const guint8 *enc,
+    const guint64 *words)
+{
+  guint8 expected[LATENCY_CLOCK_MAX_ROWS * 8];
+  guint len = codec->fec_k ? codec->fec_k : codec->fec_n, i, distance = 0;
+
+  if (codec->rows > LATENCY_CLOCK_MAX_ROWS)
+    return 0;
+  latency_clock_encode (codec, words, expected);
+  for (i = 0; i < len; i++)
+    distance += __builtin_popcount (enc[i] ^ expected[i]);
+  return distance;
+}
+
+/* Encodes codec->words words into codec->msg_enc */
+void
+latency_clock_codec_encode (LatencyClockCodec *codec, const guint64 *words)
+{
+  latency_clock_encode (codec, words, codec->msg_enc);
+}
+
+/* Decodes codec->msg_enc into codec->words words */
+void
+latency_clock_codec_decode (LatencyClockCodec *codec, guint64 *words)
+{
+  latency_clock_decode (codec, codec->msg_enc, words);
+}
+
+#define HEADER_BITS 21
+#define HEADER_MASK ((1U << HEADER_BITS) - 1)
+
+guint64
+latency_clock_header_pack (const LatencyClockCodec *codec, guint eye)
+{
+  guint64 info;
+
+  info = (guint64) codec->version << 18 |
+      (guint64) (codec->fec_scheme & 0x1f) << 13 |
+      (guint64) (codec->words & 0x1f) << 8 |
+      (guint64) (codec->rows & 0x3f) << 2 |
+      (guint64) (eye & 0x3);
+
+  return info << 43 | info << 22 | info << 1;
+}
+
+/* Returns FALSE if header isn't a valid header, e.g. because the stream
+ * comes from a timestampoverlay that doesn't send one, or if it describes a
+ * wire format this build can't decode.  eye may be NULL. */
+gboolean
+latency_clock_header_unpack (guint64 header, fec_scheme *fs, guint *words,
+    guint *version, guint *eye)
+{
+  guint32 a = (header >> 43) & HEADER_MASK;
+  guint32 b = (header >> 22) & HEADER_MASK;
+  guint32 c = (header >> 1) & HEADER_MASK;
+  guint32 info = (a & b) | (a & c) | (b & c);
+  guint v = info >> 18;
+  guint scheme = (info >> 13) & 0x1f;
+  guint n_words = (info >> 8) & 0x1f;
+  guint rows = (info >> 2) & 0x3f;
+
+  if (v < LATENCY_CLOCK_HEADER_VERSION_LIQUID ||
+      v > LATENCY_CLOCK_HEADER_VERSION || n_words == 0 ||
+      scheme == LIQUID_FEC_UNKNOWN || scheme > LIQUID_FEC_RS_M8)
+    return FALSE;
+#ifndef HAVE_LIQUID
+  if (!codec_builtin (scheme, v))
+    return FALSE;
+#endif
+
+  /* The row count is redundant, which makes it a cheap sanity check */
+  if (rows != (codec_rows (scheme, n_words, v) & 0x3f))
+    return FALSE;
+
+  *fs = scheme;
+  *words = n_words;
+  *version = v;
+  if (eye)
+    *eye = info & 0x3;
+  return TRUE;
+}
+
+/* Returns the top-left pixel of the view of the given eye and sets width
+ * and height to its size.  With LATENCY_CLOCK_LAYOUT_MONO the view is the
+ * whole frame.  An odd pixel left over goes to neither eye. */
+guint8 *
+latency_clock_view (guint8 *data, gint *width, gint *height, gint stride,
+    gint pxsize, LatencyClockLayout layout, guint eye)
+{
+  switch (layout) {
+  case LATENCY_CLOCK_LAYOUT_SIDE_BY_SIDE:
+    *width /= 2;
+    return eye == LATENCY_CLOCK_EYE_RIGHT ? data + *width * pxsize : data;
+  case LATENCY_CLOCK_LAYOUT_TOP_BOTTOM:
+    *height /= 2;
+    return eye == LATENCY_CLOCK_EYE_RIGHT ? data + *height * stride : data;
+  case LATENCY_CLOCK_LAYOUT_MONO:
+  default:
+    return data;
+  }
+}
+
+/* Returns a pointer to the top-left pixel of the first row of the code
+ * block, or NULL if rows payload rows (plus the header row) don't fit into
+ * the frame. */
+guint8 *
+latency_clock_block (guint8 *data, gint width, gint height, gint stride,
+    gint pxsize, guint rows, gboolean header)
+{
+  gint top;
+
+  if (header) {
+    top = (height - 8) / 2;
+    rows++;
+  } else {
+    top = (height - (gint) rows * 8) / 2;
+  }
+  if (top < 0 || top + (gint) rows * 8 > height || width < 64 * 8)
+    return NULL;
+
+  return data + top * stride + (width - 64 * 8) * pxsize / 2;
+}
+
+/* The rectangle has as many rows above the header row as below it, so the
+ * header row stays centred in the cropped frame.  It reaches beyond the
+ * frame when the frame holds fewer rows. */
+void
+latency_clock_roi (gint width, gint height, guint rows, gint *x, gint *y,
+    gint *roi_width, gint *roi_height)
+{
+  *x = (width - 64 * 8) / 2;
+  *y = (height - 8) / 2 - (gint) rows * 8;
+  *roi_width = 64 * 8;
+  *roi_height = 8 + 16 * (gint) rows;
+}
+
+/* Every row is a 64-bit word drawn MSB first as 64 black or white boxes of
+ * 8x8 pixels */
+void
+latency_clock_draw_row (int lineoffset, guint64 value, guint8 *buf,
+    size_t stride, int pxsize)
+{
+  int bit, line;
+  buf += lineoffset * 8 * stride;
+
+  for (line = 0; line < 8; line++) {
+    for (bit = 0; bit < 64; bit++) {
+      char color = ((value >> (63 - bit)) & 1) * 255;
+      memset(buf + bit * pxsize * 8, color, pxsize * 8);
+    }
+    buf += stride;
+  }
+}
+
+/* Reads a row back by sampling the middle line of every box */
+guint64
+latency_clock_read_row (int lineoffset, const guint8 *buf, size_t stride,
+    int pxsize)
+{
+  int bit;
+  guint64 value = 0;
+
+  buf += (lineoffset * 8 + 4) * stride;
+
+  for (bit = 0; bit < 64; bit++) {
+    char color = buf[bit * pxsize * 8 + 4];
+    value |= (color & 0x80) ?  (guint64) 1 << (63 - bit) : 0;
+  }
+
+  return value;
+}
+
+/* Encodes words and draws them, below the header row for the given eye if
+ * header is set.  Returns FALSE if the rows don't fit into the frame. */
+gboolean
+latency_clock_stamp (const LatencyClockCodec *codec, const guint64 *words,
+    gboolean header, guint eye, guint8 *data, gint width, gint height,
+    gint stride, gint pxsize)
+{
+  guint64 enc[LATENCY_CLOCK_MAX_ROWS];
+  guint8 *block;
+  guint r;
+
+  block = latency_clock_block (data, width, height, stride, pxsize,
+      codec->rows, header);
+  if (!block || codec->rows > LATENCY_CLOCK_MAX_ROWS)
+    return FALSE;
+
+  latency_clock_encode (codec, words, (guint8 *) enc);
+  if (header) {
+    latency_clock_draw_row (0, latency_clock_header_pack (codec, eye), block,
+        stride, pxsize);
+    block += 8 * stride;
+  }
+  for (r = 0; r < codec->rows; r++)
+    latency_clock_draw_row (r, enc[r], block, stride, pxsize);
+  return TRUE;
+}
+
+/* Reads the header row, without unpacking it.  Returns FALSE if the frame is
+ * too small to hold one. */
+gboolean
+latency_clock_read_header (const guint8 *data, gint width, gint height,
+    gint stride, gint pxsize, guint64 *header)
+{
+  const guint8 *block = latency_clock_block ((guint8 *) data, width, height,
+      stride, pxsize, 0, TRUE);
+
+  if (!block)
+    return FALSE;
+  *header = latency_clock_read_row (0, block, stride, pxsize);
+  return TRUE;
+}
+
+/* Reads the rows below the header row, if header is set, and decodes them.
+ * The rows as received are left in enc if it isn't NULL, which must then
+ * hold codec->rows * 8 bytes.  Returns FALSE if the rows don't fit into the
+ * frame. */
+gboolean
+latency_clock_read (const LatencyClockCodec *codec, gboolean header,
+    const guint8 *data, gint width, gint height, gint stride, gint pxsize,
+    guint8 *enc, guint64 *words)
+{
+  guint64 rows[LATENCY_CLOCK_MAX_ROWS];
+  const guint8 *block;
+  guint r;
+
+  block = latency_clock_block ((guint8 *) data, width, height, stride,
+      pxsize, codec->rows, header);
+  if (!block || codec->rows > LATENCY_CLOCK_MAX_ROWS)
+    return FALSE;
+  if (header)
+    block += 8 * stride;
+
+  for (r = 0; r < codec->rows; r++)
+    rows[r] = latency_clock_read_row (r, block, stride, pxsize);
+  if (enc)
+    memcpy (enc, rows, codec->rows * 8);
+  latency_clock_decode (codec, (const guint8 *) rows, words);
+  return TRUE;
+}
+
+/* Returns the header row of the band below the band whose header row is at
+ * band and which has rows payload rows, or NULL if a band of next_rows
+ * payload rows doesn't fit there.  The code block is the first band. */
+guint8 *
+latency_clock_next_band (guint8 *data, gint height, gint stride,
+    guint8 *band, guint rows, guint next_rows)
+{
+  guint8 *next = band + (1 + rows) * 8 * stride;
+  gint top = (next - data) / stride;
+
+  if (top + (gint) (1 + next_rows) * 8 > height)
+    return NULL;
+  return next;
+}
+
+/* Draws word, encoded with codec, in a band of its own below the code
+ * block and the bands appended so far.  Returns FALSE if there is no code
+ * block with a valid header, or no room left below it. */
+gboolean
+latency_clock_append (const LatencyClockCodec *codec, guint64 word,
+    guint eye, guint8 *data, gint width, gint height, gint stride,
+    gint pxsize)
+{
+  guint64 enc[LATENCY_CLOCK_MAX_ROWS];
+  guint8 *band, *next;
+  fec_scheme fs;
+  guint words, version, rows, r;
+
+  band = latency_clock_block (data, width, height, stride, pxsize, 0, TRUE);
+  if (!band || codec->words != 1 || codec->rows > LATENCY_CLOCK_MAX_ROWS ||
+      !latency_clock_header_unpack (latency_clock_read_row (0, band, stride,
+              pxsize), &fs, &words, &version, NULL))
+    return FALSE;
+
+  for (;;) {
+    rows = codec_rows (fs, words, version);
+    next = latency_clock_next_band (data, height, stride, band, rows, 0);
+    if (!next)
+      return FALSE;
+    if (!latency_clock_header_unpack (latency_clock_read_row (0, next, stride,
+                pxsize), &fs, &words, &version, NULL))
+      break;
+    band = next;
+  }
+  next = latency_clock_next_band (data, height, stride, band, rows,
+      codec->rows);
+  if (!next)
+    return FALSE;
+
+  latency_clock_encode (codec, &word, (guint8 *) enc);
+  latency_clock_draw_row (0, latency_clock_header_pack (codec, eye), next,
+      stride, pxsize);
+  for (r = 0; r < codec->rows; r++)
+    latency_clock_draw_row (r + 1, enc[r], next, stride, pxsize);
+  return TRUE;
+}
+
+/* Reads and decodes the payload of the band whose header row is at band.
+ * latency_clock_next_band() must have said that it fits. */
+void
+latency_clock_read_band (const LatencyClockCodec *codec, const guint8 *band,
+    gint stride, gint pxsize, guint64 *words)
+{
+  guint64 rows[LATENCY_CLOCK_MAX_ROWS];
+  guint r;
+
+  for (r = 0; r < codec->rows && r < LATENCY_CLOCK_MAX_ROWS; r++)
+    rows[r] = latency_clock_read_row (r + 1, band, stride, pxsize);
+  latency_clock_decode (codec, (const guint8 *) rows, words);
+}
+
+/* The systime of a LATENCY_CLOCK_EXT_STAGE word, taken to be the one
+ * closest to reference */
+guint64
+latency_clock_stage_time (guint64 word, guint64 reference)
+{
+  const guint64 wrap = LATENCY_CLOCK_STAGE_TIME_MASK + 1;
+  guint64 t = (reference & ~(wrap - 1)) |
+      (word & LATENCY_CLOCK_STAGE_TIME_MASK);
+
+  if (t > reference && t - reference > wrap / 2 && t >= wrap)
+    t -= wrap;
+  else if (t < reference && reference - t > wrap / 2)
+    t += wrap;
+  return t;
+}
+
+guint64
+latency_clock_send_time (const guint64 *words, guint n_words,
+    gboolean *exact)
+{
+  guint w;
+
+  for (w = 1; w < n_words; w++) {
+    if (LATENCY_CLOCK_EXT_TAG (words[w]) == LATENCY_CLOCK_EXT_SEND_TIME) {
+      if (exact)
+        *exact = TRUE;
+      /* Both words were cut from the same systime, so the first one has
+       * the 4 bits the extension word lacks */
+      return (words[0] & ~LATENCY_CLOCK_EXT_DATA (G_MAXUINT64)) |
+          LATENCY_CLOCK_EXT_DATA (words[w]);
+    }
+  }
+  if (exact)
+    *exact = FALSE;
+  return words[0] & LATENCY_CLOCK_SYSTIME_MASK;
+}
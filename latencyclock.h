@@ -0,0 +1,237 @@
+/* latency-clock
+ * Copyright (C) 2024 Felician Nemeth <nemethf@tmit.bme.hu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LATENCY_CLOCK_H_
+#define _LATENCY_CLOCK_H_
+
+#include "gsttimestampfec.h"
+
+G_BEGIN_DECLS
+
+/* liblatencyclock: the payload, its FEC and its drawing, without GStreamer.
+ *
+ * Frames are passed as a pointer to the top-left pixel of a packed plane,
+ * its width and height in pixels, its stride in bytes and the bytes per
+ * pixel.  The payload is drawn into, and read from, every byte of a pixel,
+ * so any packed RGB or grey format works.
+ *
+ * A codec is only read once latency_clock_codec_new() has returned, so any
+ * number of threads can use one at the same time with latency_clock_stamp(),
+ * latency_clock_read(), latency_clock_encode() and latency_clock_decode().
+ * These keep their scratch space on the stack and never allocate.  The
+ * exceptions are the liquid-dsp schemes (the convolutional codes, and all
+ * schemes of header version 1), whose state lives in the codec, and
+ * latency_clock_codec_encode() and latency_clock_codec_decode(), which use
+ * the msg_enc buffer of the codec. */
+
+/* The first payload word is the sender's systime with its low 24 bits
+ * replaced by the frame id.  Any further words are extensions: the top 4 bits
+ * of the word say what the other 60 bits hold. */
+#define LATENCY_CLOCK_FRAME_ID_MASK 0xffFFffULL
+#define LATENCY_CLOCK_SYSTIME_MASK 0xFFffFFffFF000000ULL
+#define LATENCY_CLOCK_MAX_WORDS 31
+
+#define LATENCY_CLOCK_EXT_TAG(word) ((guint) ((word) >> 60))
+#define LATENCY_CLOCK_EXT_DATA(word) ((word) & 0x0FFFFFFFFFFFFFFFULL)
+#define LATENCY_CLOCK_EXT(tag, data) \
+    ((guint64) (tag) << 60 | LATENCY_CLOCK_EXT_DATA (data))
+
+enum {
+  LATENCY_CLOCK_EXT_NONE = 0,
+  /* Send times of the previous frames, three per word: the distance of frame
+   * id-1, id-2 and id-3 (then id-4, id-5, id-6 in the next word, etc.) from
+   * this frame in microseconds, 20 bits each, most recent first.
+   * LATENCY_CLOCK_HISTORY_UNKNOWN marks frames that were never sent. */
+  LATENCY_CLOCK_EXT_HISTORY = 1,
+  /* The timestamps of the original latency-clock, modulo 2^60 ns.  An
+   * invalid timestamp is sent as all ones, LATENCY_CLOCK_EXT_DATA (-1) */
+  LATENCY_CLOCK_EXT_BUFFER_TIME = 2,
+  LATENCY_CLOCK_EXT_STREAM_TIME = 3,
+  LATENCY_CLOCK_EXT_RUNNING_TIME = 4,
+  LATENCY_CLOCK_EXT_CLOCK_TIME = 5,
+  LATENCY_CLOCK_EXT_RENDER_TIME = 6,
+  LATENCY_CLOCK_EXT_RENDER_REALTIME = 7,
+  /* Sent back by timestampreflect along with the first word it received:
+   * the nanoseconds from reading that word to drawing the reflection */
+  LATENCY_CLOCK_EXT_HOLD = 8,
+  /* The only word of an appended band: the stage id in the top 4 bits of
+   * the data and the systime of the stage modulo 2^56 ns in the others */
+  LATENCY_CLOCK_EXT_STAGE = 9,
+  /* The video mode of the frame: width:16 | height:16 | framerate
+   * numerator:18 | denominator:10, with a framerate of 0/1 if it doesn't
+   * fit */
+  LATENCY_CLOCK_EXT_MODE = 10,
+  /* The low 60 bits of the systime the first word was cut from.  The frame
+   * id takes the low 24 bits of the first word, which leaves the send time
+   * there only accurate to 2^24 ns (16.78 ms) */
+  LATENCY_CLOCK_EXT_SEND_TIME = 11,
+};
+
+#define LATENCY_CLOCK_HISTORY_LEN 16
+#define LATENCY_CLOCK_HISTORY_PER_WORD 3
+#define LATENCY_CLOCK_HISTORY_BITS 20
+#define LATENCY_CLOCK_HISTORY_UNKNOWN 0xFFFFF
+#define LATENCY_CLOCK_HISTORY_WORDS(history) \
+    (((history) + LATENCY_CLOCK_HISTORY_PER_WORD - 1) / \
+        LATENCY_CLOCK_HISTORY_PER_WORD)
+
+#define LATENCY_CLOCK_MAX_STAGES 16
+#define LATENCY_CLOCK_STAGE_TIME_MASK 0x00FFFFFFFFFFFFFFULL
+#define LATENCY_CLOCK_STAGE(stage, time) \
+    LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_STAGE, \
+        (guint64) ((stage) & 0xf) << 56 | \
+        ((time) & LATENCY_CLOCK_STAGE_TIME_MASK))
+#define LATENCY_CLOCK_STAGE_ID(word) \
+    ((guint) (LATENCY_CLOCK_EXT_DATA (word) >> 56))
+
+#define LATENCY_CLOCK_MODE_FITS(width, height, fps_n, fps_d) \
+    ((width) <= 0xffff && (height) <= 0xffff && (fps_n) <= 0x3ffff && \
+        (fps_d) <= 0x3ff)
+#define LATENCY_CLOCK_MODE(width, height, fps_n, fps_d) \
+    LATENCY_CLOCK_EXT (LATENCY_CLOCK_EXT_MODE, \
+        (guint64) ((width) & 0xffff) << 44 | \
+        (guint64) ((height) & 0xffff) << 28 | \
+        (guint64) ((fps_n) & 0x3ffff) << 10 | ((fps_d) & 0x3ff))
+#define LATENCY_CLOCK_MODE_WIDTH(word) \
+    ((guint) (LATENCY_CLOCK_EXT_DATA (word) >> 44) & 0xffff)
+#define LATENCY_CLOCK_MODE_HEIGHT(word) ((guint) ((word) >> 28) & 0xffff)
+#define LATENCY_CLOCK_MODE_FPS_N(word) ((guint) ((word) >> 10) & 0x3ffff)
+#define LATENCY_CLOCK_MODE_FPS_D(word) ((guint) (word) & 0x3ff)
+
+/* The header can't describe more rows than this */
+#define LATENCY_CLOCK_MAX_ROWS 63
+
+/* Everything needed to encode or decode the payload with one FEC scheme */
+typedef struct {
+  fec_scheme fec_scheme;
+  guint version;        /* header version whose wire format is used */
+#ifdef HAVE_LIQUID
+  fec fec;              /* NULL when the built-in code is used */
+#endif
+  unsigned int words;   /* 64-bit words in the decoded message */
+  unsigned int fec_n;   /* decoded message length (bytes) */
+  unsigned int fec_k;   /* encoded message length (bytes) */
+  unsigned int rows;    /* 64-bit rows the encoded message occupies */
+  unsigned char *msg_enc;
+
+  /* The layout of the words, for a sender to pack them from the codec it
+   * encodes with.  Zero unless the sender sets them. */
+  guint history;        /* previous send times in HISTORY words */
+  guint timestamps;     /* timestamp words, one per bit from BUFFER_TIME */
+  gboolean mode;        /* a MODE word */
+  gboolean send_time;   /* a SEND_TIME word, last */
+  gboolean header;      /* drawn below a header row */
+  gboolean append;      /* a STAGE word appended as a band */
+} LatencyClockCodec;
+
+LatencyClockCodec *latency_clock_codec_new (fec_scheme fs, guint words);
+LatencyClockCodec *latency_clock_codec_new_version (fec_scheme fs,
+    guint words, guint version);
+void latency_clock_codec_free (LatencyClockCodec *codec);
+guint latency_clock_codec_rows (fec_scheme fs, guint words);
+
+void latency_clock_encode (const LatencyClockCodec *codec,
+    const guint64 *words, guint8 *enc);
+void latency_clock_decode (const LatencyClockCodec *codec,
+    const guint8 *enc, guint64 *words);
+guint latency_clock_distance (const LatencyClockCodec *codec,
+    const guint8 *enc, const guint64 *words);
+void latency_clock_codec_encode (LatencyClockCodec *codec,
+    const guint64 *words);
+void latency_clock_codec_decode (LatencyClockCodec *codec, guint64 *words);
+
+/* In-band header: a row drawn above the payload rows that describes them, so
+ * timeoverlayparse can configure itself.  It holds
+ *
+ *   version:3 | fec_scheme:5 | words:5 | rows:6 | eye:2
+ *
+ * three times over (bits 63-43, 42-22 and 21-1) and is decoded by majority
+ * vote.  The header row is vertically centred in the frame and the payload
+ * rows follow it, so it can be found without knowing the payload size.
+ * eye is LATENCY_CLOCK_EYE_NONE except in stereo frames.
+ *
+ * Version 1 streams encode all schemes with liquid-dsp.  Version 2 streams
+ * use the built-in codes of gsttimestampfec.h where there is one. */
+#define LATENCY_CLOCK_HEADER_VERSION 2
+#define LATENCY_CLOCK_HEADER_VERSION_LIQUID 1
+
+guint64 latency_clock_header_pack (const LatencyClockCodec *codec, guint eye);
+gboolean latency_clock_header_unpack (guint64 header, fec_scheme *fs,
+    guint *words, guint *version, guint *eye);
+
+/* Stereo frames pack both eyes into one frame, side by side or top and
+ * bottom, left eye first.  Each eye view gets its own code block, centred
+ * in the view, with the eye in its header. */
+typedef enum {
+  LATENCY_CLOCK_LAYOUT_MONO,
+  LATENCY_CLOCK_LAYOUT_SIDE_BY_SIDE,
+  LATENCY_CLOCK_LAYOUT_TOP_BOTTOM,
+} LatencyClockLayout;
+
+enum {
+  LATENCY_CLOCK_EYE_NONE = 0,
+  LATENCY_CLOCK_EYE_LEFT = 1,
+  LATENCY_CLOCK_EYE_RIGHT = 2,
+};
+
+guint8 *latency_clock_view (guint8 *data, gint *width, gint *height,
+    gint stride, gint pxsize, LatencyClockLayout layout, guint eye);
+
+/* Drawing.  Every row is a 64-bit word drawn as 64 boxes of 8x8 pixels,
+ * centred horizontally. */
+guint8 *latency_clock_block (guint8 *data, gint width, gint height,
+    gint stride, gint pxsize, guint rows, gboolean header);
+void latency_clock_draw_row (int lineoffset, guint64 value, guint8 *buf,
+    size_t stride, int pxsize);
+guint64 latency_clock_read_row (int lineoffset, const guint8 *buf,
+    size_t stride, int pxsize);
+
+/* Region of interest: the rectangle of a frame with a header row that can
+ * be cropped out of it and read like the whole frame.  It holds the header
+ * row with rows rows of boxes below it. */
+void latency_clock_roi (gint width, gint height, guint rows, gint *x,
+    gint *y, gint *roi_width, gint *roi_height);
+
+gboolean latency_clock_stamp (const LatencyClockCodec *codec,
+    const guint64 *words, gboolean header, guint eye, guint8 *data,
+    gint width, gint height, gint stride, gint pxsize);
+gboolean latency_clock_read_header (const guint8 *data, gint width,
+    gint height, gint stride, gint pxsize, guint64 *header);
+gboolean latency_clock_read (const LatencyClockCodec *codec, gboolean header,
+    const guint8 *data, gint width, gint height, gint stride, gint pxsize,
+    guint8 *enc, guint64 *words);
+
+/* Multi-hop paths.  Every hop after the first can append a band below the
+ * code block: a header row followed by the rows of a payload of one
+ * LATENCY_CLOCK_EXT_STAGE word.  Bands are stacked downwards in the order
+ * they were appended and never overwrite each other. */
+guint8 *latency_clock_next_band (guint8 *data, gint height, gint stride,
+    guint8 *band, guint rows, guint next_rows);
+gboolean latency_clock_append (const LatencyClockCodec *codec,
+    guint64 word, guint eye, guint8 *data, gint width, gint height,
+    gint stride, gint pxsize);
+void latency_clock_read_band (const LatencyClockCodec *codec,
+    const guint8 *band, gint stride, gint pxsize, guint64 *words);
+guint64 latency_clock_stage_time (guint64 word, guint64 reference);
+
+/* The send time of a payload: the one of its LATENCY_CLOCK_EXT_SEND_TIME
+ * word, or the truncated one of its first word if it has none */
+guint64 latency_clock_send_time (const guint64 *words, guint n_words,
+    gboolean *exact);
+
+G_END_DECLS
+#endif
@@ -25,14 +25,53 @@
 
 #include "gsttimeoverlayparse.h"
 #include "gsttimestampoverlay.h"
+#ifdef HAVE_LIQUID
+#include "gstaudiotimestampoverlay.h"
+#include "gstaudiotimeoverlayparse.h"
+#endif
+#include "gstseitimestampinsert.h"
+#include "gstseitimestampparse.h"
+#include "gstrtptimestampinsert.h"
+#include "gstrtptimestampparse.h"
+#include "gstlatencyinject.h"
+#include "gsttimestampreflect.h"
+#ifdef HAVE_JPEG
+#include "gstjpegtimestampdec.h"
+#endif
 
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
+#ifdef HAVE_LIQUID
+  /* The modems of the audio elements come from liquid-dsp */
+  if (!gst_element_register (plugin, "audiotimestampoverlay", GST_RANK_NONE,
+          GST_TYPE_AUDIOTIMESTAMPOVERLAY) ||
+      !gst_element_register (plugin, "audiotimeoverlayparse", GST_RANK_NONE,
+          GST_TYPE_AUDIOTIMEOVERLAYPARSE))
+    return FALSE;
+#endif
+#ifdef HAVE_JPEG
+  if (!gst_element_register (plugin, "jpegtimestampdec", GST_RANK_NONE,
+          GST_TYPE_JPEGTIMESTAMPDEC))
+    return FALSE;
+#endif
+
   return gst_element_register (plugin, "timestampoverlay", GST_RANK_NONE,
              GST_TYPE_TIMESTAMPOVERLAY) &&
          gst_element_register (plugin, "timeoverlayparse", GST_RANK_NONE,
-             GST_TYPE_TIMEOVERLAYPARSE);
+             GST_TYPE_TIMEOVERLAYPARSE) &&
+         gst_element_register (plugin, "seitimestampinsert", GST_RANK_NONE,
+             GST_TYPE_SEITIMESTAMPINSERT) &&
+         gst_element_register (plugin, "seitimestampparse", GST_RANK_NONE,
+             GST_TYPE_SEITIMESTAMPPARSE) &&
+         gst_element_register (plugin, "rtptimestampinsert", GST_RANK_NONE,
+             GST_TYPE_RTPTIMESTAMPINSERT) &&
+         gst_element_register (plugin, "rtptimestampparse", GST_RANK_NONE,
+             GST_TYPE_RTPTIMESTAMPPARSE) &&
+         gst_element_register (plugin, "latencyinject", GST_RANK_NONE,
+             GST_TYPE_LATENCYINJECT) &&
+         gst_element_register (plugin, "timestampreflect", GST_RANK_NONE,
+             GST_TYPE_TIMESTAMPREFLECT);
 }
 
 #ifndef VERSION
@@ -0,0 +1,231 @@
+/* GStreamer
+ *
+ * Copyright (C) 2016 William Manley <will@williammanley.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "rtsched.h"
+
+static gchar *rt_policy = NULL;
+static gint rt_priority = 50;
+static gchar *rt_cpus = NULL;
+static gboolean rt_mlock = FALSE;
+static gint rt_interval_us = 1000;
+
+GOptionEntry rtsched_entries[] = {
+  { "rt-policy", 0, 0, G_OPTION_ARG_STRING, &rt_policy,
+    "Scheduling policy of the streaming threads: fifo or rr", "POLICY" },
+  { "rt-priority", 0, 0, G_OPTION_ARG_INT, &rt_priority,
+    "Priority of the streaming threads with --rt-policy (default: 50)",
+    "PRIORITY" },
+  { "rt-cpus", 0, 0, G_OPTION_ARG_STRING, &rt_cpus,
+    "Pin the streaming threads to these CPUs, e.g. 2,3 or 2-3", "CPUS" },
+  { "mlock", 0, 0, G_OPTION_ARG_NONE, &rt_mlock,
+    "Lock all current and future memory of the process", NULL },
+  { "lateness-interval", 0, 0, G_OPTION_ARG_INT, &rt_interval_us,
+    "Period of the wakeups whose lateness is measured (default: 1000)",
+    "MICROSECONDS" },
+  { NULL }
+};
+
+static int policy = SCHED_OTHER;
+static cpu_set_t cpus;
+static gboolean have_cpus = FALSE;
+
+/* Lateness of the monitor's wakeups since it was last taken */
+static GMutex lateness_lock;
+static guint64 lateness_wakeups = 0;
+static guint64 lateness_sum = 0;
+static guint64 lateness_max = 0;
+
+static gboolean
+parse_cpus (const gchar *list, cpu_set_t *set)
+{
+  gchar **ranges = g_strsplit (list, ",", -1);
+  gboolean ok = TRUE;
+  gint i;
+
+  CPU_ZERO (set);
+  for (i = 0; ranges[i] && ok; i++) {
+    gchar *end;
+    gulong first = strtoul (ranges[i], &end, 10), last = first, cpu;
+
+    if (end == ranges[i])
+      ok = FALSE;
+    else if (*end == '-')
+      last = strtoul (end + 1, &end, 10);
+    if (*end != '\0' || last < first || last >= CPU_SETSIZE)
+      ok = FALSE;
+    for (cpu = first; ok && cpu <= last; cpu++)
+      CPU_SET (cpu, set);
+  }
+  g_strfreev (ranges);
+  return ok;
+}
+
+/* Applies the scheduling options to the calling thread */
+static void
+rtsched_apply (const gchar *name)
+{
+  int res;
+
+  if (policy != SCHED_OTHER) {
+    struct sched_param param = { .sched_priority = rt_priority };
+
+    res = pthread_setschedparam (pthread_self (), policy, &param);
+    if (res != 0)
+      g_printerr ("Failed to set the scheduling of %s: %s\n", name,
+          strerror (res));
+  }
+  if (have_cpus) {
+    res = pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+    if (res != 0)
+      g_printerr ("Failed to set the CPU affinity of %s: %s\n", name,
+          strerror (res));
+  }
+}
+
+/* Streaming threads post ENTER from themselves as they start, so the sync
+ * handler runs in the thread to be scheduled */
+static GstBusSyncReply
+rtsched_sync_handler (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+    return GST_BUS_PASS;
+
+  gst_message_parse_stream_status (msg, &type, &owner);
+  if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+    gchar *name = gst_object_get_path_string (GST_OBJECT (owner));
+
+    rtsched_apply (name);
+    GST_INFO ("Scheduled streaming thread of %s", name);
+    g_free (name);
+  }
+  return GST_BUS_PASS;
+}
+
+/* Sleeps until absolute deadlines lateness-interval apart and records how
+ * late it woke up for each */
+static gpointer
+rtsched_monitor (gpointer data)
+{
+  struct timespec next, now;
+  guint64 lateness;
+  /* Intervals above 2.1 s don't fit a gint in nanoseconds */
+  gint64 interval = (gint64) rt_interval_us * 1000;
+
+  rtsched_apply ("the lateness monitor");
+  clock_gettime (CLOCK_MONOTONIC, &next);
+  for (;;) {
+    next.tv_sec += interval / GST_SECOND;
+    next.tv_nsec += interval % GST_SECOND;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) ==
+        EINTR);
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    lateness = (guint64) (now.tv_sec - next.tv_sec) * GST_SECOND +
+        now.tv_nsec - next.tv_nsec;
+    g_mutex_lock (&lateness_lock);
+    lateness_wakeups++;
+    lateness_sum += lateness;
+    lateness_max = MAX (lateness_max, lateness);
+    g_mutex_unlock (&lateness_lock);
+  }
+  return NULL;
+}
+
+gboolean
+rtsched_enabled (void)
+{
+  return rt_policy || rt_cpus || rt_mlock;
+}
+
+/* Installs the scheduling of the streaming threads of pipeline, which must
+ * not have started yet, and starts the lateness monitor */
+gboolean
+rtsched_setup (GstElement *pipeline)
+{
+  GstBus *bus;
+
+  if (!rtsched_enabled ())
+    return TRUE;
+
+  if (rt_policy && g_strcmp0 (rt_policy, "fifo") == 0) {
+    policy = SCHED_FIFO;
+  } else if (rt_policy && g_strcmp0 (rt_policy, "rr") == 0) {
+    policy = SCHED_RR;
+  } else if (rt_policy) {
+    g_printerr ("Unknown scheduling policy %s\n", rt_policy);
+    return FALSE;
+  }
+  if (policy != SCHED_OTHER && (rt_priority < sched_get_priority_min (policy)
+          || rt_priority > sched_get_priority_max (policy))) {
+    g_printerr ("Priority %d is out of range for %s\n", rt_priority,
+        rt_policy);
+    return FALSE;
+  }
+  if (rt_cpus) {
+    if (!parse_cpus (rt_cpus, &cpus)) {
+      g_printerr ("Invalid CPU list %s\n", rt_cpus);
+      return FALSE;
+    }
+    have_cpus = TRUE;
+  }
+  if (rt_interval_us <= 0) {
+    g_printerr ("Invalid lateness interval %d\n", rt_interval_us);
+    return FALSE;
+  }
+
+  /* Page faults in the streaming threads would show up as latency */
+  if (rt_mlock && mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    g_printerr ("Failed to lock memory: %s\n", g_strerror (errno));
+
+  bus = gst_element_get_bus (pipeline);
+  gst_bus_set_sync_handler (bus, rtsched_sync_handler, NULL, NULL);
+  gst_object_unref (bus);
+
+  g_thread_unref (g_thread_new ("rtsched-monitor", rtsched_monitor, NULL));
+  return TRUE;
+}
+
+/* Returns the lateness of the wakeups since the last call */
+void
+rtsched_take_lateness (RtSchedLateness *lateness)
+{
+  g_mutex_lock (&lateness_lock);
+  lateness->wakeups = lateness_wakeups;
+  lateness->mean = lateness_wakeups ? lateness_sum / lateness_wakeups : 0;
+  lateness->max = lateness_max;
+  lateness_wakeups = lateness_sum = lateness_max = 0;
+  g_mutex_unlock (&lateness_lock);
+}
@@ -0,0 +1,51 @@
+/* GStreamer
+ *
+ * Copyright (C) 2016 William Manley <will@williammanley.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _RTSCHED_H_
+#define _RTSCHED_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Real-time scheduling of the streaming threads of server and client.
+ *
+ * With any of the options given, every streaming thread of the pipeline is
+ * switched to the chosen policy and CPUs as it starts, memory is locked if
+ * asked for, and a monitor thread with the same scheduling measures how
+ * late its periodic wakeups are.  That lateness is what the streaming
+ * threads suffer from the host as well, so it is reported next to the
+ * latency. */
+
+extern GOptionEntry rtsched_entries[];
+
+typedef struct {
+  guint64 wakeups;
+  GstClockTime mean;
+  GstClockTime max;
+} RtSchedLateness;
+
+gboolean rtsched_enabled (void);
+gboolean rtsched_setup (GstElement *pipeline);
+void rtsched_take_lateness (RtSchedLateness *lateness);
+
+G_END_DECLS
+
+#endif
@@ -22,25 +22,126 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <gst/gst.h>
+#include <gst/net/net.h>
+
+#include "rtsched.h"
 
 static gboolean bus_call (GstBus *bus, GstMessage *msg, gpointer data);
+static gboolean report_lateness (gpointer data);
 static gchar* get_current_mode (void);
+static gchar* sweep_mode_caps (const gchar *mode);
+static gboolean next_sweep_mode (gpointer data);
+static GstPadProbeReturn count_sweep_frames (GstPad *pad,
+    GstPadProbeInfo *info, gpointer data);
+static void take_cost (const GstStructure *s);
+static void set_time_source (GstBin *bin, const gchar *name);
+
+static gchar *time_source = NULL;
+static gchar *net_clock_address = NULL;
+static gint net_clock_port = 0;
+static gint provide_clock_port = 0;
+static gchar *reflect_source = NULL;
+static gint fec_feedback_port = 0;
+static gchar *sweep = NULL;
+static gint sweep_frames = 600;
+static gboolean cost = FALSE;
+static gboolean cost_perf = FALSE;
+
+static GOptionEntry entries[] = {
+  { "time-source", 't', 0, G_OPTION_ARG_STRING, &time_source,
+    "time-source of the overlays: realtime, tai, pipeline, net-client "
+    "or ptp (default: realtime)", "SOURCE" },
+  { "net-clock-address", 0, 0, G_OPTION_ARG_STRING, &net_clock_address,
+    "Address of the network clock for --time-source=net-client", "ADDRESS" },
+  { "net-clock-port", 0, 0, G_OPTION_ARG_INT, &net_clock_port,
+    "Port of the network clock for --time-source=net-client", "PORT" },
+  { "provide-clock", 'p', 0, G_OPTION_ARG_INT, &provide_clock_port,
+    "Serve a CLOCK_REALTIME pipeline clock with a GstNetTimeProvider on PORT",
+    "PORT" },
+  { "reflect-source", 'r', 0, G_OPTION_ARG_STRING, &reflect_source,
+    "Capture the video reflected by timestampreflect with PIPELINE and print "
+    "the round-trip time", "PIPELINE" },
+  { "fec-feedback-port", 0, 0, G_OPTION_ARG_INT, &fec_feedback_port,
+    "Adapt the fec-scheme to the reports of client --fec-feedback received "
+    "on UDP PORT", "PORT" },
+  { "sweep", 's', 0, G_OPTION_ARG_STRING, &sweep,
+    "Show these modes one after the other and stop, e.g. "
+    "1280x720@60,1920x1080@30000/1001", "MODES" },
+  { "sweep-frames", 0, 0, G_OPTION_ARG_INT, &sweep_frames,
+    "Frames to hold every mode of --sweep for (default: 600)", "FRAMES" },
+  { "cost", 0, 0, G_OPTION_ARG_NONE, &cost,
+    "Print the cost of timestampoverlay once a second", NULL },
+  { "cost-perf", 0, 0, G_OPTION_ARG_NONE, &cost_perf,
+    "Count the CPU cycles and cache misses of timestampoverlay (implies "
+    "--cost)", NULL },
+  { NULL }
+};
+
+/* --sweep: the caps of the modes, the one being shown and the frames left
+ * of it */
+static gchar **sweep_caps = NULL;
+static guint sweep_index = 0;
+static gint sweep_frames_left = 0;
+static GstElement *mode_filter = NULL;
+
+/* Cost of timestampoverlay since the start, from its last
+ * timestampoverlay-cost message */
+static guint64 cost_frames = 0, cost_mean = 0, cost_max = 0;
+static guint64 cost_cycles = 0, cost_cache_misses = 0;
 
 int main(int argc, char* argv[])
 {
   GMainLoop *loop;
   GstBus *bus;
   GstElement * epipeline;
-  GstElement * mmalvideosink;
+  GstElement * mmalvideosink, * overlay;
   GstPipeline * pipeline;
   GError * err = NULL;
-  gchar * sink_pipeline, *pipeline_description;
+  gchar * sink_pipeline, *pipeline_description, *audio_description;
+  gchar * reflect_description, * mode;
   struct timespec ts;
   int res;
   GstClock *clock;
-
-  gst_init(&argc, &argv);
+  GstNetTimeProvider *provider = NULL;
+  GOptionContext *ctx;
+
+  ctx = g_option_context_new ("[SINK-PIPELINE [AUDIO-SINK-PIPELINE]]");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_main_entries (ctx, rtsched_entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+  if (cost_perf)
+    cost = TRUE;
+
+  /* The modes of the sweep are checked before anything starts */
+  if (sweep) {
+    gchar **modes = g_strsplit (sweep, ",", -1);
+    guint i, n = g_strv_length (modes);
+
+    if (sweep_frames <= 0) {
+      g_printerr ("Invalid number of frames per mode %d\n", sweep_frames);
+      return 1;
+    }
+    sweep_caps = g_new0 (gchar *, n + 1);
+    for (i = 0; i < n; i++) {
+      sweep_caps[i] = sweep_mode_caps (modes[i]);
+      if (!sweep_caps[i]) {
+        g_printerr ("Invalid mode %s\n", modes[i]);
+        return 1;
+      }
+    }
+    g_strfreev (modes);
+    if (n == 0) {
+      g_printerr ("No modes to sweep\n");
+      return 1;
+    }
+  }
 
   loop = g_main_loop_new (NULL, FALSE);
 
@@ -49,12 +150,39 @@ int main(int argc, char* argv[])
   else
     sink_pipeline = "videoconvert ! mmalvideosink name=mmalsink";
 
+  /* An optional audio sink gets timestamp bursts for measuring audio latency
+   * and A/V skew */
+  if (argc > 2)
+    audio_description = g_strdup_printf (
+        " audiotestsrc is-live=true wave=silence "
+        "! audioconvert "
+        "! audiotimestampoverlay name=audiooverlay "
+        "! audioconvert "
+        "! queue "
+        "! %s", argv[2]);
+  else
+    audio_description = g_strdup ("");
+
+  /* The reflection is parsed against the same clock the overlay sends */
+  if (reflect_source)
+    reflect_description = g_strdup_printf (
+        " %s "
+        "! videoconvert "
+        "! timeoverlayparse name=reflectparse post-messages=true "
+        "! fakesink", reflect_source);
+  else
+    reflect_description = g_strdup ("");
+
+  /* The sweep changes the caps of the capsfilter on the running pipeline,
+   * and the overlay sends the mode with every frame */
+  mode = sweep ? sweep_caps[0] : get_current_mode ();
   pipeline_description = g_strdup_printf (
       "videotestsrc is-live=true pattern=white "
-      "! %s "
-      "! timestampoverlay "
+      "! capsfilter name=mode caps=\"%s\" "
+      "! timestampoverlay name=overlay mode=%s "
       "! queue "
-      "! %s", get_current_mode(), sink_pipeline);
+      "! %s%s%s", mode, sweep ? "true" : "false", sink_pipeline,
+      audio_description, reflect_description);
   g_printerr ("Using pipeline %s\n", pipeline_description);
   epipeline = gst_parse_launch (pipeline_description, &err);
 
@@ -80,6 +208,51 @@ int main(int argc, char* argv[])
     mmalvideosink = NULL;
   }
 
+  set_time_source (GST_BIN (pipeline), "overlay");
+  set_time_source (GST_BIN (pipeline), "audiooverlay");
+  set_time_source (GST_BIN (pipeline), "reflectparse");
+
+  overlay = gst_bin_get_by_name (GST_BIN (pipeline), "overlay");
+  if (fec_feedback_port)
+    g_object_set (overlay, "feedback-port", fec_feedback_port, NULL);
+  if (rtsched_enabled () || cost)
+    g_object_set (overlay, "cost", TRUE, "cost-perf", cost_perf, NULL);
+  if (sweep) {
+    GstPad *pad = gst_element_get_static_pad (overlay, "sink");
+
+    g_atomic_int_set (&sweep_frames_left, sweep_frames);
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, count_sweep_frames,
+        pipeline, NULL);
+    gst_object_unref (pad);
+    mode_filter = gst_bin_get_by_name (GST_BIN (pipeline), "mode");
+    g_print ("Mode: %s\n", sweep_caps[0]);
+  }
+  gst_object_unref (overlay);
+
+  /* Clients synchronise a GstNetClientClock to the served clock, so both
+   * ends of the measurement can read one clock regardless of how the hosts
+   * discipline theirs.  Run the overlay with --time-source=net-client
+   * against it too for both sides to be on the same footing. */
+  if (provide_clock_port) {
+    clock = g_object_new (GST_TYPE_SYSTEM_CLOCK, "clock-type",
+        GST_CLOCK_TYPE_REALTIME, NULL);
+    gst_pipeline_use_clock (pipeline, clock);
+    provider = gst_net_time_provider_new (clock, NULL, provide_clock_port);
+    if (!provider) {
+      g_printerr ("Failed to provide the clock on port %d\n",
+          provide_clock_port);
+      return 1;
+    }
+    g_printerr ("Providing clock %s on port %d\n", GST_OBJECT_NAME (clock),
+        provide_clock_port);
+    gst_object_unref (clock);
+  }
+
+  if (!rtsched_setup (epipeline))
+    return 1;
+  if (rtsched_enabled () || cost)
+    g_timeout_add_seconds (1, report_lateness, NULL);
+
   /* we add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
   gst_bus_add_watch (bus, bus_call, loop);
@@ -100,6 +273,7 @@ int main(int argc, char* argv[])
 
   g_main_loop_run (loop);
 
+  g_clear_object (&provider);
   return 0;
 }
 
@@ -111,6 +285,27 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 
   switch (GST_MESSAGE_TYPE (msg)) {
 
+    case GST_MESSAGE_ELEMENT: {
+      const GstStructure *s = gst_message_get_structure (msg);
+      guint64 frame_id, hold;
+      gint64 rtt;
+
+      if (gst_structure_has_name (s, "timestampoverlay-cost")) {
+        take_cost (s);
+        break;
+      }
+      if (gst_structure_has_name (s, "timeoverlayparse") &&
+          gst_structure_get (s,
+              "frame-id", G_TYPE_UINT64, &frame_id,
+              "hold", G_TYPE_UINT64, &hold,
+              "round-trip-time", G_TYPE_INT64, &rtt,
+              NULL))
+        g_print ("Frame-id: %" G_GUINT64_FORMAT "; Round-trip time: %"
+            G_GINT64_FORMAT "; Hold: %" G_GUINT64_FORMAT "\n", frame_id, rtt,
+            hold);
+      break;
+    }
+
     case GST_MESSAGE_EOS:
       g_print ("End of stream\n");
       g_main_loop_quit (loop);
@@ -136,6 +331,98 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
   return TRUE;
 }
 
+/* The round-trip times of --reflect-source are printed per frame, so this
+ * goes in between them, with the share of stamping in them */
+static gboolean
+report_lateness (gpointer data)
+{
+  RtSchedLateness lateness;
+  const gchar *sep = "";
+
+  if (cost_frames > 0) {
+    g_print ("Stamp cost mean/max: %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT
+        " ns", cost_mean, cost_max);
+    if (cost_cycles > 0)
+      g_print (", %" G_GUINT64_FORMAT " cycles/%" G_GUINT64_FORMAT
+          " cache misses per frame", cost_cycles / cost_frames,
+          cost_cache_misses / cost_frames);
+    sep = "; ";
+  }
+  if (rtsched_enabled ()) {
+    rtsched_take_lateness (&lateness);
+    g_print ("%sWakeup lateness mean/max: %" G_GUINT64_FORMAT "/%"
+        G_GUINT64_FORMAT " ns over %" G_GUINT64_FORMAT " wakeups", sep,
+        lateness.mean, lateness.max, lateness.wakeups);
+  }
+  if (*sep || rtsched_enabled ())
+    g_print ("\n");
+  return G_SOURCE_CONTINUE;
+}
+
+/* Reads the systime of a stamping or parsing element from the clock given
+ * on the command line.  All of them must read the same clock, or the
+ * latencies of different elements can't be combined. */
+static void
+set_time_source (GstBin *bin, const gchar *name)
+{
+  GstElement *element = gst_bin_get_by_name (bin, name);
+
+  if (!element)
+    return;
+  if (time_source)
+    gst_util_set_object_arg (G_OBJECT (element), "time-source", time_source);
+  if (net_clock_address)
+    g_object_set (element, "net-clock-address", net_clock_address, NULL);
+  if (net_clock_port)
+    g_object_set (element, "net-clock-port", net_clock_port, NULL);
+  gst_object_unref (element);
+}
+
+static void
+take_cost (const GstStructure *s)
+{
+  gst_structure_get (s,
+      "frames", G_TYPE_UINT64, &cost_frames,
+      "mean", G_TYPE_UINT64, &cost_mean,
+      "max", G_TYPE_UINT64, &cost_max,
+      NULL);
+  gst_structure_get (s,
+      "cycles", G_TYPE_UINT64, &cost_cycles,
+      "cache-misses", G_TYPE_UINT64, &cost_cache_misses,
+      NULL);
+}
+
+/* Counts the frames of the current mode in the streaming thread and leaves
+ * the switch to the main loop */
+static GstPadProbeReturn
+count_sweep_frames (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  if (g_atomic_int_dec_and_test (&sweep_frames_left))
+    g_idle_add (next_sweep_mode, data);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Renegotiates the running pipeline to the next mode of the sweep, or ends
+ * the stream after the last one */
+static gboolean
+next_sweep_mode (gpointer data)
+{
+  GstCaps *caps;
+
+  if (!sweep_caps[++sweep_index]) {
+    g_print ("Sweep finished\n");
+    gst_element_send_event (GST_ELEMENT (data), gst_event_new_eos ());
+    return G_SOURCE_REMOVE;
+  }
+
+  g_print ("Mode: %s\n", sweep_caps[sweep_index]);
+  caps = gst_caps_from_string (sweep_caps[sweep_index]);
+  g_atomic_int_set (&sweep_frames_left, sweep_frames);
+  g_object_set (mode_filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  return G_SOURCE_REMOVE;
+}
+
 struct frac {
     int n, d;
 };
@@ -151,6 +438,35 @@ struct frac fps_to_frac(double fps) {
   return out;
 }
 
+/* Turns a mode of --sweep, WIDTHxHEIGHT@FPS with FPS a fraction like
+ * 30000/1001 or a number like 59.94, into caps.  Returns NULL if the mode
+ * can't be parsed. */
+static gchar*
+sweep_mode_caps (const gchar *mode)
+{
+  gint width, height, n = -1;
+  struct frac fps;
+  gchar *end;
+
+  if (sscanf (mode, "%dx%d@%n", &width, &height, &n) != 2 || n < 0 ||
+      width <= 0 || height <= 0)
+    return NULL;
+  mode += n;
+  if (strchr (mode, '/')) {
+    if (sscanf (mode, "%d/%d%n", &fps.n, &fps.d, &n) != 2 ||
+        mode[n] != '\0' || fps.n <= 0 || fps.d <= 0)
+      return NULL;
+  } else {
+    double rate = g_ascii_strtod (mode, &end);
+
+    if (end == mode || *end != '\0' || rate <= 0)
+      return NULL;
+    fps = fps_to_frac (rate);
+  }
+  return g_strdup_printf ("video/x-raw,width=%d,height=%d,framerate=%d/%d",
+      width, height, fps.n, fps.d);
+}
+
 static gchar*
 get_current_mode (void)
 {